@@ -1,24 +1,37 @@
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <structmember.h>
 
 #include <assert.h>
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
+#include <FLAC/metadata.h>
 #include <FLAC/stream_decoder.h>
 #include <FLAC/stream_encoder.h>
 
 #ifdef _WIN32
+# include <windows.h>
 # include <io.h>
+# include <sys/types.h>
+# include <sys/stat.h>
 # undef lseek
 # undef off_t
+# undef fstat
+# undef stat
 # define lseek _lseeki64
 # define off_t __int64
+# define fstat _fstati64
+# define stat _stati64
 #else
 # include <sys/types.h>
+# include <sys/stat.h>
 # include <unistd.h>
+# include <pthread.h>
 #endif
 
 /* PyBUF_READ and PyBUF_WRITE were not formally added to the limited
@@ -45,16 +58,118 @@
 # define Py_END_CRITICAL_SECTION() }
 #endif
 
+/* PyMem_RawRealloc and PyMem_RawFree were not added to the limited
+   API until 3.13 */
+#if defined(Py_LIMITED_API) && Py_LIMITED_API + 0 < 0x030d0000
+# define PyMem_RawRealloc realloc
+# define PyMem_RawFree free
+#endif
+
 /****************************************************************/
 
 #ifndef OFF_MAX
 # define OFF_MAX ((((off_t) 1 << (sizeof(off_t) * CHAR_BIT - 2)) - 1) * 2 + 1)
 #endif
 
+/* Read from a file at a given offset, without using or changing the
+   file position.  The file is read through a pread_handle_t, which
+   fd_pread_open creates from a file descriptor and fd_pread_close
+   releases.
+
+   On Windows, ReadFile with an OVERLAPPED offset still moves the file
+   pointer if the handle was opened for synchronous I/O, which would
+   disturb other users of the same descriptor.  So the descriptor's
+   handle is reopened for overlapped I/O, which has no file pointer.  */
+#ifdef _WIN32
+typedef HANDLE pread_handle_t;
+# define PREAD_HANDLE_NONE INVALID_HANDLE_VALUE
+
+static pread_handle_t
+fd_pread_open(int fd)
+{
+    HANDLE handle = (HANDLE) _get_osfhandle(fd);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        errno = EBADF;
+        return INVALID_HANDLE_VALUE;
+    }
+    handle = ReOpenFile(handle, GENERIC_READ,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_FLAG_OVERLAPPED);
+    if (handle == INVALID_HANDLE_VALUE)
+        errno = (GetLastError() == ERROR_ACCESS_DENIED ? EACCES : EIO);
+    return handle;
+}
+
+static void
+fd_pread_close(pread_handle_t handle)
+{
+    CloseHandle(handle);
+}
+
+static Py_ssize_t
+fd_pread(pread_handle_t handle, void *buffer, size_t count, off_t offset)
+{
+    OVERLAPPED overlapped;
+    DWORD n;
+
+    if (count > INT_MAX)
+        count = INT_MAX;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+    if (!ReadFile(handle, buffer, (DWORD) count, NULL, &overlapped)
+        && GetLastError() != ERROR_IO_PENDING) {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        errno = EIO;
+        return -1;
+    }
+    if (!GetOverlappedResult(handle, &overlapped, &n, TRUE)) {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+#else
+typedef int pread_handle_t;
+# define PREAD_HANDLE_NONE (-1)
+# define fd_pread_open(fd) (fd)
+# define fd_pread_close(handle) ((void) 0)
+# define fd_pread pread
+#endif
+
+/* Interval for checking whether a followed file has grown, in
+   milliseconds.  */
+#define FOLLOW_POLL_INTERVAL 10
+
+static void
+sleep_ms(unsigned int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/* Maximum number of points that fit in a SEEKTABLE block */
+#define MAX_SEEK_POINTS (((1 << 24) - 1) / 18)
+
+/* Maximum number of bits for decoder sample histograms */
+#define MAX_HISTOGRAM_BITS 16
+
 #if INT_MAX == 0x7fffffff
 # define INT32_FORMAT "i"
+# define UINT32_FORMAT "I"
 #elif LONG_MAX == 0x7fffffff
 # define INT32_FORMAT "l"
+# define UINT32_FORMAT "L"
 #else
 # error "type of int32 is unknown!"
 #endif
@@ -140,6 +255,23 @@ MemoryView_FromMem(void *ptr, size_t size)
 #endif
 }
 
+static PyObject *
+Array_FromMem(const void *ptr, size_t size, const char *format)
+{
+    PyObject *bytes, *memview, *array;
+
+    bytes = PyByteArray_FromStringAndSize(ptr, size);
+    if (!bytes)
+        return NULL;
+    memview = PyMemoryView_FromObject(bytes);
+    Py_DECREF(bytes);
+    if (!memview)
+        return NULL;
+    array = PyObject_CallMethod(memview, "cast", "(s)", format);
+    Py_DECREF(memview);
+    return array;
+}
+
 static unsigned long
 get_python_version(void)
 {
@@ -160,6 +292,729 @@ get_python_version(void)
     return ((major_n << 24) + (minor_n << 16));
 }
 
+/****************************************************************/
+/* Frame headers */
+
+/* Maximum length of a frame header, including the CRC-8 */
+#define MAX_FRAME_HEADER_LENGTH 16
+
+static const FLAC__uint8 crc8_table[256] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31,
+    0x24, 0x23, 0x2a, 0x2d, 0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65,
+    0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d, 0xe0, 0xe7, 0xee, 0xe9,
+    0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1,
+    0xb4, 0xb3, 0xba, 0xbd, 0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2,
+    0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea, 0xb7, 0xb0, 0xb9, 0xbe,
+    0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16,
+    0x03, 0x04, 0x0d, 0x0a, 0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42,
+    0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a, 0x89, 0x8e, 0x87, 0x80,
+    0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8,
+    0xdd, 0xda, 0xd3, 0xd4, 0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c,
+    0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44, 0x19, 0x1e, 0x17, 0x10,
+    0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f,
+    0x6a, 0x6d, 0x64, 0x63, 0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b,
+    0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13, 0xae, 0xa9, 0xa0, 0xa7,
+    0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef,
+    0xfa, 0xfd, 0xf4, 0xf3
+};
+
+static const FLAC__uint16 crc16_table[256] = {
+    0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011, 0x8033,
+    0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022, 0x8063, 0x0066,
+    0x006c, 0x8069, 0x0078, 0x807d, 0x8077, 0x0072, 0x0050, 0x8055, 0x805f,
+    0x005a, 0x804b, 0x004e, 0x0044, 0x8041, 0x80c3, 0x00c6, 0x00cc, 0x80c9,
+    0x00d8, 0x80dd, 0x80d7, 0x00d2, 0x00f0, 0x80f5, 0x80ff, 0x00fa, 0x80eb,
+    0x00ee, 0x00e4, 0x80e1, 0x00a0, 0x80a5, 0x80af, 0x00aa, 0x80bb, 0x00be,
+    0x00b4, 0x80b1, 0x8093, 0x0096, 0x009c, 0x8099, 0x0088, 0x808d, 0x8087,
+    0x0082, 0x8183, 0x0186, 0x018c, 0x8189, 0x0198, 0x819d, 0x8197, 0x0192,
+    0x01b0, 0x81b5, 0x81bf, 0x01ba, 0x81ab, 0x01ae, 0x01a4, 0x81a1, 0x01e0,
+    0x81e5, 0x81ef, 0x01ea, 0x81fb, 0x01fe, 0x01f4, 0x81f1, 0x81d3, 0x01d6,
+    0x01dc, 0x81d9, 0x01c8, 0x81cd, 0x81c7, 0x01c2, 0x0140, 0x8145, 0x814f,
+    0x014a, 0x815b, 0x015e, 0x0154, 0x8151, 0x8173, 0x0176, 0x017c, 0x8179,
+    0x0168, 0x816d, 0x8167, 0x0162, 0x8123, 0x0126, 0x012c, 0x8129, 0x0138,
+    0x813d, 0x8137, 0x0132, 0x0110, 0x8115, 0x811f, 0x011a, 0x810b, 0x010e,
+    0x0104, 0x8101, 0x8303, 0x0306, 0x030c, 0x8309, 0x0318, 0x831d, 0x8317,
+    0x0312, 0x0330, 0x8335, 0x833f, 0x033a, 0x832b, 0x032e, 0x0324, 0x8321,
+    0x0360, 0x8365, 0x836f, 0x036a, 0x837b, 0x037e, 0x0374, 0x8371, 0x8353,
+    0x0356, 0x035c, 0x8359, 0x0348, 0x834d, 0x8347, 0x0342, 0x03c0, 0x83c5,
+    0x83cf, 0x03ca, 0x83db, 0x03de, 0x03d4, 0x83d1, 0x83f3, 0x03f6, 0x03fc,
+    0x83f9, 0x03e8, 0x83ed, 0x83e7, 0x03e2, 0x83a3, 0x03a6, 0x03ac, 0x83a9,
+    0x03b8, 0x83bd, 0x83b7, 0x03b2, 0x0390, 0x8395, 0x839f, 0x039a, 0x838b,
+    0x038e, 0x0384, 0x8381, 0x0280, 0x8285, 0x828f, 0x028a, 0x829b, 0x029e,
+    0x0294, 0x8291, 0x82b3, 0x02b6, 0x02bc, 0x82b9, 0x02a8, 0x82ad, 0x82a7,
+    0x02a2, 0x82e3, 0x02e6, 0x02ec, 0x82e9, 0x02f8, 0x82fd, 0x82f7, 0x02f2,
+    0x02d0, 0x82d5, 0x82df, 0x02da, 0x82cb, 0x02ce, 0x02c4, 0x82c1, 0x8243,
+    0x0246, 0x024c, 0x8249, 0x0258, 0x825d, 0x8257, 0x0252, 0x0270, 0x8275,
+    0x827f, 0x027a, 0x826b, 0x026e, 0x0264, 0x8261, 0x0220, 0x8225, 0x822f,
+    0x022a, 0x823b, 0x023e, 0x0234, 0x8231, 0x8213, 0x0216, 0x021c, 0x8219,
+    0x0208, 0x820d, 0x8207, 0x0202
+};
+
+static FLAC__uint8
+crc8(const FLAC__byte *data, size_t len)
+{
+    FLAC__uint8 crc = 0;
+    while (len-- > 0)
+        crc = crc8_table[crc ^ *data++];
+    return crc;
+}
+
+/* crc16_wide_table[k][x] is the CRC-16 of byte x followed by k + 1
+   zero bytes, for processing eight bytes at a time.  It is derived
+   from crc16_table, and stored here (rather than computed when the
+   module is loaded) so that it is never written while another
+   interpreter may be reading it. */
+static const FLAC__uint16 crc16_wide_table[7][256] = {
+    {
+        0x0000, 0x8603, 0x8c03, 0x0a00, 0x9803, 0x1e00, 0x1400, 0x9203,
+        0xb003, 0x3600, 0x3c00, 0xba03, 0x2800, 0xae03, 0xa403, 0x2200,
+        0xe003, 0x6600, 0x6c00, 0xea03, 0x7800, 0xfe03, 0xf403, 0x7200,
+        0x5000, 0xd603, 0xdc03, 0x5a00, 0xc803, 0x4e00, 0x4400, 0xc203,
+        0x4003, 0xc600, 0xcc00, 0x4a03, 0xd800, 0x5e03, 0x5403, 0xd200,
+        0xf000, 0x7603, 0x7c03, 0xfa00, 0x6803, 0xee00, 0xe400, 0x6203,
+        0xa000, 0x2603, 0x2c03, 0xaa00, 0x3803, 0xbe00, 0xb400, 0x3203,
+        0x1003, 0x9600, 0x9c00, 0x1a03, 0x8800, 0x0e03, 0x0403, 0x8200,
+        0x8006, 0x0605, 0x0c05, 0x8a06, 0x1805, 0x9e06, 0x9406, 0x1205,
+        0x3005, 0xb606, 0xbc06, 0x3a05, 0xa806, 0x2e05, 0x2405, 0xa206,
+        0x6005, 0xe606, 0xec06, 0x6a05, 0xf806, 0x7e05, 0x7405, 0xf206,
+        0xd006, 0x5605, 0x5c05, 0xda06, 0x4805, 0xce06, 0xc406, 0x4205,
+        0xc005, 0x4606, 0x4c06, 0xca05, 0x5806, 0xde05, 0xd405, 0x5206,
+        0x7006, 0xf605, 0xfc05, 0x7a06, 0xe805, 0x6e06, 0x6406, 0xe205,
+        0x2006, 0xa605, 0xac05, 0x2a06, 0xb805, 0x3e06, 0x3406, 0xb205,
+        0x9005, 0x1606, 0x1c06, 0x9a05, 0x0806, 0x8e05, 0x8405, 0x0206,
+        0x8009, 0x060a, 0x0c0a, 0x8a09, 0x180a, 0x9e09, 0x9409, 0x120a,
+        0x300a, 0xb609, 0xbc09, 0x3a0a, 0xa809, 0x2e0a, 0x240a, 0xa209,
+        0x600a, 0xe609, 0xec09, 0x6a0a, 0xf809, 0x7e0a, 0x740a, 0xf209,
+        0xd009, 0x560a, 0x5c0a, 0xda09, 0x480a, 0xce09, 0xc409, 0x420a,
+        0xc00a, 0x4609, 0x4c09, 0xca0a, 0x5809, 0xde0a, 0xd40a, 0x5209,
+        0x7009, 0xf60a, 0xfc0a, 0x7a09, 0xe80a, 0x6e09, 0x6409, 0xe20a,
+        0x2009, 0xa60a, 0xac0a, 0x2a09, 0xb80a, 0x3e09, 0x3409, 0xb20a,
+        0x900a, 0x1609, 0x1c09, 0x9a0a, 0x0809, 0x8e0a, 0x840a, 0x0209,
+        0x000f, 0x860c, 0x8c0c, 0x0a0f, 0x980c, 0x1e0f, 0x140f, 0x920c,
+        0xb00c, 0x360f, 0x3c0f, 0xba0c, 0x280f, 0xae0c, 0xa40c, 0x220f,
+        0xe00c, 0x660f, 0x6c0f, 0xea0c, 0x780f, 0xfe0c, 0xf40c, 0x720f,
+        0x500f, 0xd60c, 0xdc0c, 0x5a0f, 0xc80c, 0x4e0f, 0x440f, 0xc20c,
+        0x400c, 0xc60f, 0xcc0f, 0x4a0c, 0xd80f, 0x5e0c, 0x540c, 0xd20f,
+        0xf00f, 0x760c, 0x7c0c, 0xfa0f, 0x680c, 0xee0f, 0xe40f, 0x620c,
+        0xa00f, 0x260c, 0x2c0c, 0xaa0f, 0x380c, 0xbe0f, 0xb40f, 0x320c,
+        0x100c, 0x960f, 0x9c0f, 0x1a0c, 0x880f, 0x0e0c, 0x040c, 0x820f
+    },
+    {
+        0x0000, 0x8017, 0x802b, 0x003c, 0x8053, 0x0044, 0x0078, 0x806f,
+        0x80a3, 0x00b4, 0x0088, 0x809f, 0x00f0, 0x80e7, 0x80db, 0x00cc,
+        0x8143, 0x0154, 0x0168, 0x817f, 0x0110, 0x8107, 0x813b, 0x012c,
+        0x01e0, 0x81f7, 0x81cb, 0x01dc, 0x81b3, 0x01a4, 0x0198, 0x818f,
+        0x8283, 0x0294, 0x02a8, 0x82bf, 0x02d0, 0x82c7, 0x82fb, 0x02ec,
+        0x0220, 0x8237, 0x820b, 0x021c, 0x8273, 0x0264, 0x0258, 0x824f,
+        0x03c0, 0x83d7, 0x83eb, 0x03fc, 0x8393, 0x0384, 0x03b8, 0x83af,
+        0x8363, 0x0374, 0x0348, 0x835f, 0x0330, 0x8327, 0x831b, 0x030c,
+        0x8503, 0x0514, 0x0528, 0x853f, 0x0550, 0x8547, 0x857b, 0x056c,
+        0x05a0, 0x85b7, 0x858b, 0x059c, 0x85f3, 0x05e4, 0x05d8, 0x85cf,
+        0x0440, 0x8457, 0x846b, 0x047c, 0x8413, 0x0404, 0x0438, 0x842f,
+        0x84e3, 0x04f4, 0x04c8, 0x84df, 0x04b0, 0x84a7, 0x849b, 0x048c,
+        0x0780, 0x8797, 0x87ab, 0x07bc, 0x87d3, 0x07c4, 0x07f8, 0x87ef,
+        0x8723, 0x0734, 0x0708, 0x871f, 0x0770, 0x8767, 0x875b, 0x074c,
+        0x86c3, 0x06d4, 0x06e8, 0x86ff, 0x0690, 0x8687, 0x86bb, 0x06ac,
+        0x0660, 0x8677, 0x864b, 0x065c, 0x8633, 0x0624, 0x0618, 0x860f,
+        0x8a03, 0x0a14, 0x0a28, 0x8a3f, 0x0a50, 0x8a47, 0x8a7b, 0x0a6c,
+        0x0aa0, 0x8ab7, 0x8a8b, 0x0a9c, 0x8af3, 0x0ae4, 0x0ad8, 0x8acf,
+        0x0b40, 0x8b57, 0x8b6b, 0x0b7c, 0x8b13, 0x0b04, 0x0b38, 0x8b2f,
+        0x8be3, 0x0bf4, 0x0bc8, 0x8bdf, 0x0bb0, 0x8ba7, 0x8b9b, 0x0b8c,
+        0x0880, 0x8897, 0x88ab, 0x08bc, 0x88d3, 0x08c4, 0x08f8, 0x88ef,
+        0x8823, 0x0834, 0x0808, 0x881f, 0x0870, 0x8867, 0x885b, 0x084c,
+        0x89c3, 0x09d4, 0x09e8, 0x89ff, 0x0990, 0x8987, 0x89bb, 0x09ac,
+        0x0960, 0x8977, 0x894b, 0x095c, 0x8933, 0x0924, 0x0918, 0x890f,
+        0x0f00, 0x8f17, 0x8f2b, 0x0f3c, 0x8f53, 0x0f44, 0x0f78, 0x8f6f,
+        0x8fa3, 0x0fb4, 0x0f88, 0x8f9f, 0x0ff0, 0x8fe7, 0x8fdb, 0x0fcc,
+        0x8e43, 0x0e54, 0x0e68, 0x8e7f, 0x0e10, 0x8e07, 0x8e3b, 0x0e2c,
+        0x0ee0, 0x8ef7, 0x8ecb, 0x0edc, 0x8eb3, 0x0ea4, 0x0e98, 0x8e8f,
+        0x8d83, 0x0d94, 0x0da8, 0x8dbf, 0x0dd0, 0x8dc7, 0x8dfb, 0x0dec,
+        0x0d20, 0x8d37, 0x8d0b, 0x0d1c, 0x8d73, 0x0d64, 0x0d58, 0x8d4f,
+        0x0cc0, 0x8cd7, 0x8ceb, 0x0cfc, 0x8c93, 0x0c84, 0x0cb8, 0x8caf,
+        0x8c63, 0x0c74, 0x0c48, 0x8c5f, 0x0c30, 0x8c27, 0x8c1b, 0x0c0c
+    },
+    {
+        0x0000, 0x9403, 0xa803, 0x3c00, 0xd003, 0x4400, 0x7800, 0xec03,
+        0x2003, 0xb400, 0x8800, 0x1c03, 0xf000, 0x6403, 0x5803, 0xcc00,
+        0x4006, 0xd405, 0xe805, 0x7c06, 0x9005, 0x0406, 0x3806, 0xac05,
+        0x6005, 0xf406, 0xc806, 0x5c05, 0xb006, 0x2405, 0x1805, 0x8c06,
+        0x800c, 0x140f, 0x280f, 0xbc0c, 0x500f, 0xc40c, 0xf80c, 0x6c0f,
+        0xa00f, 0x340c, 0x080c, 0x9c0f, 0x700c, 0xe40f, 0xd80f, 0x4c0c,
+        0xc00a, 0x5409, 0x6809, 0xfc0a, 0x1009, 0x840a, 0xb80a, 0x2c09,
+        0xe009, 0x740a, 0x480a, 0xdc09, 0x300a, 0xa409, 0x9809, 0x0c0a,
+        0x801d, 0x141e, 0x281e, 0xbc1d, 0x501e, 0xc41d, 0xf81d, 0x6c1e,
+        0xa01e, 0x341d, 0x081d, 0x9c1e, 0x701d, 0xe41e, 0xd81e, 0x4c1d,
+        0xc01b, 0x5418, 0x6818, 0xfc1b, 0x1018, 0x841b, 0xb81b, 0x2c18,
+        0xe018, 0x741b, 0x481b, 0xdc18, 0x301b, 0xa418, 0x9818, 0x0c1b,
+        0x0011, 0x9412, 0xa812, 0x3c11, 0xd012, 0x4411, 0x7811, 0xec12,
+        0x2012, 0xb411, 0x8811, 0x1c12, 0xf011, 0x6412, 0x5812, 0xcc11,
+        0x4017, 0xd414, 0xe814, 0x7c17, 0x9014, 0x0417, 0x3817, 0xac14,
+        0x6014, 0xf417, 0xc817, 0x5c14, 0xb017, 0x2414, 0x1814, 0x8c17,
+        0x803f, 0x143c, 0x283c, 0xbc3f, 0x503c, 0xc43f, 0xf83f, 0x6c3c,
+        0xa03c, 0x343f, 0x083f, 0x9c3c, 0x703f, 0xe43c, 0xd83c, 0x4c3f,
+        0xc039, 0x543a, 0x683a, 0xfc39, 0x103a, 0x8439, 0xb839, 0x2c3a,
+        0xe03a, 0x7439, 0x4839, 0xdc3a, 0x3039, 0xa43a, 0x983a, 0x0c39,
+        0x0033, 0x9430, 0xa830, 0x3c33, 0xd030, 0x4433, 0x7833, 0xec30,
+        0x2030, 0xb433, 0x8833, 0x1c30, 0xf033, 0x6430, 0x5830, 0xcc33,
+        0x4035, 0xd436, 0xe836, 0x7c35, 0x9036, 0x0435, 0x3835, 0xac36,
+        0x6036, 0xf435, 0xc835, 0x5c36, 0xb035, 0x2436, 0x1836, 0x8c35,
+        0x0022, 0x9421, 0xa821, 0x3c22, 0xd021, 0x4422, 0x7822, 0xec21,
+        0x2021, 0xb422, 0x8822, 0x1c21, 0xf022, 0x6421, 0x5821, 0xcc22,
+        0x4024, 0xd427, 0xe827, 0x7c24, 0x9027, 0x0424, 0x3824, 0xac27,
+        0x6027, 0xf424, 0xc824, 0x5c27, 0xb024, 0x2427, 0x1827, 0x8c24,
+        0x802e, 0x142d, 0x282d, 0xbc2e, 0x502d, 0xc42e, 0xf82e, 0x6c2d,
+        0xa02d, 0x342e, 0x082e, 0x9c2d, 0x702e, 0xe42d, 0xd82d, 0x4c2e,
+        0xc028, 0x542b, 0x682b, 0xfc28, 0x102b, 0x8428, 0xb828, 0x2c2b,
+        0xe02b, 0x7428, 0x4828, 0xdc2b, 0x3028, 0xa42b, 0x982b, 0x0c28
+    },
+    {
+        0x0000, 0x807b, 0x80f3, 0x0088, 0x81e3, 0x0198, 0x0110, 0x816b,
+        0x83c3, 0x03b8, 0x0330, 0x834b, 0x0220, 0x825b, 0x82d3, 0x02a8,
+        0x8783, 0x07f8, 0x0770, 0x870b, 0x0660, 0x861b, 0x8693, 0x06e8,
+        0x0440, 0x843b, 0x84b3, 0x04c8, 0x85a3, 0x05d8, 0x0550, 0x852b,
+        0x8f03, 0x0f78, 0x0ff0, 0x8f8b, 0x0ee0, 0x8e9b, 0x8e13, 0x0e68,
+        0x0cc0, 0x8cbb, 0x8c33, 0x0c48, 0x8d23, 0x0d58, 0x0dd0, 0x8dab,
+        0x0880, 0x88fb, 0x8873, 0x0808, 0x8963, 0x0918, 0x0990, 0x89eb,
+        0x8b43, 0x0b38, 0x0bb0, 0x8bcb, 0x0aa0, 0x8adb, 0x8a53, 0x0a28,
+        0x9e03, 0x1e78, 0x1ef0, 0x9e8b, 0x1fe0, 0x9f9b, 0x9f13, 0x1f68,
+        0x1dc0, 0x9dbb, 0x9d33, 0x1d48, 0x9c23, 0x1c58, 0x1cd0, 0x9cab,
+        0x1980, 0x99fb, 0x9973, 0x1908, 0x9863, 0x1818, 0x1890, 0x98eb,
+        0x9a43, 0x1a38, 0x1ab0, 0x9acb, 0x1ba0, 0x9bdb, 0x9b53, 0x1b28,
+        0x1100, 0x917b, 0x91f3, 0x1188, 0x90e3, 0x1098, 0x1010, 0x906b,
+        0x92c3, 0x12b8, 0x1230, 0x924b, 0x1320, 0x935b, 0x93d3, 0x13a8,
+        0x9683, 0x16f8, 0x1670, 0x960b, 0x1760, 0x971b, 0x9793, 0x17e8,
+        0x1540, 0x953b, 0x95b3, 0x15c8, 0x94a3, 0x14d8, 0x1450, 0x942b,
+        0xbc03, 0x3c78, 0x3cf0, 0xbc8b, 0x3de0, 0xbd9b, 0xbd13, 0x3d68,
+        0x3fc0, 0xbfbb, 0xbf33, 0x3f48, 0xbe23, 0x3e58, 0x3ed0, 0xbeab,
+        0x3b80, 0xbbfb, 0xbb73, 0x3b08, 0xba63, 0x3a18, 0x3a90, 0xbaeb,
+        0xb843, 0x3838, 0x38b0, 0xb8cb, 0x39a0, 0xb9db, 0xb953, 0x3928,
+        0x3300, 0xb37b, 0xb3f3, 0x3388, 0xb2e3, 0x3298, 0x3210, 0xb26b,
+        0xb0c3, 0x30b8, 0x3030, 0xb04b, 0x3120, 0xb15b, 0xb1d3, 0x31a8,
+        0xb483, 0x34f8, 0x3470, 0xb40b, 0x3560, 0xb51b, 0xb593, 0x35e8,
+        0x3740, 0xb73b, 0xb7b3, 0x37c8, 0xb6a3, 0x36d8, 0x3650, 0xb62b,
+        0x2200, 0xa27b, 0xa2f3, 0x2288, 0xa3e3, 0x2398, 0x2310, 0xa36b,
+        0xa1c3, 0x21b8, 0x2130, 0xa14b, 0x2020, 0xa05b, 0xa0d3, 0x20a8,
+        0xa583, 0x25f8, 0x2570, 0xa50b, 0x2460, 0xa41b, 0xa493, 0x24e8,
+        0x2640, 0xa63b, 0xa6b3, 0x26c8, 0xa7a3, 0x27d8, 0x2750, 0xa72b,
+        0xad03, 0x2d78, 0x2df0, 0xad8b, 0x2ce0, 0xac9b, 0xac13, 0x2c68,
+        0x2ec0, 0xaebb, 0xae33, 0x2e48, 0xaf23, 0x2f58, 0x2fd0, 0xafab,
+        0x2a80, 0xaafb, 0xaa73, 0x2a08, 0xab63, 0x2b18, 0x2b90, 0xabeb,
+        0xa943, 0x2938, 0x29b0, 0xa9cb, 0x28a0, 0xa8db, 0xa853, 0x2828
+    },
+    {
+        0x0000, 0xf803, 0x7003, 0x8800, 0xe006, 0x1805, 0x9005, 0x6806,
+        0x4009, 0xb80a, 0x300a, 0xc809, 0xa00f, 0x580c, 0xd00c, 0x280f,
+        0x8012, 0x7811, 0xf011, 0x0812, 0x6014, 0x9817, 0x1017, 0xe814,
+        0xc01b, 0x3818, 0xb018, 0x481b, 0x201d, 0xd81e, 0x501e, 0xa81d,
+        0x8021, 0x7822, 0xf022, 0x0821, 0x6027, 0x9824, 0x1024, 0xe827,
+        0xc028, 0x382b, 0xb02b, 0x4828, 0x202e, 0xd82d, 0x502d, 0xa82e,
+        0x0033, 0xf830, 0x7030, 0x8833, 0xe035, 0x1836, 0x9036, 0x6835,
+        0x403a, 0xb839, 0x3039, 0xc83a, 0xa03c, 0x583f, 0xd03f, 0x283c,
+        0x8047, 0x7844, 0xf044, 0x0847, 0x6041, 0x9842, 0x1042, 0xe841,
+        0xc04e, 0x384d, 0xb04d, 0x484e, 0x2048, 0xd84b, 0x504b, 0xa848,
+        0x0055, 0xf856, 0x7056, 0x8855, 0xe053, 0x1850, 0x9050, 0x6853,
+        0x405c, 0xb85f, 0x305f, 0xc85c, 0xa05a, 0x5859, 0xd059, 0x285a,
+        0x0066, 0xf865, 0x7065, 0x8866, 0xe060, 0x1863, 0x9063, 0x6860,
+        0x406f, 0xb86c, 0x306c, 0xc86f, 0xa069, 0x586a, 0xd06a, 0x2869,
+        0x8074, 0x7877, 0xf077, 0x0874, 0x6072, 0x9871, 0x1071, 0xe872,
+        0xc07d, 0x387e, 0xb07e, 0x487d, 0x207b, 0xd878, 0x5078, 0xa87b,
+        0x808b, 0x7888, 0xf088, 0x088b, 0x608d, 0x988e, 0x108e, 0xe88d,
+        0xc082, 0x3881, 0xb081, 0x4882, 0x2084, 0xd887, 0x5087, 0xa884,
+        0x0099, 0xf89a, 0x709a, 0x8899, 0xe09f, 0x189c, 0x909c, 0x689f,
+        0x4090, 0xb893, 0x3093, 0xc890, 0xa096, 0x5895, 0xd095, 0x2896,
+        0x00aa, 0xf8a9, 0x70a9, 0x88aa, 0xe0ac, 0x18af, 0x90af, 0x68ac,
+        0x40a3, 0xb8a0, 0x30a0, 0xc8a3, 0xa0a5, 0x58a6, 0xd0a6, 0x28a5,
+        0x80b8, 0x78bb, 0xf0bb, 0x08b8, 0x60be, 0x98bd, 0x10bd, 0xe8be,
+        0xc0b1, 0x38b2, 0xb0b2, 0x48b1, 0x20b7, 0xd8b4, 0x50b4, 0xa8b7,
+        0x00cc, 0xf8cf, 0x70cf, 0x88cc, 0xe0ca, 0x18c9, 0x90c9, 0x68ca,
+        0x40c5, 0xb8c6, 0x30c6, 0xc8c5, 0xa0c3, 0x58c0, 0xd0c0, 0x28c3,
+        0x80de, 0x78dd, 0xf0dd, 0x08de, 0x60d8, 0x98db, 0x10db, 0xe8d8,
+        0xc0d7, 0x38d4, 0xb0d4, 0x48d7, 0x20d1, 0xd8d2, 0x50d2, 0xa8d1,
+        0x80ed, 0x78ee, 0xf0ee, 0x08ed, 0x60eb, 0x98e8, 0x10e8, 0xe8eb,
+        0xc0e4, 0x38e7, 0xb0e7, 0x48e4, 0x20e2, 0xd8e1, 0x50e1, 0xa8e2,
+        0x00ff, 0xf8fc, 0x70fc, 0x88ff, 0xe0f9, 0x18fa, 0x90fa, 0x68f9,
+        0x40f6, 0xb8f5, 0x30f5, 0xc8f6, 0xa0f0, 0x58f3, 0xd0f3, 0x28f0
+    },
+    {
+        0x0000, 0x8113, 0x8223, 0x0330, 0x8443, 0x0550, 0x0660, 0x8773,
+        0x8883, 0x0990, 0x0aa0, 0x8bb3, 0x0cc0, 0x8dd3, 0x8ee3, 0x0ff0,
+        0x9103, 0x1010, 0x1320, 0x9233, 0x1540, 0x9453, 0x9763, 0x1670,
+        0x1980, 0x9893, 0x9ba3, 0x1ab0, 0x9dc3, 0x1cd0, 0x1fe0, 0x9ef3,
+        0xa203, 0x2310, 0x2020, 0xa133, 0x2640, 0xa753, 0xa463, 0x2570,
+        0x2a80, 0xab93, 0xa8a3, 0x29b0, 0xaec3, 0x2fd0, 0x2ce0, 0xadf3,
+        0x3300, 0xb213, 0xb123, 0x3030, 0xb743, 0x3650, 0x3560, 0xb473,
+        0xbb83, 0x3a90, 0x39a0, 0xb8b3, 0x3fc0, 0xbed3, 0xbde3, 0x3cf0,
+        0xc403, 0x4510, 0x4620, 0xc733, 0x4040, 0xc153, 0xc263, 0x4370,
+        0x4c80, 0xcd93, 0xcea3, 0x4fb0, 0xc8c3, 0x49d0, 0x4ae0, 0xcbf3,
+        0x5500, 0xd413, 0xd723, 0x5630, 0xd143, 0x5050, 0x5360, 0xd273,
+        0xdd83, 0x5c90, 0x5fa0, 0xdeb3, 0x59c0, 0xd8d3, 0xdbe3, 0x5af0,
+        0x6600, 0xe713, 0xe423, 0x6530, 0xe243, 0x6350, 0x6060, 0xe173,
+        0xee83, 0x6f90, 0x6ca0, 0xedb3, 0x6ac0, 0xebd3, 0xe8e3, 0x69f0,
+        0xf703, 0x7610, 0x7520, 0xf433, 0x7340, 0xf253, 0xf163, 0x7070,
+        0x7f80, 0xfe93, 0xfda3, 0x7cb0, 0xfbc3, 0x7ad0, 0x79e0, 0xf8f3,
+        0x0803, 0x8910, 0x8a20, 0x0b33, 0x8c40, 0x0d53, 0x0e63, 0x8f70,
+        0x8080, 0x0193, 0x02a3, 0x83b0, 0x04c3, 0x85d0, 0x86e0, 0x07f3,
+        0x9900, 0x1813, 0x1b23, 0x9a30, 0x1d43, 0x9c50, 0x9f60, 0x1e73,
+        0x1183, 0x9090, 0x93a0, 0x12b3, 0x95c0, 0x14d3, 0x17e3, 0x96f0,
+        0xaa00, 0x2b13, 0x2823, 0xa930, 0x2e43, 0xaf50, 0xac60, 0x2d73,
+        0x2283, 0xa390, 0xa0a0, 0x21b3, 0xa6c0, 0x27d3, 0x24e3, 0xa5f0,
+        0x3b03, 0xba10, 0xb920, 0x3833, 0xbf40, 0x3e53, 0x3d63, 0xbc70,
+        0xb380, 0x3293, 0x31a3, 0xb0b0, 0x37c3, 0xb6d0, 0xb5e0, 0x34f3,
+        0xcc00, 0x4d13, 0x4e23, 0xcf30, 0x4843, 0xc950, 0xca60, 0x4b73,
+        0x4483, 0xc590, 0xc6a0, 0x47b3, 0xc0c0, 0x41d3, 0x42e3, 0xc3f0,
+        0x5d03, 0xdc10, 0xdf20, 0x5e33, 0xd940, 0x5853, 0x5b63, 0xda70,
+        0xd580, 0x5493, 0x57a3, 0xd6b0, 0x51c3, 0xd0d0, 0xd3e0, 0x52f3,
+        0x6e03, 0xef10, 0xec20, 0x6d33, 0xea40, 0x6b53, 0x6863, 0xe970,
+        0xe680, 0x6793, 0x64a3, 0xe5b0, 0x62c3, 0xe3d0, 0xe0e0, 0x61f3,
+        0xff00, 0x7e13, 0x7d23, 0xfc30, 0x7b43, 0xfa50, 0xf960, 0x7873,
+        0x7783, 0xf690, 0xf5a0, 0x74b3, 0xf3c0, 0x72d3, 0x71e3, 0xf0f0
+    },
+    {
+        0x0000, 0x1006, 0x200c, 0x300a, 0x4018, 0x501e, 0x6014, 0x7012,
+        0x8030, 0x9036, 0xa03c, 0xb03a, 0xc028, 0xd02e, 0xe024, 0xf022,
+        0x8065, 0x9063, 0xa069, 0xb06f, 0xc07d, 0xd07b, 0xe071, 0xf077,
+        0x0055, 0x1053, 0x2059, 0x305f, 0x404d, 0x504b, 0x6041, 0x7047,
+        0x80cf, 0x90c9, 0xa0c3, 0xb0c5, 0xc0d7, 0xd0d1, 0xe0db, 0xf0dd,
+        0x00ff, 0x10f9, 0x20f3, 0x30f5, 0x40e7, 0x50e1, 0x60eb, 0x70ed,
+        0x00aa, 0x10ac, 0x20a6, 0x30a0, 0x40b2, 0x50b4, 0x60be, 0x70b8,
+        0x809a, 0x909c, 0xa096, 0xb090, 0xc082, 0xd084, 0xe08e, 0xf088,
+        0x819b, 0x919d, 0xa197, 0xb191, 0xc183, 0xd185, 0xe18f, 0xf189,
+        0x01ab, 0x11ad, 0x21a7, 0x31a1, 0x41b3, 0x51b5, 0x61bf, 0x71b9,
+        0x01fe, 0x11f8, 0x21f2, 0x31f4, 0x41e6, 0x51e0, 0x61ea, 0x71ec,
+        0x81ce, 0x91c8, 0xa1c2, 0xb1c4, 0xc1d6, 0xd1d0, 0xe1da, 0xf1dc,
+        0x0154, 0x1152, 0x2158, 0x315e, 0x414c, 0x514a, 0x6140, 0x7146,
+        0x8164, 0x9162, 0xa168, 0xb16e, 0xc17c, 0xd17a, 0xe170, 0xf176,
+        0x8131, 0x9137, 0xa13d, 0xb13b, 0xc129, 0xd12f, 0xe125, 0xf123,
+        0x0101, 0x1107, 0x210d, 0x310b, 0x4119, 0x511f, 0x6115, 0x7113,
+        0x8333, 0x9335, 0xa33f, 0xb339, 0xc32b, 0xd32d, 0xe327, 0xf321,
+        0x0303, 0x1305, 0x230f, 0x3309, 0x431b, 0x531d, 0x6317, 0x7311,
+        0x0356, 0x1350, 0x235a, 0x335c, 0x434e, 0x5348, 0x6342, 0x7344,
+        0x8366, 0x9360, 0xa36a, 0xb36c, 0xc37e, 0xd378, 0xe372, 0xf374,
+        0x03fc, 0x13fa, 0x23f0, 0x33f6, 0x43e4, 0x53e2, 0x63e8, 0x73ee,
+        0x83cc, 0x93ca, 0xa3c0, 0xb3c6, 0xc3d4, 0xd3d2, 0xe3d8, 0xf3de,
+        0x8399, 0x939f, 0xa395, 0xb393, 0xc381, 0xd387, 0xe38d, 0xf38b,
+        0x03a9, 0x13af, 0x23a5, 0x33a3, 0x43b1, 0x53b7, 0x63bd, 0x73bb,
+        0x02a8, 0x12ae, 0x22a4, 0x32a2, 0x42b0, 0x52b6, 0x62bc, 0x72ba,
+        0x8298, 0x929e, 0xa294, 0xb292, 0xc280, 0xd286, 0xe28c, 0xf28a,
+        0x82cd, 0x92cb, 0xa2c1, 0xb2c7, 0xc2d5, 0xd2d3, 0xe2d9, 0xf2df,
+        0x02fd, 0x12fb, 0x22f1, 0x32f7, 0x42e5, 0x52e3, 0x62e9, 0x72ef,
+        0x8267, 0x9261, 0xa26b, 0xb26d, 0xc27f, 0xd279, 0xe273, 0xf275,
+        0x0257, 0x1251, 0x225b, 0x325d, 0x424f, 0x5249, 0x6243, 0x7245,
+        0x0202, 0x1204, 0x220e, 0x3208, 0x421a, 0x521c, 0x6216, 0x7210,
+        0x8232, 0x9234, 0xa23e, 0xb238, 0xc22a, 0xd22c, 0xe226, 0xf220
+    }
+};
+
+static FLAC__uint16
+crc16(FLAC__uint16 crc, const FLAC__byte *data, size_t len)
+{
+    while (len >= 8) {
+        crc = (crc16_wide_table[6][data[0] ^ (crc >> 8)] ^
+               crc16_wide_table[5][data[1] ^ (crc & 0xff)] ^
+               crc16_wide_table[4][data[2]] ^
+               crc16_wide_table[3][data[3]] ^
+               crc16_wide_table[2][data[4]] ^
+               crc16_wide_table[1][data[5]] ^
+               crc16_wide_table[0][data[6]] ^
+               crc16_table[data[7]]);
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0)
+        crc = ((crc << 8) & 0xffff) ^ crc16_table[(crc >> 8) ^ *data++];
+    return crc;
+}
+
+typedef struct {
+    unsigned int header_length;
+    unsigned int number_offset;
+    unsigned int number_length;
+    FLAC__bool   variable_blocksize;
+    FLAC__uint64 number;
+    uint32_t     blocksize;
+    uint32_t     sample_rate;
+    uint32_t     channels;
+    uint32_t     channel_assignment;
+    uint32_t     bits_per_sample;
+} frame_header;
+
+/* Parse a frame header.  Returns 1 if the header is valid, 0 if it
+   is invalid, or -1 if more data is needed.  sample_rate and
+   bits_per_sample are set to zero if they are not given in the
+   header (and must be taken from STREAMINFO.) */
+static int
+parse_frame_header(const FLAC__byte *buf, size_t len, frame_header *h)
+{
+    static const uint32_t sample_rates[12] = {
+        0, 88200, 176400, 192000, 8000, 16000,
+        22050, 24000, 32000, 44100, 48000, 96000
+    };
+    static const uint32_t sample_sizes[8] = {
+        0, 8, 12, 0, 16, 20, 24, 32
+    };
+    unsigned int bs_code, sr_code, ch_code, n, i;
+    FLAC__uint64 number;
+
+    if (len < 4)
+        return (len == 0 || buf[0] == 0xff) ? -1 : 0;
+    if (buf[0] != 0xff || (buf[1] & 0xfe) != 0xf8 || (buf[3] & 1))
+        return 0;
+    h->variable_blocksize = buf[1] & 1;
+    bs_code = buf[2] >> 4;
+    sr_code = buf[2] & 0xf;
+    ch_code = buf[3] >> 4;
+    if (bs_code == 0 || sr_code == 15 || ch_code > 10 ||
+        ((buf[3] >> 1) & 7) == 3)
+        return 0;
+    h->channels = (ch_code < 8 ? ch_code + 1 : 2);
+    h->channel_assignment = ch_code;
+    h->bits_per_sample = sample_sizes[(buf[3] >> 1) & 7];
+
+    /* Frame or sample number, in UTF-8-like coding */
+    h->number_offset = i = 4;
+    if (len <= i)
+        return -1;
+    if (buf[i] < 0x80) {
+        number = buf[i];
+        n = 0;
+    } else if (buf[i] < 0xc0) {
+        return 0;
+    } else {
+        for (n = 1; n < 7 && (buf[i] & (0x40 >> n)); n++)
+            ;
+        if (n == 7)
+            return 0;
+        number = buf[i] & (0x3f >> n);
+    }
+    if (n > (h->variable_blocksize ? 6 : 5))
+        return 0;
+    i++;
+    while (n-- > 0) {
+        if (len <= i)
+            return -1;
+        if ((buf[i] & 0xc0) != 0x80)
+            return 0;
+        number = (number << 6) | (buf[i++] & 0x3f);
+    }
+    h->number = number;
+    h->number_length = i - h->number_offset;
+
+    if (bs_code == 1) {
+        h->blocksize = 192;
+    } else if (bs_code <= 5) {
+        h->blocksize = 576 << (bs_code - 2);
+    } else if (bs_code == 6) {
+        if (len <= i)
+            return -1;
+        h->blocksize = buf[i++] + 1;
+    } else if (bs_code == 7) {
+        if (len <= i + 1)
+            return -1;
+        h->blocksize = ((buf[i] << 8) | buf[i + 1]) + 1;
+        i += 2;
+    } else {
+        h->blocksize = 256 << (bs_code - 8);
+    }
+
+    if (sr_code < 12) {
+        h->sample_rate = sample_rates[sr_code];
+    } else if (sr_code == 12) {
+        if (len <= i)
+            return -1;
+        h->sample_rate = buf[i++] * 1000;
+    } else {
+        if (len <= i + 1)
+            return -1;
+        h->sample_rate = (buf[i] << 8) | buf[i + 1];
+        if (sr_code == 14)
+            h->sample_rate *= 10;
+        i += 2;
+    }
+
+    if (len <= i)
+        return -1;
+    if (crc8(buf, i) != buf[i])
+        return 0;
+    h->header_length = i + 1;
+    return 1;
+}
+
+/* Copy a complete frame from src to dest, replacing its number and
+   blocking strategy, and recomputing the CRCs.  dest must have room
+   for len + 6 bytes.  Returns the length of the new frame. */
+static size_t
+renumber_frame(FLAC__byte *dest, const FLAC__byte *src, size_t len,
+               const frame_header *h, FLAC__bool variable_blocksize,
+               FLAC__uint64 number)
+{
+    unsigned int n, i, rest;
+    size_t new_len;
+    FLAC__uint16 crc;
+
+    /* Encode the number */
+    memcpy(dest, src, h->number_offset);
+    dest[1] = 0xf8 | (variable_blocksize ? 1 : 0);
+    i = h->number_offset;
+    if (number < 0x80) {
+        dest[i++] = number;
+    } else {
+        for (n = 1; n < 6 && number >= ((FLAC__uint64) 1 << (5 * n + 6)); n++)
+            ;
+        dest[i++] = ((0xff00 >> (n + 1)) & 0xff) | (number >> (6 * n));
+        while (n-- > 0)
+            dest[i++] = 0x80 | ((number >> (6 * n)) & 0x3f);
+    }
+
+    /* Copy the remainder of the header, and compute the CRC-8 */
+    rest = h->header_length - 1 - h->number_offset - h->number_length;
+    memcpy(dest + i, src + h->number_offset + h->number_length, rest);
+    i += rest;
+    dest[i] = crc8(dest, i);
+    i++;
+
+    /* Copy the frame body, and compute the CRC-16 */
+    new_len = i + len - h->header_length;
+    memcpy(dest + i, src + h->header_length, len - h->header_length - 2);
+    crc = crc16(0, dest, new_len - 2);
+    dest[new_len - 2] = crc >> 8;
+    dest[new_len - 1] = crc & 0xff;
+    return new_len;
+}
+
+/****************************************************************/
+/* Frame scanning */
+
+typedef struct {
+    size_t       offset;
+    size_t       length;
+    frame_header header;
+} frame_record;
+
+/* Check whether a frame header is consistent with the stream
+   parameters in ref (where zero means the parameter is unknown.)
+   ref->blocksize is the maximum block size. */
+static int
+frame_header_matches(const frame_header *h, const frame_header *ref)
+{
+    return ((ref->channels == 0 || h->channels == ref->channels) &&
+            (ref->blocksize == 0 || h->blocksize <= ref->blocksize) &&
+            (ref->sample_rate == 0 || h->sample_rate == 0 ||
+             h->sample_rate == ref->sample_rate) &&
+            (ref->bits_per_sample == 0 || h->bits_per_sample == 0 ||
+             h->bits_per_sample == ref->bits_per_sample));
+}
+
+/* Search for a frame header, consistent with ref, starting at
+   buf[pos].  Returns the offset of the header, or len if there is
+   none.  If final is false and more data is needed to parse a
+   possible header, returns its offset and sets *more to 1. */
+static size_t
+find_frame_header(const FLAC__byte *buf, size_t len, size_t pos,
+                  FLAC__bool final, const frame_header *ref,
+                  frame_header *h, int *more)
+{
+    const FLAC__byte *p;
+    int valid;
+
+    while (pos < len) {
+        p = memchr(buf + pos, 0xff, len - pos);
+        if (!p)
+            return len;
+        pos = p - buf;
+        valid = parse_frame_header(p, len - pos, h);
+        if (valid == 1 && frame_header_matches(h, ref))
+            return pos;
+        if (valid < 0 && !final) {
+            *more = 1;
+            return pos;
+        }
+        pos++;
+    }
+    return len;
+}
+
+/* Upper bound on the size of a frame with the given header: a
+   verbatim subframe for every channel (allowing an extra bit per
+   sample for a side channel, and the subframe header and wasted-bits
+   count), plus the frame header and CRC-16. */
+static size_t
+max_frame_size(const frame_header *h, const frame_header *ref)
+{
+    size_t bits_per_sample = h->bits_per_sample;
+
+    if (bits_per_sample == 0)
+        bits_per_sample = ref->bits_per_sample;
+    if (bits_per_sample == 0)
+        bits_per_sample = 32;
+    return (h->header_length + 2 +
+            h->channels * (((size_t) h->blocksize * (bits_per_sample + 1)
+                            + 7) / 8 + 6));
+}
+
+/* Find complete frames in buf, storing up to max_records of them in
+   records.  A frame ends where the CRC-16 of its contents is zero and
+   it is followed by another frame header (or by the end of the
+   stream, if final is true.)  Damaged frames, and frames longer than
+   max_framesize (or, if that is zero, longer than any valid frame
+   could be), are skipped.  Sets *consumed to the offset where
+   scanning should resume, and returns the number of frames found. */
+static size_t
+scan_frames(const FLAC__byte *buf, size_t len, FLAC__bool final,
+            const frame_header *ref, size_t max_framesize,
+            frame_record *records, size_t max_records, size_t *consumed)
+{
+    size_t n = 0, start, pos, next, search, min_end, limit;
+    frame_header h, next_h;
+    FLAC__uint16 crc;
+    int more = 0, too_long;
+
+    start = find_frame_header(buf, len, 0, final, ref, &h, &more);
+    while (!more && n < max_records && start < len) {
+        pos = start + h.header_length;
+        min_end = pos + h.channels + 2;
+        crc = crc16(0, buf + start, h.header_length);
+        search = min_end;
+        limit = max_framesize ? max_framesize : max_frame_size(&h, ref);
+        too_long = 0;
+        for (;;) {
+            next = find_frame_header(buf, len, search, final,
+                                     ref, &next_h, &more);
+            if (next - start > limit) {
+                too_long = 1;
+                more = 0;
+                break;
+            }
+            crc = crc16(crc, buf + pos, next - pos);
+            pos = next;
+            if (more || pos == len || crc == 0)
+                break;
+            search = pos + 1;
+        }
+        if (too_long) {
+            /* The frame is damaged; look for the next header. */
+            start = find_frame_header(buf, len, start + 1, final,
+                                      ref, &h, &more);
+            continue;
+        }
+        if (more)
+            break;
+        if (pos == len) {
+            if (!final) {
+                more = 1;
+                break;
+            }
+            if (crc != 0 || pos < min_end) {
+                start = find_frame_header(buf, len, start + 1, final,
+                                          ref, &h, &more);
+                continue;
+            }
+        }
+        records[n].offset = start;
+        records[n].length = pos - start;
+        records[n].header = h;
+        n++;
+        start = pos;
+        h = next_h;
+    }
+    *consumed = start;
+    return n;
+}
+
+/****************************************************************/
+/* Raw PCM samples */
+
+/* Number of sample frames to convert at once */
+#define RAW_CHUNK_SIZE 4096
+
+typedef struct {
+    unsigned int size;          /* bytes per sample (1 to 4) */
+    int          big_endian;
+    int          is_unsigned;
+    unsigned int shift;         /* unused low-order bits */
+} raw_format;
+
+/* Convert interleaved raw samples into an array for each channel. */
+static void
+raw_to_samples(const FLAC__byte *raw, size_t nframes, unsigned int channels,
+               const raw_format *fmt, FLAC__int32 * const *samples)
+{
+    size_t i;
+    unsigned int c, j;
+    FLAC__uint32 u, bias = 0;
+    unsigned int bits = fmt->size * 8;
+
+    if (fmt->is_unsigned)
+        bias = (FLAC__uint32) 1 << (bits - 1);
+
+    for (i = 0; i < nframes; i++) {
+        for (c = 0; c < channels; c++) {
+            u = 0;
+            if (fmt->big_endian)
+                for (j = 0; j < fmt->size; j++)
+                    u = (u << 8) | raw[j];
+            else
+                for (j = fmt->size; j > 0; j--)
+                    u = (u << 8) | raw[j - 1];
+            raw += fmt->size;
+            u -= bias;
+            /* Sign-extend and discard unused bits */
+            if (bits < 32 && (u & ((FLAC__uint32) 1 << (bits - 1))))
+                u |= ~(FLAC__uint32) 0 << bits;
+            samples[c][i] = (FLAC__int32) u >> fmt->shift;
+        }
+    }
+}
+
+/* Convert an array for each channel into interleaved raw samples. */
+static void
+samples_to_raw(const FLAC__int32 * const *samples, size_t start,
+               size_t nframes, unsigned int channels,
+               const raw_format *fmt, FLAC__byte *raw)
+{
+    size_t i;
+    unsigned int c, j;
+    FLAC__uint32 u, bias = 0;
+
+    if (fmt->is_unsigned)
+        bias = (FLAC__uint32) 1 << (fmt->size * 8 - 1);
+
+    for (i = start; i < start + nframes; i++) {
+        for (c = 0; c < channels; c++) {
+            u = ((FLAC__uint32) samples[c][i] << fmt->shift) + bias;
+            for (j = 0; j < fmt->size; j++) {
+                raw[fmt->big_endian ? fmt->size - 1 - j : j] = u & 0xff;
+                u >>= 8;
+            }
+            raw += fmt->size;
+        }
+    }
+}
+
+/* Write an entire buffer to a file descriptor.  Returns 0 on success,
+   or -1 (and sets errno) on failure. */
+static int
+write_all(int fd, const FLAC__byte *buffer, size_t bytes)
+{
+    Py_ssize_t n;
+
+    while (bytes > 0) {
+        n = write(fd, buffer, bytes);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buffer += n;
+        bytes -= n;
+    }
+    return 0;
+}
+
 /****************************************************************/
 
 typedef struct {
@@ -296,6 +1151,51 @@ recursion_check(const char **busy_method, const char *this_method)
         }                                                               \
         return 0;                                                       \
     }
+
+/* Define a getter and setter for an option that is stored in the
+   object itself, and used when the stream is opened. */
+#define OPTION_FUNCS(Obj, obj, OBJ, prop, type, to_pyobj, from_pyobj)   \
+    static PyObject *                                                   \
+    Obj##_##prop##_getter(Obj##Object *self, void *closure)             \
+    {                                                                   \
+        type value;                                                     \
+        Py_BEGIN_CRITICAL_SECTION(self);                                \
+        value = self->prop;                                             \
+        Py_END_CRITICAL_SECTION();                                      \
+        return to_pyobj(value);                                         \
+    }                                                                   \
+    static int                                                          \
+    Obj##_##prop##_setter(Obj##Object *self, PyObject *value,           \
+                          void *closure)                                \
+    {                                                                   \
+        type n;                                                         \
+        FLAC__bool ok = 0;                                              \
+        if (!value) {                                                   \
+            PyErr_Format(PyExc_AttributeError,                          \
+                         "cannot delete attribute '%s'", #prop);        \
+            return -1;                                                  \
+        }                                                               \
+        if (!PyLong_Check(value)) {                                     \
+            PyErr_Format(PyExc_TypeError,                               \
+                         "invalid type for attribute '%s'", #prop);     \
+            return -1;                                                  \
+        }                                                               \
+        n = from_pyobj(value);                                          \
+        if (PyErr_Occurred())                                           \
+            return -1;                                                  \
+        BEGIN_PROPERTY_SET(self, #prop);                                \
+        ok = (FLAC__stream_##obj##_get_state(self->obj) ==              \
+              FLAC__STREAM_##OBJ##_UNINITIALIZED);                      \
+        if (ok)                                                         \
+            self->prop = n;                                             \
+        END_PROPERTY_SET(self);                                         \
+        if (!ok) {                                                      \
+            PyErr_Format(PyExc_ValueError,                              \
+                         "cannot set '%s' after open()", #prop);        \
+            return -1;                                                  \
+        }                                                               \
+        return 0;                                                       \
+    }
 #define PROPERTY_BOOL(Obj, obj, prop)                                   \
     PROPERTY_FUNCS(Obj, obj, prop, FLAC__bool,                          \
                    PyBool_FromLong, Long_AsBool)
@@ -306,9 +1206,182 @@ recursion_check(const char **busy_method, const char *this_method)
     PROPERTY_FUNCS(Obj, obj, prop, FLAC__uint64,                        \
                    PyLong_FromUnsignedLongLong, Long_AsUint64)
 
+/****************************************************************/
+/* Shared frame cache */
+
+typedef struct {
+    unsigned int  channels;
+    unsigned int  bits_per_sample;
+    unsigned long sample_rate;
+} sample_attr;
+
+#define SHARED_CACHE_BUCKETS 16384
+
+/* A file is identified by its device, inode, modification time, and
+   size, and the position of the start of the stream */
+#define FILE_ID_SIZE 5
+
+/* A decoded frame that can be used by any Decoder reading the same
+   file */
+typedef struct shared_frame {
+    struct shared_frame *next;          /* next frame in hash bucket */
+    struct shared_frame *lru_prev;
+    struct shared_frame *lru_next;
+    FLAC__uint64         file_id[FILE_ID_SIZE];
+    FLAC__uint64         first_sample;
+    Py_ssize_t           blocksize;
+    sample_attr          attr;
+    size_t               size;          /* total size in bytes */
+    FLAC__int32         *samples;       /* channels * blocksize */
+} shared_frame;
+
+/* A lock that is initialized statically, and therefore exists before
+   the module is imported by any interpreter. */
+#ifdef _WIN32
+typedef SRWLOCK static_lock;
+# define STATIC_LOCK_INIT SRWLOCK_INIT
+# define static_lock_acquire(l) AcquireSRWLockExclusive(l)
+# define static_lock_release(l) ReleaseSRWLockExclusive(l)
+#else
+typedef pthread_mutex_t static_lock;
+# define STATIC_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+# define static_lock_acquire(l) pthread_mutex_lock(l)
+# define static_lock_release(l) pthread_mutex_unlock(l)
+#endif
+
+/* The cache is shared by all threads (and interpreters), and is used
+   while the GIL is released, so it is protected by its own lock.  The
+   GIL must never be acquired while holding this lock. */
+static struct {
+    static_lock          lock;
+    shared_frame       **buckets;
+    shared_frame         lru;           /* lru.lru_next is the oldest */
+    size_t               size;
+    size_t               max_size;
+    size_t               count;
+    unsigned long long   hits;
+    unsigned long long   misses;
+} shared_cache = {
+    STATIC_LOCK_INIT,
+    NULL,
+    { NULL, &shared_cache.lru, &shared_cache.lru }
+};
+
+static shared_frame **
+shared_cache_find(const FLAC__uint64 *file_id, FLAC__uint64 first_sample)
+{
+    FLAC__uint64 h = first_sample;
+    shared_frame **p;
+    unsigned int i;
+
+    for (i = 0; i < FILE_ID_SIZE; i++)
+        h = (h ^ file_id[i]) * 0x100000001b3ULL;
+    p = &shared_cache.buckets[(h ^ (h >> 32)) % SHARED_CACHE_BUCKETS];
+    while (*p && ((*p)->first_sample != first_sample ||
+                  memcmp((*p)->file_id, file_id, sizeof((*p)->file_id))))
+        p = &(*p)->next;
+    return p;
+}
+
+static void
+shared_cache_unlink(shared_frame *frame)
+{
+    frame->lru_prev->lru_next = frame->lru_next;
+    frame->lru_next->lru_prev = frame->lru_prev;
+}
+
+static void
+shared_cache_link(shared_frame *frame)
+{
+    frame->lru_prev = shared_cache.lru.lru_prev;
+    frame->lru_next = &shared_cache.lru;
+    frame->lru_prev->lru_next = frame;
+    shared_cache.lru.lru_prev = frame;
+}
+
+/* Discard the least recently used frames until the total size is
+   within the limit. */
+static void
+shared_cache_trim(void)
+{
+    shared_frame *frame, **p;
+
+    while (shared_cache.size > shared_cache.max_size &&
+           shared_cache.lru.lru_next != &shared_cache.lru) {
+        frame = shared_cache.lru.lru_next;
+        p = shared_cache_find(frame->file_id, frame->first_sample);
+        *p = frame->next;
+        shared_cache_unlink(frame);
+        shared_cache.size -= frame->size;
+        shared_cache.count--;
+        free(frame);
+    }
+}
+
+/* Add a decoded frame to the cache, if it is not there already. */
+static void
+shared_cache_insert(const FLAC__uint64 *file_id, const FLAC__Frame *frame,
+                    const FLAC__int32 * const buffer[])
+{
+    Py_ssize_t blocksize = frame->header.blocksize;
+    unsigned int channels = frame->header.channels, i;
+    size_t size = (sizeof(shared_frame)
+                   + (size_t) blocksize * channels * sizeof(FLAC__int32));
+    shared_frame *new_frame, **p;
+    int found;
+
+    static_lock_acquire(&shared_cache.lock);
+    found = (size > shared_cache.max_size ||
+             *shared_cache_find(file_id, frame->header.number.sample_number));
+    static_lock_release(&shared_cache.lock);
+    if (found)
+        return;
+
+    /* Copy the samples without holding the lock */
+    new_frame = malloc(size);
+    if (!new_frame)
+        return;
+    memcpy(new_frame->file_id, file_id, sizeof(new_frame->file_id));
+    new_frame->first_sample = frame->header.number.sample_number;
+    new_frame->blocksize = blocksize;
+    new_frame->attr.channels = channels;
+    new_frame->attr.bits_per_sample = frame->header.bits_per_sample;
+    new_frame->attr.sample_rate = frame->header.sample_rate;
+    new_frame->size = size;
+    new_frame->samples = (FLAC__int32 *) (new_frame + 1);
+    for (i = 0; i < channels; i++)
+        memcpy(new_frame->samples + i * blocksize, buffer[i],
+               blocksize * sizeof(FLAC__int32));
+
+    static_lock_acquire(&shared_cache.lock);
+    p = shared_cache_find(file_id, new_frame->first_sample);
+    if (*p || size > shared_cache.max_size) {
+        static_lock_release(&shared_cache.lock);
+        free(new_frame);
+        return;
+    }
+    new_frame->next = NULL;
+    *p = new_frame;
+    shared_cache_link(new_frame);
+    shared_cache.size += size;
+    shared_cache.count++;
+    shared_cache_trim();
+    static_lock_release(&shared_cache.lock);
+}
+
 /****************************************************************/
 /* Decoder objects */
 
+/* A previously decoded frame */
+typedef struct {
+    FLAC__uint64  first_sample;
+    Py_ssize_t    blocksize;    /* zero if unused */
+    sample_attr   attr;
+    unsigned long last_used;
+    size_t        size;         /* allocated size of samples */
+    FLAC__int32  *samples;      /* channels * blocksize */
+} cached_frame;
+
 typedef struct {
     PyObject_HEAD
 
@@ -322,6 +1395,24 @@ typedef struct {
     int                  fd;
     char                 seekable;
     char                 eof;
+    char                 use_pread;
+    pread_handle_t       pread_handle;
+    FLAC__uint64         fd_offset;
+
+    double               follow_timeout;
+    char                 follow_valid;
+    char                 follow_rewind;
+    char                 follow_output;
+    FLAC__uint64         follow_offset;
+
+    char                 resumable;
+    char                 would_block;
+    char                 hold_synced;
+    FLAC__byte          *hold_buf;      /* input since last frame */
+    size_t               hold_size;     /* allocated size of hold_buf */
+    size_t               hold_len;      /* number of bytes in hold_buf */
+    size_t               hold_pos;      /* next byte to pass to libFLAC */
+    FLAC__uint64         hold_base;     /* stream offset of hold_buf[0] */
 
     PyObject            *out_byteobjs[FLAC__MAX_CHANNELS];
     FLAC__int32         *out_samples[FLAC__MAX_CHANNELS];
@@ -329,17 +1420,131 @@ typedef struct {
     Py_ssize_t           out_remaining;
 
     FLAC__int32         *buf_samples[FLAC__MAX_CHANNELS];
+    FLAC__uint64         buf_first_sample; /* sample number of buf[0] */
     Py_ssize_t           buf_start;
     Py_ssize_t           buf_count;
     Py_ssize_t           buf_size;
 
+    sample_attr          out_attr, buf_attr;
+
+    char                 has_file_id;
+    char                 seeking;
+    char                 frame_damaged; /* error reported for this frame */
+    FLAC__uint64         file_id[FILE_ID_SIZE];
+    unsigned int         max_blocksize;
+    unsigned int         fixed_blocksize;
+
+    cached_frame        *cache;
+    unsigned int         cache_size;
+    unsigned int         cache_allocated;
+    unsigned long        cache_clock;
+    char                 seek_pending;
+    FLAC__uint64         seek_target;
+
+    struct EncoderObject *sink;
+    FLAC__uint64         sink_samples;
+    PyObject            *applications;
+
+    int                  raw_fd;
+    raw_format           raw_fmt;
+    unsigned int         raw_channels;
+    FLAC__byte          *raw_buf;
+    FLAC__uint64         raw_samples;
+    PyObject            *raw_out;
+    size_t               raw_out_len;
+
+    FLAC__byte           md5sum[16];
+    char                 track_position;
+    unsigned long long   frame_end_offset;
+    unsigned long long   frame_end_sample;
+
+    Py_ssize_t           skip_remaining;
+
+    char                 collect_stats;
+    unsigned int         histogram_bits;
     struct {
-        unsigned int channels;
-        unsigned int bits_per_sample;
-        unsigned long sample_rate;
-    } out_attr, buf_attr;
+        FLAC__uint64     count;
+        unsigned int     channels;
+        unsigned int     histogram_bits;
+        FLAC__int32      min[FLAC__MAX_CHANNELS];
+        FLAC__int32      max[FLAC__MAX_CHANNELS];
+        /* 128-bit sums, as (low, high) pairs */
+        FLAC__uint64     sum[FLAC__MAX_CHANNELS][2];
+        FLAC__uint64     sum_squares[FLAC__MAX_CHANNELS][2];
+        FLAC__uint64    *histogram[FLAC__MAX_CHANNELS];
+    } stats;
 } DecoderObject;
 
+static FLAC__bool
+encoder_process_frame(struct EncoderObject *self,
+                      const FLAC__Frame *frame,
+                      const FLAC__int32 * const buffer[]);
+
+/* In resumable mode, supply input that was read earlier but not
+   decoded as part of a complete frame.  Return 1 if any bytes were
+   supplied. */
+static int
+decoder_replay(DecoderObject *self, FLAC__byte buffer[], size_t *bytes)
+{
+    size_t n;
+
+    if (!self->resumable || self->hold_pos >= self->hold_len)
+        return 0;
+    n = self->hold_len - self->hold_pos;
+    if (n > *bytes)
+        n = *bytes;
+    memcpy(buffer, self->hold_buf + self->hold_pos, n);
+    self->hold_pos += n;
+    *bytes = n;
+    return 1;
+}
+
+/* In resumable mode, save input that has been passed to libFLAC, so
+   that it can be supplied again if decoding is interrupted.  Return
+   -1 if out of memory. */
+static int
+decoder_hold(DecoderObject *self, const FLAC__byte *data, size_t n)
+{
+    FLAC__byte *p;
+    size_t size;
+
+    if (!self->resumable)
+        return 0;
+    if (self->hold_len + n > self->hold_size) {
+        size = self->hold_size * 2;
+        if (size < self->hold_len + n)
+            size = self->hold_len + n;
+        p = PyMem_RawRealloc(self->hold_buf, size);
+        if (!p)
+            return -1;
+        self->hold_buf = p;
+        self->hold_size = size;
+    }
+    memcpy(self->hold_buf + self->hold_len, data, n);
+    self->hold_len += n;
+    self->hold_pos = self->hold_len;
+    return 0;
+}
+
+/* Discard saved input before the given stream offset (the end of a
+   complete frame or of the metadata.) */
+static void
+decoder_release_hold(DecoderObject *self, FLAC__uint64 offset)
+{
+    size_t n;
+
+    if (offset <= self->hold_base)
+        return;
+    n = (size_t) (offset - self->hold_base);
+    if (n > self->hold_pos)
+        n = self->hold_pos;
+    memmove(self->hold_buf, self->hold_buf + n, self->hold_len - n);
+    self->hold_len -= n;
+    self->hold_pos -= n;
+    self->hold_base += n;
+    self->hold_synced = 1;
+}
+
 static FLAC__StreamDecoderReadStatus
 decoder_read(const FLAC__StreamDecoder *decoder,
              FLAC__byte                 buffer[],
@@ -351,6 +1556,9 @@ decoder_read(const FLAC__StreamDecoder *decoder,
     PyObject *memview = NULL, *count = NULL;
     FLAC__StreamDecoderReadStatus status;
 
+    if (decoder_replay(self, buffer, bytes))
+        return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+
     BEGIN_CALLBACK(self);
 
     PyErr_CheckSignals();
@@ -371,12 +1579,16 @@ decoder_read(const FLAC__StreamDecoder *decoder,
         status = FLAC__STREAM_DECODER_READ_STATUS_ABORT;
     } else if (count == Py_None) {
         /* None means stream is non-blocking and no data available */
+        self->would_block = 1;
         status = FLAC__STREAM_DECODER_READ_STATUS_ABORT;
     } else if (n == 0) {
         /* Zero means end of file */
         *bytes = 0;
         self->eof = 1;
         status = FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    } else if (decoder_hold(self, buffer, n) < 0) {
+        PyErr_NoMemory();
+        status = FLAC__STREAM_DECODER_READ_STATUS_ABORT;
     } else {
         *bytes = n;
         status = FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
@@ -395,8 +1607,12 @@ decoder_read_fd(const FLAC__StreamDecoder *decoder,
 {
     DecoderObject *self = client_data;
     Py_ssize_t n;
+    double waited = 0;
     int e;
 
+    if (decoder_replay(self, buffer, bytes))
+        return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+
     do {
         BEGIN_CALLBACK(self);
         PyErr_CheckSignals();
@@ -414,8 +1630,32 @@ decoder_read_fd(const FLAC__StreamDecoder *decoder,
            fundamental bug that also affects 'os.read' and all other
            blocking system calls in CPython. */
 
-        n = read(self->fd, buffer, *bytes);
-    } while (n < 0 && errno == EINTR);
+        if (self->use_pread)
+            n = fd_pread(self->pread_handle, buffer, *bytes,
+                         (off_t) self->fd_offset);
+        else
+            n = read(self->fd, buffer, *bytes);
+
+        /* In follow mode, the end of the file is only the end of the
+           data written so far.  If some samples have been decoded by
+           the current call, or we've waited long enough, stop and
+           return them; the partial frame (or metadata) will be read
+           again by the next call.  Otherwise, wait for more data. */
+        if (n == 0 && self->follow_timeout >= 0 && !self->seeking) {
+            if (self->follow_output || waited >= self->follow_timeout) {
+                self->follow_rewind = 1;
+                *bytes = 0;
+                return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+            }
+            sleep_ms(FOLLOW_POLL_INTERVAL);
+            waited += FOLLOW_POLL_INTERVAL / 1000.0;
+            n = -1;
+            errno = EINTR;
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n > 0 && self->use_pread)
+        self->fd_offset += n;
 
     if (n == 0) {
         *bytes = 0;
@@ -425,6 +1665,7 @@ decoder_read_fd(const FLAC__StreamDecoder *decoder,
         e = errno;
         if (e == EAGAIN || e == EWOULDBLOCK) {
             *bytes = 0;
+            self->would_block = 1;
             return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
         } else {
             BEGIN_CALLBACK(self);
@@ -434,6 +1675,11 @@ decoder_read_fd(const FLAC__StreamDecoder *decoder,
             END_CALLBACK(self);
             return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
         }
+    } else if (decoder_hold(self, buffer, n) < 0) {
+        BEGIN_CALLBACK(self);
+        PyErr_NoMemory();
+        END_CALLBACK(self);
+        return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
     } else {
         *bytes = n;
         return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
@@ -484,9 +1730,15 @@ decoder_seek_fd(const FLAC__StreamDecoder *decoder,
 
     if (absolute_byte_offset > (FLAC__uint64) OFF_MAX) {
         errno = EOVERFLOW;
+    } else if (self->use_pread) {
+        self->fd_offset = absolute_byte_offset;
+        self->eof = 0;
+        return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
     } else {
-        if (lseek(self->fd, absolute_byte_offset, SEEK_SET) >= 0)
+        if (lseek(self->fd, absolute_byte_offset, SEEK_SET) >= 0) {
+            self->eof = 0;
             return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+        }
     }
     e = errno;
     BEGIN_CALLBACK(self);
@@ -507,6 +1759,13 @@ decoder_tell(const FLAC__StreamDecoder *decoder,
     FLAC__uint64 pos;
     FLAC__StreamDecoderTellStatus status;
 
+    /* In resumable mode, the position is needed to find the end of
+       each frame, even if the input is not seekable. */
+    if (self->resumable) {
+        *absolute_byte_offset = self->hold_base + self->hold_pos;
+        return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+    }
+
     if (!self->seekable)
         return FLAC__STREAM_DECODER_TELL_STATUS_UNSUPPORTED;
 
@@ -538,9 +1797,19 @@ decoder_tell_fd(const FLAC__StreamDecoder *decoder,
     off_t pos;
     int e;
 
+    if (self->resumable) {
+        *absolute_byte_offset = self->hold_base + self->hold_pos;
+        return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+    }
+
     if (!self->seekable)
         return FLAC__STREAM_DECODER_TELL_STATUS_UNSUPPORTED;
 
+    if (self->use_pread) {
+        *absolute_byte_offset = self->fd_offset;
+        return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+    }
+
     pos = lseek(self->fd, (off_t) 0, SEEK_CUR);
     if (pos >= 0) {
         *absolute_byte_offset = (FLAC__uint64) pos;
@@ -599,6 +1868,90 @@ decoder_length(const FLAC__StreamDecoder *decoder,
     return status;
 }
 
+static FLAC__StreamDecoderLengthStatus
+decoder_length_fd(const FLAC__StreamDecoder *decoder,
+                  FLAC__uint64              *stream_length,
+                  void                      *client_data)
+{
+    DecoderObject *self = client_data;
+    struct stat st;
+    int e;
+
+    if (!self->seekable)
+        return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED;
+
+    if (fstat(self->fd, &st) == 0) {
+        *stream_length = (FLAC__uint64) st.st_size;
+        return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+    }
+    e = errno;
+    BEGIN_CALLBACK(self);
+    if (!PyErr_Occurred()) {
+        errno = e;
+        PyErr_SetFromErrno(PyExc_OSError);
+    }
+    END_CALLBACK(self);
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_ERROR;
+}
+
+/* After decoding was aborted in follow mode, discard the partial
+   frame and return to the end of the last complete frame.  If the
+   metadata was incomplete, return to the start of the stream (which
+   Decoder_open saved in follow_offset.)  Must be called while
+   processing. */
+static int
+decoder_follow_rewind(DecoderObject *self)
+{
+    int e;
+
+    self->follow_rewind = 0;
+    if (self->follow_valid)
+        FLAC__stream_decoder_flush(self->decoder);
+    else
+        FLAC__stream_decoder_reset(self->decoder);
+    self->eof = 0;
+    if (self->use_pread) {
+        self->fd_offset = self->follow_offset;
+        return 0;
+    }
+    if (lseek(self->fd, (off_t) self->follow_offset, SEEK_SET) >= 0)
+        return 0;
+    e = errno;
+    BEGIN_CALLBACK(self);
+    errno = e;
+    if (!PyErr_Occurred())
+        PyErr_SetFromErrno(PyExc_OSError);
+    END_CALLBACK(self);
+    return -1;
+}
+
+/* Reset libFLAC's state after decoding was aborted.  If the input
+   was temporarily unavailable (in resumable mode), arrange for the
+   saved input to be decoded again, and return 1.  Must be called
+   while processing. */
+static int
+decoder_recover(DecoderObject *self)
+{
+    if (self->follow_rewind) {
+        decoder_follow_rewind(self);
+        return 0;
+    }
+    if (self->would_block && self->resumable) {
+        self->would_block = 0;
+        /* Until a frame is decoded, the saved input begins at the
+           start of the stream, so begin again from the metadata. */
+        if (self->hold_synced)
+            FLAC__stream_decoder_flush(self->decoder);
+        else
+            FLAC__stream_decoder_reset(self->decoder);
+        self->hold_pos = 0;
+        self->eof = 0;
+        return 1;
+    }
+    FLAC__stream_decoder_flush(self->decoder);
+    return 0;
+}
+
 static FLAC__bool
 decoder_eof(const FLAC__StreamDecoder *decoder,
             void                      *client_data)
@@ -607,6 +1960,133 @@ decoder_eof(const FLAC__StreamDecoder *decoder,
     return self->eof;
 }
 
+static void
+decoder_clear_stats(DecoderObject *self)
+{
+    unsigned int i;
+
+    for (i = 0; i < FLAC__MAX_CHANNELS; i++) {
+        PyMem_Free(self->stats.histogram[i]);
+        self->stats.histogram[i] = NULL;
+    }
+    memset(&self->stats, 0, sizeof(self->stats));
+}
+
+static void
+add_uint128(FLAC__uint64 acc[2], FLAC__uint64 value, FLAC__uint64 high)
+{
+    acc[0] += value;
+    acc[1] += high + (acc[0] < value);
+}
+
+/* Accumulate statistics for samples that are returned to the
+   caller.  Must be called while processing. */
+static int
+decoder_update_stats(DecoderObject *self,
+                     const FLAC__int32 * const buffer[],
+                     unsigned int channels,
+                     unsigned int bits_per_sample,
+                     Py_ssize_t offset,
+                     Py_ssize_t count)
+{
+    unsigned int c, k, shift;
+    const FLAC__int32 *x;
+    FLAC__int32 lo, hi;
+    FLAC__int64 sum;
+    FLAC__uint64 sum_squares, sq, *histogram;
+    Py_ssize_t i, j, n;
+    int ok = 1;
+
+    if (!self->collect_stats || count <= 0)
+        return 0;
+
+    if (self->stats.count == 0) {
+        self->stats.histogram_bits = self->histogram_bits;
+        if (self->stats.histogram_bits > MAX_HISTOGRAM_BITS)
+            self->stats.histogram_bits = MAX_HISTOGRAM_BITS;
+        if (self->stats.histogram_bits > bits_per_sample)
+            self->stats.histogram_bits = bits_per_sample;
+    }
+    k = self->stats.histogram_bits;
+
+    if (k > 0 && !self->stats.histogram[channels - 1]) {
+        BEGIN_CALLBACK(self);
+        for (c = 0; c < channels && ok; c++) {
+            if (!self->stats.histogram[c]) {
+                self->stats.histogram[c] = PyMem_New(FLAC__uint64,
+                                                     (size_t) 1 << k);
+                if (self->stats.histogram[c])
+                    memset(self->stats.histogram[c], 0,
+                           sizeof(FLAC__uint64) << k);
+            }
+            if (!self->stats.histogram[c]) {
+                PyErr_NoMemory();
+                ok = 0;
+            }
+        }
+        END_CALLBACK(self);
+        if (!ok)
+            return -1;
+    }
+
+    for (c = 0; c < channels; c++) {
+        x = buffer[c] + offset;
+        if (c >= self->stats.channels)
+            self->stats.min[c] = self->stats.max[c] = x[0];
+        lo = self->stats.min[c];
+        hi = self->stats.max[c];
+
+        /* Sums of up to 65536 samples of up to 24 bits can be
+           computed exactly with 64-bit integers. */
+        for (i = 0; i < count; i += n) {
+            n = count - i;
+            if (n > 65536)
+                n = 65536;
+            sum = 0;
+            sum_squares = 0;
+            if (bits_per_sample <= 24) {
+                for (j = i; j < i + n; j++) {
+                    lo = (x[j] < lo ? x[j] : lo);
+                    hi = (x[j] > hi ? x[j] : hi);
+                    sum += x[j];
+                    sum_squares += (FLAC__uint64) ((FLAC__int64) x[j] * x[j]);
+                }
+            } else {
+                for (j = i; j < i + n; j++) {
+                    lo = (x[j] < lo ? x[j] : lo);
+                    hi = (x[j] > hi ? x[j] : hi);
+                    sum += x[j];
+                    sq = (FLAC__uint64) ((FLAC__int64) x[j] * x[j]);
+                    add_uint128(self->stats.sum_squares[c], sq, 0);
+                }
+            }
+            add_uint128(self->stats.sum[c], (FLAC__uint64) sum,
+                        sum < 0 ? (FLAC__uint64) -1 : 0);
+            add_uint128(self->stats.sum_squares[c], sum_squares, 0);
+        }
+        self->stats.min[c] = lo;
+        self->stats.max[c] = hi;
+
+        histogram = self->stats.histogram[c];
+        if (histogram && bits_per_sample >= k) {
+            shift = bits_per_sample - k;
+            for (j = 0; j < count; j++)
+                histogram[((x[j] >> shift) + (1 << (k - 1)))
+                          & ((1 << k) - 1)]++;
+        } else if (histogram) {
+            shift = k - bits_per_sample;
+            for (j = 0; j < count; j++)
+                histogram[(((FLAC__uint32) x[j] << shift) + (1 << (k - 1)))
+                          & ((1 << k) - 1)]++;
+        }
+    }
+
+    if (channels > self->stats.channels)
+        self->stats.channels = channels;
+    self->stats.count += count;
+    return 0;
+}
+
 static int
 write_out_samples(DecoderObject  *self,
                   FLAC__int32   **buffer,
@@ -650,6 +2130,433 @@ write_out_samples(DecoderObject  *self,
     return 0;
 }
 
+static int
+write_raw_samples(DecoderObject *self, const FLAC__int32 * const *samples,
+                  unsigned int channels, unsigned int bits_per_sample,
+                  Py_ssize_t start, Py_ssize_t count)
+{
+    size_t nframes, bytes, size;
+    int ok;
+
+    if (self->raw_channels == 0)
+        self->raw_channels = channels;
+
+    if (channels != self->raw_channels ||
+        bits_per_sample + self->raw_fmt.shift > self->raw_fmt.size * 8) {
+        BEGIN_CALLBACK(self);
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "format of input "
+                            "does not match output sample format");
+        END_CALLBACK(self);
+        return -1;
+    }
+
+    if (decoder_update_stats(self, samples, channels, bits_per_sample,
+                             start, count) < 0)
+        return -1;
+
+    /* Without an output file, append samples to raw_out. */
+    if (self->raw_fd < 0) {
+        bytes = (size_t) count * channels * self->raw_fmt.size;
+        size = PyByteArray_Size(self->raw_out);
+        if (self->raw_out_len + bytes > size) {
+            size = (self->raw_out_len + bytes > 2 * size
+                    ? self->raw_out_len + bytes : 2 * size);
+            BEGIN_CALLBACK(self);
+            ok = (PyByteArray_Resize(self->raw_out, size) == 0);
+            END_CALLBACK(self);
+            if (!ok)
+                return -1;
+        }
+        samples_to_raw(samples, start, count, channels, &self->raw_fmt,
+                       ((FLAC__byte *) PyByteArray_AsString(self->raw_out)
+                        + self->raw_out_len));
+        self->raw_out_len += bytes;
+        self->raw_samples += count;
+        return 0;
+    }
+
+    while (count > 0) {
+        nframes = (count < RAW_CHUNK_SIZE ? count : RAW_CHUNK_SIZE);
+        samples_to_raw(samples, start, nframes, channels,
+                       &self->raw_fmt, self->raw_buf);
+        if (write_all(self->raw_fd, self->raw_buf,
+                      nframes * channels * self->raw_fmt.size) < 0) {
+            BEGIN_CALLBACK(self);
+            PyErr_SetFromErrno(PyExc_OSError);
+            END_CALLBACK(self);
+            return -1;
+        }
+        start += nframes;
+        count -= nframes;
+        self->raw_samples += nframes;
+    }
+    return 0;
+}
+
+/* Allocate buf_samples to hold `size` samples of each channel. */
+static int
+decoder_alloc_buffer(DecoderObject *self, unsigned int channels,
+                     Py_ssize_t size)
+{
+    unsigned int i;
+
+    for (i = 0; i < FLAC__MAX_CHANNELS; i++) {
+        PyMem_Free(self->buf_samples[i]);
+        self->buf_samples[i] = NULL;
+    }
+    self->buf_size = size;
+    for (i = 0; i < channels; i++) {
+        self->buf_samples[i] = PyMem_New(FLAC__int32, self->buf_size);
+        if (!self->buf_samples[i]) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+decoder_clear_cache(DecoderObject *self)
+{
+    unsigned int i;
+
+    for (i = 0; i < self->cache_allocated; i++)
+        PyMem_Free(self->cache[i].samples);
+    PyMem_Free(self->cache);
+    self->cache = NULL;
+    self->cache_allocated = 0;
+    self->cache_clock = 0;
+}
+
+/* Save a copy of a decoded frame, replacing the least recently used
+   frame in the cache. */
+static int
+decoder_cache_frame(DecoderObject *self, const FLAC__Frame *frame,
+                    const FLAC__int32 * const buffer[])
+{
+    cached_frame *entry = NULL;
+    Py_ssize_t blocksize = frame->header.blocksize;
+    unsigned int channels = frame->header.channels, i;
+    size_t size = (size_t) blocksize * channels;
+    FLAC__int32 *samples;
+
+    if (self->cache_allocated != self->cache_size) {
+        BEGIN_CALLBACK(self);
+        decoder_clear_cache(self);
+        if (self->cache_size > 0)
+            self->cache = PyMem_New(cached_frame, self->cache_size);
+        if (self->cache) {
+            memset(self->cache, 0, self->cache_size * sizeof(cached_frame));
+            self->cache_allocated = self->cache_size;
+        } else if (self->cache_size > 0) {
+            PyErr_NoMemory();
+        }
+        END_CALLBACK(self);
+    }
+    if (self->cache_size == 0)
+        return 0;
+    if (!self->cache)
+        return -1;
+
+    for (i = 0; i < self->cache_allocated; i++) {
+        if (self->cache[i].blocksize > 0 &&
+            self->cache[i].first_sample ==
+            frame->header.number.sample_number) {
+            entry = &self->cache[i];
+            break;
+        }
+        if (!entry || self->cache[i].last_used < entry->last_used)
+            entry = &self->cache[i];
+    }
+
+    if (entry->size < size) {
+        BEGIN_CALLBACK(self);
+        samples = PyMem_Realloc(entry->samples, size * sizeof(FLAC__int32));
+        if (samples) {
+            entry->samples = samples;
+            entry->size = size;
+        } else {
+            PyErr_NoMemory();
+        }
+        END_CALLBACK(self);
+        if (entry->size < size)
+            return -1;
+    }
+
+    for (i = 0; i < channels; i++)
+        memcpy(entry->samples + i * blocksize, buffer[i],
+               blocksize * sizeof(FLAC__int32));
+    entry->first_sample = frame->header.number.sample_number;
+    entry->blocksize = blocksize;
+    entry->attr.channels = channels;
+    entry->attr.bits_per_sample = frame->header.bits_per_sample;
+    entry->attr.sample_rate = frame->header.sample_rate;
+    entry->last_used = ++self->cache_clock;
+    return 0;
+}
+
+/* Copy the remainder of a frame from the shared cache, starting at
+   the given sample number, into buf_samples.  Return 1 if the frame
+   is found, 0 if it is not, or -1 on error. */
+static int
+decoder_load_shared(DecoderObject *self, FLAC__uint64 sample_number)
+{
+    shared_frame *frame;
+    FLAC__uint64 end = 0;
+    Py_ssize_t offset = 0, count = 0;
+    unsigned int channels = self->out_attr.channels, i;
+    int err = 0;
+
+    /* Frames that are not decoded by libFLAC would not be included
+       in the MD5 hash. */
+    if (!self->has_file_id || self->max_blocksize == 0 ||
+        FLAC__stream_decoder_get_md5_checking(self->decoder))
+        return 0;
+
+    if (self->buf_size < (Py_ssize_t) self->max_blocksize ||
+        !self->buf_samples[channels - 1]) {
+        BEGIN_CALLBACK(self);
+        err = decoder_alloc_buffer(self, channels, self->max_blocksize);
+        END_CALLBACK(self);
+        if (err < 0)
+            return -1;
+    }
+
+    static_lock_acquire(&shared_cache.lock);
+    if (shared_cache.max_size == 0) {
+        static_lock_release(&shared_cache.lock);
+        return 0;
+    }
+    frame = *shared_cache_find(self->file_id, sample_number);
+    if (!frame && self->fixed_blocksize)
+        frame = *shared_cache_find(self->file_id,
+                                   sample_number - (sample_number %
+                                                    self->fixed_blocksize));
+    if (frame) {
+        offset = sample_number - frame->first_sample;
+        count = frame->blocksize - offset;
+        end = frame->first_sample + frame->blocksize;
+        if (count <= 0 || frame->blocksize > self->buf_size ||
+            frame->attr.channels != channels ||
+            (end != self->frame_end_sample &&
+             FLAC__stream_decoder_get_total_samples(self->decoder) == 0))
+            frame = NULL;
+    }
+    if (frame) {
+        for (i = 0; i < channels; i++)
+            memcpy(self->buf_samples[i],
+                   frame->samples + i * frame->blocksize + offset,
+                   count * sizeof(FLAC__int32));
+        self->buf_attr = frame->attr;
+        shared_cache_unlink(frame);
+        shared_cache_link(frame);
+        shared_cache.hits++;
+    } else {
+        shared_cache.misses++;
+    }
+    static_lock_release(&shared_cache.lock);
+
+    if (!frame)
+        return 0;
+    self->buf_first_sample = sample_number;
+    self->buf_start = 0;
+    self->buf_count = count;
+    self->seek_pending = (end != self->frame_end_sample);
+    self->seek_target = end;
+    return 1;
+}
+
+/* Copy the remainder of a cached frame, starting at the given sample
+   number, into buf_samples.  Return 1 if the frame is found, 0 if it
+   is not, or -1 on error.
+
+   libFLAC itself is not involved, so if this is not the frame that
+   was most recently decoded, set seek_pending to indicate that
+   libFLAC must seek to the end of this frame before decoding
+   anything else. */
+static int
+decoder_load_cached(DecoderObject *self, FLAC__uint64 sample_number)
+{
+    cached_frame *entry = NULL;
+    FLAC__uint64 end;
+    Py_ssize_t offset, count;
+    unsigned int i;
+    int err = 0;
+
+    /* Frames that are not decoded by libFLAC would not be included
+       in the frame positions. */
+    if (self->track_position || self->follow_timeout >= 0 ||
+        self->resumable)
+        return 0;
+
+    /* If the cache size has changed since the last frame was
+       decoded, only the shared cache is used. */
+    for (i = 0; (i < self->cache_allocated &&
+                 self->cache_allocated == self->cache_size); i++) {
+        if (self->cache[i].blocksize > 0 &&
+            self->cache[i].first_sample <= sample_number &&
+            (sample_number - self->cache[i].first_sample
+             < (FLAC__uint64) self->cache[i].blocksize)) {
+            entry = &self->cache[i];
+            break;
+        }
+    }
+    if (!entry)
+        return decoder_load_shared(self, sample_number);
+
+    /* Seeking to the end of the stream fails, so a pending seek
+       requires knowing the length of the stream. */
+    end = entry->first_sample + entry->blocksize;
+    if (end != self->frame_end_sample &&
+        FLAC__stream_decoder_get_total_samples(self->decoder) == 0)
+        return 0;
+
+    offset = sample_number - entry->first_sample;
+    count = entry->blocksize - offset;
+    if (count > self->buf_size ||
+        !self->buf_samples[entry->attr.channels - 1]) {
+        BEGIN_CALLBACK(self);
+        err = decoder_alloc_buffer(self, entry->attr.channels,
+                                   entry->blocksize);
+        END_CALLBACK(self);
+        if (err < 0)
+            return -1;
+    }
+
+    for (i = 0; i < entry->attr.channels; i++)
+        memcpy(self->buf_samples[i],
+               entry->samples + i * entry->blocksize + offset,
+               count * sizeof(FLAC__int32));
+    self->buf_attr = entry->attr;
+    self->buf_first_sample = sample_number;
+    self->buf_start = 0;
+    self->buf_count = count;
+    entry->last_used = ++self->cache_clock;
+
+    self->seek_pending = (end != self->frame_end_sample);
+    self->seek_target = end;
+    return 1;
+}
+
+/* If the given sample number is in the frame that was last copied
+   into buf_samples (including samples that have already been
+   returned), move buf_start to that sample and return 1; otherwise
+   return 0. */
+static int
+decoder_seek_buffer(DecoderObject *self, FLAC__uint64 sample_number)
+{
+    FLAC__uint64 end;
+
+    if (self->buf_count == 0 || !self->seekable ||
+        sample_number < self->buf_first_sample)
+        return 0;
+    end = self->buf_first_sample + self->buf_start + self->buf_count;
+    if (sample_number >= end)
+        return 0;
+    self->buf_start = (Py_ssize_t) (sample_number - self->buf_first_sample);
+    self->buf_count = (Py_ssize_t) (end - sample_number);
+    return 1;
+}
+
+/* Decode the metadata, if it has not been decoded already.  Must be
+   called while processing. */
+static FLAC__bool
+decoder_process_metadata(DecoderObject *self)
+{
+    FLAC__uint64 position = 0;
+    FLAC__bool ok;
+
+    self->would_block = 0;
+    ok = FLAC__stream_decoder_process_until_end_of_metadata(self->decoder);
+    if (ok && self->resumable && !self->hold_synced &&
+        FLAC__stream_decoder_get_decode_position(self->decoder, &position))
+        decoder_release_hold(self, position);
+    /* Before decoding any frames, record the end of the metadata
+       as the end of the "previous" frame. */
+    if (ok && self->seekable && self->frame_end_sample == 0 &&
+        FLAC__stream_decoder_get_decode_position(self->decoder, &position)) {
+        self->frame_end_offset = position;
+        if (self->fd >= 0 && !self->follow_valid) {
+            self->follow_offset = position;
+            self->follow_valid = 1;
+        }
+    }
+    return ok;
+}
+
+/* Decode the next frame, first performing a pending seek if any. */
+static FLAC__bool
+decoder_process_single(DecoderObject *self, FLAC__StreamDecoderState *state)
+{
+    FLAC__bool ok;
+
+    /* In follow mode, the end of the metadata must be known before
+       decoding a frame, so that an incomplete first frame can be
+       discarded. */
+    if (self->follow_timeout >= 0 && !self->follow_valid &&
+        !decoder_process_metadata(self)) {
+        *state = FLAC__stream_decoder_get_state(self->decoder);
+        return 0;
+    }
+
+    if (self->seek_pending) {
+        if (self->seek_target >=
+            FLAC__stream_decoder_get_total_samples(self->decoder)) {
+            *state = FLAC__STREAM_DECODER_END_OF_STREAM;
+            return 1;
+        }
+        self->seek_pending = 0;
+        ok = FLAC__stream_decoder_seek_absolute(self->decoder,
+                                                self->seek_target);
+        *state = FLAC__stream_decoder_get_state(self->decoder);
+        if (*state == FLAC__STREAM_DECODER_SEEK_ERROR) {
+            FLAC__stream_decoder_flush(self->decoder);
+            self->frame_end_sample = 0;
+        }
+        return ok;
+    }
+
+    self->would_block = 0;
+    ok = FLAC__stream_decoder_process_single(self->decoder);
+    *state = FLAC__stream_decoder_get_state(self->decoder);
+    return ok;
+}
+
+/* Move samples from buf_samples to out_samples, as many as will fit
+   (and have the same format as earlier samples.) */
+static int
+decoder_read_buffer(DecoderObject *self)
+{
+    Py_ssize_t count;
+
+    count = self->out_remaining;
+    if (count > self->buf_count)
+        count = self->buf_count;
+    if (count > 0 && self->out_count > 0 &&
+        (self->out_attr.channels != self->buf_attr.channels ||
+         self->out_attr.bits_per_sample != self->buf_attr.bits_per_sample ||
+         self->out_attr.sample_rate != self->buf_attr.sample_rate))
+        count = 0;
+    if (count <= 0)
+        return 0;
+
+    if (decoder_update_stats(self, (const FLAC__int32 * const *)
+                             self->buf_samples,
+                             self->buf_attr.channels,
+                             self->buf_attr.bits_per_sample,
+                             self->buf_start, count) < 0 ||
+        write_out_samples(self, self->buf_samples,
+                          self->buf_attr.channels,
+                          self->buf_start, count) < 0)
+        return -1;
+
+    self->out_attr = self->buf_attr;
+    self->buf_start += count;
+    self->buf_count -= count;
+    return 0;
+}
+
 static FLAC__StreamDecoderWriteStatus
 decoder_write(const FLAC__StreamDecoder *decoder,
               const FLAC__Frame         *frame,
@@ -657,25 +2564,98 @@ decoder_write(const FLAC__StreamDecoder *decoder,
               void                      *client_data)
 {
     DecoderObject *self = client_data;
-    Py_ssize_t blocksize, out_count, buf_count;
+    Py_ssize_t blocksize, skip_count, out_count, buf_count;
     unsigned int channels, i;
+    char damaged;
 
     blocksize = frame->header.blocksize;
+    channels = frame->header.channels;
+
+    /* If an error was reported (for example, a CRC mismatch), libFLAC
+       passes silence in place of the damaged frame, which must not
+       be cached. */
+    damaged = self->frame_damaged;
+    self->frame_damaged = 0;
+
+    self->frame_end_sample = frame->header.number.sample_number + blocksize;
+    if (self->track_position) {
+        FLAC__uint64 position;
+        if (FLAC__stream_decoder_get_decode_position(decoder, &position))
+            self->frame_end_offset = position;
+    }
+    if (self->follow_timeout >= 0) {
+        self->follow_valid = FLAC__stream_decoder_get_decode_position(
+            decoder, &self->follow_offset);
+        self->follow_output = 1;
+    }
+    if (self->resumable) {
+        FLAC__uint64 position;
+        if (FLAC__stream_decoder_get_decode_position(decoder, &position))
+            decoder_release_hold(self, position);
+    }
+
+    /* When transcoding, pass samples directly to the encoder. */
+    if (self->sink) {
+        if (decoder_update_stats(self, buffer, channels,
+                                 frame->header.bits_per_sample,
+                                 0, blocksize) < 0)
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        if (!encoder_process_frame(self->sink, frame, buffer))
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        self->sink_samples += blocksize;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    /* When converting to raw PCM, write samples directly to the
+       output file. */
+    if (self->raw_buf) {
+        if (write_raw_samples(self, buffer, frame->header.channels,
+                              frame->header.bits_per_sample,
+                              0, blocksize) < 0)
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    if (!damaged && decoder_cache_frame(self, frame, buffer) < 0)
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    /* When seeking, libFLAC discards the start of the target frame,
+       which is only known to be the start of a frame if the block
+       size is fixed. */
+    if (self->has_file_id && !damaged &&
+        (!self->seeking ||
+         (self->fixed_blocksize &&
+          frame->header.number.sample_number % self->fixed_blocksize == 0)))
+        shared_cache_insert(self->file_id, frame, buffer);
+
+    /* When skipping, discard samples (apart from computing
+       statistics) without copying them. */
+    skip_count = self->skip_remaining;
+    if (skip_count > blocksize)
+        skip_count = blocksize;
+    if (skip_count > 0) {
+        if (decoder_update_stats(self, buffer, channels,
+                                 frame->header.bits_per_sample,
+                                 0, skip_count) < 0)
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        self->skip_remaining -= skip_count;
+    }
+
     out_count = self->out_remaining;
-    if (out_count > blocksize)
-        out_count = blocksize;
+    if (out_count > blocksize - skip_count)
+        out_count = blocksize - skip_count;
     if (out_count > 0 && self->out_count > 0 &&
         (self->out_attr.channels != frame->header.channels ||
          self->out_attr.bits_per_sample != frame->header.bits_per_sample ||
          self->out_attr.sample_rate != frame->header.sample_rate))
         out_count = 0;
-    buf_count = blocksize - out_count;
-
-    channels = frame->header.channels;
+    buf_count = blocksize - skip_count - out_count;
 
     if (out_count > 0) {
-        if (write_out_samples(self, (FLAC__int32 **) buffer,
-                              channels, 0, out_count) < 0)
+        if (decoder_update_stats(self, buffer, channels,
+                                 frame->header.bits_per_sample,
+                                 skip_count, out_count) < 0 ||
+            write_out_samples(self, (FLAC__int32 **) buffer,
+                              channels, skip_count, out_count) < 0)
             return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
         self->out_attr.channels = frame->header.channels;
         self->out_attr.bits_per_sample = frame->header.bits_per_sample;
@@ -692,34 +2672,26 @@ decoder_write(const FLAC__StreamDecoder *decoder,
             return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
         }
 
-        if (buf_count > self->buf_size || !self->buf_samples[channels - 1]) {
+        if (blocksize > self->buf_size || !self->buf_samples[channels - 1]) {
             BEGIN_CALLBACK(self);
-            for (i = 0; i < FLAC__MAX_CHANNELS; i++) {
-                PyMem_Free(self->buf_samples[i]);
-                self->buf_samples[i] = NULL;
-            }
-            self->buf_size = blocksize;
-            for (i = 0; i < channels; i++) {
-                self->buf_samples[i] = PyMem_New(FLAC__int32, self->buf_size);
-                if (!self->buf_samples[i]) {
-                    PyErr_NoMemory();
-                    break;
-                }
-            }
+            decoder_alloc_buffer(self, channels, blocksize);
             END_CALLBACK(self);
         }
 
+        /* Save the whole frame, so that seeking back to samples that
+           were already returned does not require decoding it again. */
         for (i = 0; i < channels; i++) {
             if (!self->buf_samples[i])
                 return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-            memcpy(self->buf_samples[i], &buffer[i][out_count],
-                   buf_count * sizeof(FLAC__int32));
+            memcpy(self->buf_samples[i], buffer[i],
+                   blocksize * sizeof(FLAC__int32));
         }
 
         self->buf_attr.channels = frame->header.channels;
         self->buf_attr.bits_per_sample = frame->header.bits_per_sample;
         self->buf_attr.sample_rate = frame->header.sample_rate;
-        self->buf_start = 0;
+        self->buf_first_sample = frame->header.number.sample_number;
+        self->buf_start = skip_count + out_count;
         self->buf_count = buf_count;
     }
 
@@ -732,6 +2704,7 @@ decoder_metadata(const FLAC__StreamDecoder  *decoder,
                  void                       *client_data)
 {
     DecoderObject *self = client_data;
+    PyObject *key, *value;
 
     /* I'm not sure it's possible for metadata callback to be invoked
        after decoding begins, but be safe */
@@ -745,6 +2718,30 @@ decoder_metadata(const FLAC__StreamDecoder  *decoder,
         self->out_attr.sample_rate = metadata->data.stream_info.sample_rate;
         self->out_attr.bits_per_sample =
             metadata->data.stream_info.bits_per_sample;
+        memcpy(self->md5sum, metadata->data.stream_info.md5sum,
+               sizeof(self->md5sum));
+        self->max_blocksize = metadata->data.stream_info.max_blocksize;
+        if (metadata->data.stream_info.min_blocksize ==
+            metadata->data.stream_info.max_blocksize)
+            self->fixed_blocksize = self->max_blocksize;
+        else
+            self->fixed_blocksize = 0;
+    }
+
+    if (metadata && metadata->type == FLAC__METADATA_TYPE_APPLICATION &&
+        metadata->length >= 4 && !PyErr_Occurred()) {
+        key = PyBytes_FromStringAndSize(
+            (const char *) metadata->data.application.id, 4);
+        value = PyBytes_FromStringAndSize(
+            (const char *) metadata->data.application.data,
+            metadata->length - 4);
+        if (key && value && !self->applications)
+            self->applications = PyDict_New();
+        if (key && value && self->applications &&
+            !PyDict_Contains(self->applications, key))
+            PyDict_SetItem(self->applications, key, value);
+        Py_XDECREF(key);
+        Py_XDECREF(value);
     }
 
     END_CALLBACK(self);
@@ -759,6 +2756,8 @@ decoder_error(const FLAC__StreamDecoder      *decoder,
     const char *msg = FLAC__StreamDecoderErrorStatusString[status];
     PyObject *result;
 
+    self->frame_damaged = 1;
+
     BEGIN_CALLBACK(self);
 
     if (!PyErr_Occurred()) {
@@ -771,6 +2770,15 @@ decoder_error(const FLAC__StreamDecoder      *decoder,
     END_CALLBACK(self);
 }
 
+static void
+decoder_close_pread(DecoderObject *self)
+{
+    if (self->pread_handle != PREAD_HANDLE_NONE) {
+        fd_pread_close(self->pread_handle);
+        self->pread_handle = PREAD_HANDLE_NONE;
+    }
+}
+
 static void
 decoder_clear_internal(DecoderObject *self)
 {
@@ -785,11 +2793,23 @@ decoder_clear_internal(DecoderObject *self)
 
     self->out_count = 0;
     self->out_remaining = 0;
+    self->buf_first_sample = 0;
     self->buf_start = 0;
     self->buf_count = 0;
     self->buf_size = 0;
     memset(&self->out_attr, 0, sizeof(self->out_attr));
     memset(&self->buf_attr, 0, sizeof(self->buf_attr));
+    decoder_clear_cache(self);
+    self->seek_pending = 0;
+
+    PyMem_RawFree(self->hold_buf);
+    self->hold_buf = NULL;
+    self->hold_size = 0;
+    self->hold_len = 0;
+    self->hold_pos = 0;
+    self->hold_base = 0;
+    self->hold_synced = 0;
+    self->would_block = 0;
 }
 
 static DecoderObject *
@@ -811,11 +2831,53 @@ newDecoderObject(PyObject *module, PyObject *fileobj)
     self->busy_method = NULL;
     self->decoder = FLAC__stream_decoder_new();
     self->eof = 0;
+    self->use_pread = 0;
+    self->pread_handle = PREAD_HANDLE_NONE;
+    self->fd_offset = 0;
+    self->follow_timeout = -1;
+    self->follow_valid = 0;
+    self->follow_rewind = 0;
+    self->follow_output = 0;
+    self->follow_offset = 0;
+    self->resumable = 0;
+    self->would_block = 0;
+    self->hold_synced = 0;
+    self->hold_buf = NULL;
+    self->hold_size = 0;
+    self->hold_len = 0;
+    self->hold_pos = 0;
+    self->hold_base = 0;
     self->module = module;
     Py_XINCREF(self->module);
     self->fileobj = fileobj;
     Py_XINCREF(self->fileobj);
     self->error_callback = NULL;
+    self->sink = NULL;
+    self->sink_samples = 0;
+    self->raw_fd = -1;
+    self->raw_buf = NULL;
+    self->raw_samples = 0;
+    self->raw_out = NULL;
+    self->raw_out_len = 0;
+    memset(self->md5sum, 0, sizeof(self->md5sum));
+    self->track_position = 0;
+    self->frame_end_offset = 0;
+    self->frame_end_sample = 0;
+    self->applications = NULL;
+    self->skip_remaining = 0;
+    self->collect_stats = 0;
+    self->histogram_bits = 0;
+    self->has_file_id = 0;
+    self->seeking = 0;
+    self->frame_damaged = 0;
+    self->max_blocksize = 0;
+    self->fixed_blocksize = 0;
+    self->cache = NULL;
+    self->cache_size = 0;
+    self->cache_allocated = 0;
+    self->cache_clock = 0;
+    self->seek_pending = 0;
+    self->seek_target = 0;
 
     PyObject_GC_Track((PyObject *) self);
 
@@ -823,7 +2885,9 @@ newDecoderObject(PyObject *module, PyObject *fileobj)
         self->out_byteobjs[i] = NULL;
         self->out_samples[i] = NULL;
         self->buf_samples[i] = NULL;
+        self->stats.histogram[i] = NULL;
     }
+    decoder_clear_stats(self);
 
     if (self->decoder == NULL) {
         PyErr_NoMemory();
@@ -842,6 +2906,7 @@ Decoder_traverse(DecoderObject *self, visitproc visit, void *arg)
     Py_VISIT(self->module);
     Py_VISIT(self->fileobj);
     Py_VISIT(self->error_callback);
+    Py_VISIT(self->applications);
     return 0;
 }
 
@@ -851,6 +2916,7 @@ Decoder_clear(DecoderObject *self)
     Py_CLEAR(self->module);
     Py_CLEAR(self->fileobj);
     Py_CLEAR(self->error_callback);
+    Py_CLEAR(self->applications);
     return 0;
 }
 
@@ -860,10 +2926,13 @@ Decoder_dealloc(DecoderObject *self)
     PyObject_GC_UnTrack((PyObject *) self);
 
     decoder_clear_internal(self);
+    decoder_clear_stats(self);
+    decoder_close_pread(self);
 
     Py_CLEAR(self->module);
     Py_CLEAR(self->fileobj);
     Py_CLEAR(self->error_callback);
+    Py_CLEAR(self->applications);
 
     if (self->decoder)
         FLAC__stream_decoder_delete(self->decoder);
@@ -882,18 +2951,62 @@ static PyObject *
 Decoder_open(DecoderObject *self, PyObject *args)
 {
     FLAC__StreamDecoderInitStatus status;
-    PyObject *seekable;
+    PyObject *seekable, *file_id = Py_None, *offset = Py_None;
     PyObject *result = NULL;
+    unsigned long long id[FILE_ID_SIZE];
+    unsigned int i;
+    off_t pos;
 
     BEGIN_METHOD(self, "open");
-    if (!PyArg_ParseTuple(args, "i:open", &self->fd))
+    if (!PyArg_ParseTuple(args, "i|OO:open", &self->fd, &file_id, &offset))
         goto done;
 
-    seekable = PyObject_CallMethod(self->fileobj, "seekable", "()");
-    self->seekable = seekable ? PyObject_IsTrue(seekable) : 0;
-    Py_XDECREF(seekable);
-    if (PyErr_Occurred())
-        goto done;
+    /* If an offset is given, the file descriptor may be shared with
+       other decoders, so read it using pread rather than read. */
+    self->use_pread = 0;
+    decoder_close_pread(self);
+    if (offset != Py_None) {
+        if (self->fd < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                            "offset requires a file descriptor");
+            goto done;
+        }
+        self->fd_offset = Long_AsUint64(offset);
+        if (PyErr_Occurred())
+            goto done;
+        self->pread_handle = fd_pread_open(self->fd);
+        if (self->pread_handle == PREAD_HANDLE_NONE) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            goto done;
+        }
+        self->use_pread = 1;
+    }
+
+    self->has_file_id = 0;
+    if (file_id != Py_None) {
+        if (!PyArg_ParseTuple(file_id, "KKKKK:open", &id[0], &id[1],
+                              &id[2], &id[3], &id[4]))
+            goto done;
+        for (i = 0; i < FILE_ID_SIZE; i++)
+            self->file_id[i] = id[i];
+        self->has_file_id = 1;
+    }
+
+    if (self->use_pread) {
+        self->seekable = 1;
+    } else if (self->resumable) {
+        self->seekable = 0;
+    } else {
+        seekable = PyObject_CallMethod(self->fileobj, "seekable", "()");
+        self->seekable = seekable ? PyObject_IsTrue(seekable) : 0;
+        Py_XDECREF(seekable);
+        if (PyErr_Occurred())
+            goto done;
+    }
+
+    Py_CLEAR(self->applications);
+    FLAC__stream_decoder_set_metadata_respond(self->decoder,
+                                              FLAC__METADATA_TYPE_APPLICATION);
 
     BEGIN_PROCESSING(self);
     if (self->fd >= 0)
@@ -901,7 +3014,7 @@ Decoder_open(DecoderObject *self, PyObject *args)
                                                   &decoder_read_fd,
                                                   &decoder_seek_fd,
                                                   &decoder_tell_fd,
-                                                  &decoder_length,
+                                                  &decoder_length_fd,
                                                   &decoder_eof,
                                                   &decoder_write,
                                                   &decoder_metadata,
@@ -928,6 +3041,18 @@ Decoder_open(DecoderObject *self, PyObject *args)
     }
 
     decoder_clear_internal(self);
+    decoder_clear_stats(self);
+    self->frame_end_offset = 0;
+    self->frame_end_sample = 0;
+    self->max_blocksize = 0;
+    self->fixed_blocksize = 0;
+    self->frame_damaged = 0;
+    self->follow_valid = 0;
+    self->follow_rewind = 0;
+    if (self->use_pread)
+        self->follow_offset = self->fd_offset;
+    else if (self->fd >= 0 && (pos = lseek(self->fd, 0, SEEK_CUR)) >= 0)
+        self->follow_offset = pos;
 
     Py_INCREF((result = Py_None));
 
@@ -952,6 +3077,8 @@ Decoder_close(DecoderObject *self, PyObject *args)
     ok = FLAC__stream_decoder_finish(self->decoder);
     END_PROCESSING(self);
 
+    decoder_close_pread(self);
+
     if (!ok) {
         PyErr_Format(get_error_type(self->module),
                      "finish failed (MD5 hash incorrect)");
@@ -972,8 +3099,9 @@ Decoder_read(DecoderObject *self, PyObject *args)
     FLAC__bool ok = 1;
     FLAC__StreamDecoderState state = FLAC__STREAM_DECODER_END_OF_STREAM;
     PyObject *memview, *arrays[FLAC__MAX_CHANNELS] = {0}, *result = NULL;
-    Py_ssize_t out_count, new_size;
+    Py_ssize_t new_size;
     unsigned int i;
+    int hit, blocked = 0;
 
     BEGIN_METHOD(self, "read");
     if (!PyArg_ParseTuple(args, "n:read", &limit))
@@ -981,31 +3109,27 @@ Decoder_read(DecoderObject *self, PyObject *args)
 
     self->out_remaining = limit;
 
-    out_count = self->out_remaining;
-    if (out_count > self->buf_count)
-        out_count = self->buf_count;
-    if (out_count > 0) {
-        BEGIN_PROCESSING(self);
-        ok = (write_out_samples(self, self->buf_samples,
-                                self->buf_attr.channels,
-                                self->buf_start, out_count) >= 0);
-        END_PROCESSING(self);
-        if (!ok)
-            goto fail;
-
-        self->out_attr = self->buf_attr;
-        self->buf_start += out_count;
-        self->buf_count -= out_count;
-    }
-
     BEGIN_PROCESSING(self);
 
-    while (self->out_remaining > 0 && self->buf_count == 0) {
-        ok = FLAC__stream_decoder_process_single(self->decoder);
+    /* Samples left over from a previous read() or seek() */
+    ok = (decoder_read_buffer(self) >= 0);
+    self->follow_output = (self->out_count > 0);
+
+    while (ok && self->out_remaining > 0 && self->buf_count == 0) {
+        /* Try to find the next frame in the cache.  (If the previous
+           frame was read from the cache, libFLAC's position is
+           behind; it will seek when a frame is not found.) */
+        hit = decoder_load_cached(self, (self->seek_pending
+                                         ? self->seek_target
+                                         : self->frame_end_sample));
+        if (hit != 0) {
+            ok = (hit > 0 && decoder_read_buffer(self) >= 0);
+            continue;
+        }
 
-        state = FLAC__stream_decoder_get_state(self->decoder);
+        ok = decoder_process_single(self, &state);
         if (state == FLAC__STREAM_DECODER_ABORTED)
-            FLAC__stream_decoder_flush(self->decoder);
+            blocked = decoder_recover(self);
 
         if ((state == FLAC__STREAM_DECODER_END_OF_STREAM ||
              state == FLAC__STREAM_DECODER_ABORTED ||
@@ -1027,45 +3151,296 @@ Decoder_read(DecoderObject *self, PyObject *args)
         goto fail;
     }
 
-    if (self->out_count == 0) {
-        Py_INCREF(Py_None);
-        result = Py_None;
-    } else {
-        if (self->out_remaining > 0) {
-            new_size = self->out_count * sizeof(FLAC__int32);
-            for (i = 0; i < self->out_attr.channels; i++)
-                if (PyByteArray_Resize(self->out_byteobjs[i], new_size) < 0)
-                    goto fail;
-        }
+    if (self->out_count == 0 && blocked) {
+        PyErr_SetString(PyExc_BlockingIOError,
+                        "no complete frame is available");
+        goto fail;
+    } else if (self->out_count == 0) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    } else {
+        if (self->out_remaining > 0) {
+            new_size = self->out_count * sizeof(FLAC__int32);
+            for (i = 0; i < self->out_attr.channels; i++)
+                if (PyByteArray_Resize(self->out_byteobjs[i], new_size) < 0)
+                    goto fail;
+        }
+
+        for (i = 0; i < self->out_attr.channels; i++) {
+            memview = PyMemoryView_FromObject(self->out_byteobjs[i]);
+            arrays[i] = PyObject_CallMethod(memview, "cast", "(s)",
+                                            INT32_FORMAT);
+            Py_XDECREF(memview);
+            if (!arrays[i])
+                goto fail;
+        }
+
+        result = PyTuple_New(self->out_attr.channels);
+        for (i = 0; i < self->out_attr.channels; i++) {
+            PyTuple_SetItem(result, i, arrays[i]);
+            arrays[i] = NULL;   /* PyTuple_SetItem steals reference */
+        }
+    }
+
+ fail:
+    for (i = 0; i < FLAC__MAX_CHANNELS; i++) {
+        Py_CLEAR(arrays[i]);
+        Py_CLEAR(self->out_byteobjs[i]);
+        self->out_samples[i] = NULL;
+    }
+
+    self->out_count = 0;
+    self->out_remaining = 0;
+
+ done:
+    END_METHOD(self);
+    return result;
+}
+
+/* Decode the remainder of the stream as raw samples, writing them
+   to the file descriptor fd (or to raw_out, if fd is negative.) */
+static int
+decoder_decode_raw(DecoderObject *self, int fd, raw_format fmt)
+{
+    FLAC__bool ok = 1;
+    FLAC__StreamDecoderState state = FLAC__STREAM_DECODER_END_OF_STREAM;
+    const FLAC__int32 *buf[FLAC__MAX_CHANNELS];
+    unsigned int i;
+    int following = 0;
+
+    if (fmt.size < 1 || fmt.size > 4 || fmt.shift >= fmt.size * 8) {
+        PyErr_SetString(PyExc_ValueError, "invalid sample format");
+        return -1;
+    }
+
+    self->raw_buf = PyMem_Malloc((size_t) RAW_CHUNK_SIZE * fmt.size
+                                 * FLAC__MAX_CHANNELS);
+    if (!self->raw_buf) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->raw_fd = fd;
+    self->raw_fmt = fmt;
+    self->raw_channels = 0;
+    self->raw_samples = 0;
+
+    BEGIN_PROCESSING(self);
+
+    /* Samples left over from a previous read() */
+    self->follow_output = (self->buf_count > 0);
+    if (self->buf_count > 0) {
+        for (i = 0; i < self->buf_attr.channels; i++)
+            buf[i] = self->buf_samples[i];
+        ok = (write_raw_samples(self, buf, self->buf_attr.channels,
+                                self->buf_attr.bits_per_sample,
+                                self->buf_start, self->buf_count) >= 0);
+        self->buf_count = 0;
+    }
+
+    while (ok) {
+        ok = decoder_process_single(self, &state);
+        if (state == FLAC__STREAM_DECODER_END_OF_STREAM ||
+            state == FLAC__STREAM_DECODER_ABORTED)
+            break;
+    }
+
+    /* In follow mode, stop at the end of the data written so far. */
+    if (state == FLAC__STREAM_DECODER_ABORTED && self->follow_rewind) {
+        following = 1;
+        decoder_follow_rewind(self);
+    }
+
+    END_PROCESSING(self);
+
+    PyMem_Free(self->raw_buf);
+    self->raw_buf = NULL;
+    self->raw_fd = -1;
+
+    if (state == FLAC__STREAM_DECODER_ABORTED && !following)
+        FLAC__stream_decoder_flush(self->decoder);
+
+    if (PyErr_Occurred())
+        return -1;
+
+    if (state != FLAC__STREAM_DECODER_END_OF_STREAM && !following) {
+        PyErr_Format(get_error_type(self->module),
+                     "process_single failed (state = %s)",
+                     FLAC__StreamDecoderStateString[state]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static PyObject *
+Decoder_read_raw(DecoderObject *self, PyObject *args)
+{
+    int fd;
+    raw_format fmt;
+    PyObject *result = NULL;
+
+    BEGIN_METHOD(self, "read_raw");
+    if (!PyArg_ParseTuple(args, "iIppI:read_raw", &fd, &fmt.size,
+                          &fmt.big_endian, &fmt.is_unsigned, &fmt.shift))
+        goto done;
+
+    if (fd < 0) {
+        PyErr_SetString(PyExc_ValueError, "invalid file descriptor");
+        goto done;
+    }
+
+    if (decoder_decode_raw(self, fd, fmt) == 0)
+        result = PyLong_FromUnsignedLongLong(self->raw_samples);
+
+ done:
+    END_METHOD(self);
+    return result;
+}
+
+static PyObject *
+Decoder_read_bytes(DecoderObject *self, PyObject *args)
+{
+    raw_format fmt;
+    PyObject *result = NULL;
+
+    BEGIN_METHOD(self, "read_bytes");
+    if (!PyArg_ParseTuple(args, "IppI:read_bytes", &fmt.size,
+                          &fmt.big_endian, &fmt.is_unsigned, &fmt.shift))
+        goto done;
+
+    self->raw_out = PyByteArray_FromStringAndSize(NULL, 0);
+    self->raw_out_len = 0;
+    if (self->raw_out &&
+        decoder_decode_raw(self, -1, fmt) == 0 &&
+        PyByteArray_Resize(self->raw_out, self->raw_out_len) == 0) {
+        result = self->raw_out;
+        self->raw_out = NULL;
+    }
+    Py_CLEAR(self->raw_out);
+
+ done:
+    END_METHOD(self);
+    return result;
+}
+
+static PyObject *
+Decoder_skip(DecoderObject *self, PyObject *args)
+{
+    Py_ssize_t limit, count;
+    FLAC__bool ok = 1;
+    FLAC__StreamDecoderState state = FLAC__STREAM_DECODER_END_OF_STREAM;
+    PyObject *result = NULL;
+    int blocked = 0;
+
+    BEGIN_METHOD(self, "skip");
+    if (!PyArg_ParseTuple(args, "n:skip", &limit))
+        goto done;
+
+    self->skip_remaining = (limit > 0 ? limit : 0);
+
+    BEGIN_PROCESSING(self);
+
+    /* Samples left over from a previous read() */
+    count = self->skip_remaining;
+    if (count > self->buf_count)
+        count = self->buf_count;
+    if (count > 0) {
+        ok = (decoder_update_stats(self, (const FLAC__int32 * const *)
+                                   self->buf_samples,
+                                   self->buf_attr.channels,
+                                   self->buf_attr.bits_per_sample,
+                                   self->buf_start, count) >= 0);
+        self->buf_start += count;
+        self->buf_count -= count;
+        self->skip_remaining -= count;
+    }
+    self->follow_output = (count > 0);
+
+    while (ok && self->skip_remaining > 0 && self->buf_count == 0) {
+        ok = decoder_process_single(self, &state);
+        if (state == FLAC__STREAM_DECODER_ABORTED)
+            blocked = decoder_recover(self);
+
+        if ((state == FLAC__STREAM_DECODER_END_OF_STREAM ||
+             state == FLAC__STREAM_DECODER_ABORTED))
+            break;
+    }
+
+    END_PROCESSING(self);
+
+    count = limit - self->skip_remaining;
+    self->skip_remaining = 0;
+
+    if (PyErr_Occurred())
+        goto done;
+
+    if ((state != FLAC__STREAM_DECODER_END_OF_STREAM &&
+         state != FLAC__STREAM_DECODER_ABORTED &&
+         !ok)) {
+        PyErr_Format(get_error_type(self->module),
+                     "process_single failed (state = %s)",
+                     FLAC__StreamDecoderStateString[state]);
+        goto done;
+    }
+
+    if (count <= 0 && blocked) {
+        PyErr_SetString(PyExc_BlockingIOError,
+                        "no complete frame is available");
+        goto done;
+    }
 
-        for (i = 0; i < self->out_attr.channels; i++) {
-            memview = PyMemoryView_FromObject(self->out_byteobjs[i]);
-            arrays[i] = PyObject_CallMethod(memview, "cast", "(s)",
-                                            INT32_FORMAT);
-            Py_XDECREF(memview);
-            if (!arrays[i])
-                goto fail;
-        }
+    result = PyLong_FromSsize_t(count > 0 ? count : 0);
 
-        result = PyTuple_New(self->out_attr.channels);
-        for (i = 0; i < self->out_attr.channels; i++) {
-            PyTuple_SetItem(result, i, arrays[i]);
-            arrays[i] = NULL;   /* PyTuple_SetItem steals reference */
-        }
-    }
+ done:
+    END_METHOD(self);
+    return result;
+}
 
- fail:
-    for (i = 0; i < FLAC__MAX_CHANNELS; i++) {
-        Py_CLEAR(arrays[i]);
-        Py_CLEAR(self->out_byteobjs[i]);
-        self->out_samples[i] = NULL;
+static PyObject *
+Decoder_stats(DecoderObject *self, PyObject *args)
+{
+    PyObject *channels = NULL, *histogram, *item, *result = NULL;
+    unsigned int c;
+    size_t size;
+
+    BEGIN_METHOD(self, "stats");
+    if (!PyArg_ParseTuple(args, ":stats"))
+        goto done;
+
+    channels = PyTuple_New(self->stats.channels);
+    if (!channels)
+        goto done;
+    size = sizeof(FLAC__uint64) << self->stats.histogram_bits;
+    for (c = 0; c < self->stats.channels; c++) {
+        if (self->stats.histogram[c]) {
+            histogram = Array_FromMem(self->stats.histogram[c], size, "Q");
+        } else {
+            Py_INCREF(Py_None);
+            histogram = Py_None;
+        }
+        if (!histogram)
+            goto done;
+        item = Py_BuildValue("(llKKKKN)",
+                             (long) self->stats.min[c],
+                             (long) self->stats.max[c],
+                             (unsigned long long) self->stats.sum[c][0],
+                             (unsigned long long) self->stats.sum[c][1],
+                             (unsigned long long)
+                             self->stats.sum_squares[c][0],
+                             (unsigned long long)
+                             self->stats.sum_squares[c][1],
+                             histogram);
+        if (!item)
+            goto done;
+        PyTuple_SetItem(channels, c, item);
     }
 
-    self->out_count = 0;
-    self->out_remaining = 0;
+    result = Py_BuildValue("(KO)", (unsigned long long) self->stats.count,
+                           channels);
 
  done:
     END_METHOD(self);
+    Py_XDECREF(channels);
     return result;
 }
 
@@ -1075,6 +3450,7 @@ Decoder_read_metadata(DecoderObject *self, PyObject *args)
     FLAC__bool ok;
     FLAC__StreamDecoderState state;
     PyObject *result = NULL;
+    int blocked = 0;
 
     BEGIN_METHOD(self, "read_metadata");
     if (!PyArg_ParseTuple(args, ":read_metadata"))
@@ -1082,17 +3458,29 @@ Decoder_read_metadata(DecoderObject *self, PyObject *args)
 
     BEGIN_PROCESSING(self);
 
-    ok = FLAC__stream_decoder_process_until_end_of_metadata(self->decoder);
+    self->follow_output = 0;
+    ok = decoder_process_metadata(self);
 
+    /* In follow mode, the read is aborted if the metadata is not
+       written in time. */
     state = FLAC__stream_decoder_get_state(self->decoder);
-    if (state == FLAC__STREAM_DECODER_ABORTED)
-        FLAC__stream_decoder_flush(self->decoder);
+    if (state == FLAC__STREAM_DECODER_ABORTED) {
+        blocked = self->follow_rewind;
+        if (decoder_recover(self))
+            blocked = 1;
+    }
 
     END_PROCESSING(self);
 
     if (PyErr_Occurred())
         goto done;
 
+    if (blocked) {
+        PyErr_SetString(PyExc_BlockingIOError,
+                        "metadata is not yet available");
+        goto done;
+    }
+
     if (!ok) {
         PyErr_Format(get_error_type(self->module),
                      "read_metadata failed (state = %s)",
@@ -1112,8 +3500,9 @@ Decoder_seek(DecoderObject *self, PyObject *args)
 {
     PyObject *arg = NULL, *result = NULL;
     FLAC__uint64 sample_number;
-    FLAC__bool ok;
-    FLAC__StreamDecoderState state;
+    FLAC__bool ok = 1;
+    FLAC__StreamDecoderState state = FLAC__STREAM_DECODER_READ_FRAME;
+    int hit;
 
     BEGIN_METHOD(self, "seek");
     if (!PyArg_ParseTuple(args, "O:seek", &arg))
@@ -1122,16 +3511,34 @@ Decoder_seek(DecoderObject *self, PyObject *args)
     if (PyErr_Occurred())
         goto done;
 
+    /* If the sample is still in buf_samples, there is nothing else
+       to do. */
+    if (decoder_seek_buffer(self, sample_number)) {
+        Py_INCREF((result = Py_None));
+        goto done;
+    }
+
     self->buf_count = 0;
 
     BEGIN_PROCESSING(self);
 
-    ok = FLAC__stream_decoder_seek_absolute(self->decoder, sample_number);
+    /* If the frame was decoded recently, there is no need to ask
+       libFLAC to seek (yet). */
+    hit = decoder_load_cached(self, sample_number);
+    if (hit == 0) {
+        self->seek_pending = 0;
+        self->seeking = 1;
+        ok = FLAC__stream_decoder_seek_absolute(self->decoder,
+                                                sample_number);
+        self->seeking = 0;
 
-    state = FLAC__stream_decoder_get_state(self->decoder);
-    if ((state == FLAC__STREAM_DECODER_ABORTED ||
-         state == FLAC__STREAM_DECODER_SEEK_ERROR))
-        FLAC__stream_decoder_flush(self->decoder);
+        state = FLAC__stream_decoder_get_state(self->decoder);
+        if ((state == FLAC__STREAM_DECODER_ABORTED ||
+             state == FLAC__STREAM_DECODER_SEEK_ERROR)) {
+            FLAC__stream_decoder_flush(self->decoder);
+            self->frame_end_sample = 0;
+        }
+    }
 
     END_PROCESSING(self);
 
@@ -1162,17 +3569,51 @@ Decoder_total_samples_getter(DecoderObject* self, void *closure)
     return PyLong_FromUnsignedLongLong(n);
 }
 
+static PyObject *
+Decoder_applications_getter(DecoderObject *self, void *closure)
+{
+    PyObject *value;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->applications)
+        value = PyDict_Copy(self->applications);
+    else
+        value = PyDict_New();
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
+static PyObject *
+Decoder_md5sum_getter(DecoderObject *self, void *closure)
+{
+    PyObject *value;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = PyBytes_FromStringAndSize((char *) self->md5sum,
+                                      sizeof(self->md5sum));
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
 static PyMethodDef Decoder_methods[] = {
     {"close", (PyCFunction)Decoder_close, METH_VARARGS,
      PyDoc_STR("close() -> None")},
     {"open", (PyCFunction)Decoder_open, METH_VARARGS,
-     PyDoc_STR("open(fd) -> None")},
+     PyDoc_STR("open(fd, file_id=None, offset=None) -> None")},
     {"read", (PyCFunction)Decoder_read, METH_VARARGS,
      PyDoc_STR("read(n_samples) -> tuple of arrays, or None")},
     {"read_metadata", (PyCFunction)Decoder_read_metadata, METH_VARARGS,
      PyDoc_STR("read_metadata() -> None")},
+    {"read_bytes", (PyCFunction)Decoder_read_bytes, METH_VARARGS,
+     PyDoc_STR("read_bytes(sample_size, big_endian, is_unsigned, "
+               "shift) -> bytearray")},
+    {"read_raw", (PyCFunction)Decoder_read_raw, METH_VARARGS,
+     PyDoc_STR("read_raw(fd, sample_size, big_endian, is_unsigned, "
+               "shift) -> int")},
     {"seek", (PyCFunction)Decoder_seek, METH_VARARGS,
      PyDoc_STR("seek_absolute(sample_number) -> None")},
+    {"skip", (PyCFunction)Decoder_skip, METH_VARARGS,
+     PyDoc_STR("skip(n_samples) -> int")},
+    {"stats", (PyCFunction)Decoder_stats, METH_VARARGS,
+     PyDoc_STR("stats() -> (count, channel_stats)")},
     {NULL, NULL}
 };
 
@@ -1189,15 +3630,41 @@ static PyMemberDef Decoder_members[] = {
     {"error_callback", T_OBJECT_EX,
      offsetof(DecoderObject, error_callback),
      0},
+    {"track_position", T_BOOL,
+     offsetof(DecoderObject, track_position),
+     0},
+    {"frame_end_offset", T_ULONGLONG,
+     offsetof(DecoderObject, frame_end_offset),
+     READONLY},
+    {"frame_end_sample", T_ULONGLONG,
+     offsetof(DecoderObject, frame_end_sample),
+     READONLY},
+    {"frame_cache", T_UINT,
+     offsetof(DecoderObject, cache_size),
+     0},
+    {"follow_timeout", T_DOUBLE,
+     offsetof(DecoderObject, follow_timeout),
+     0},
+    {"resumable", T_BOOL,
+     offsetof(DecoderObject, resumable),
+     0},
     {NULL}
 };
 
 PROPERTY_FUNCS(Decoder, decoder, md5_checking, FLAC__bool,
                PyBool_FromLong, Long_AsBool)
+OPTION_FUNCS(Decoder, decoder, DECODER, collect_stats, char,
+             PyBool_FromLong, Long_AsBool)
+OPTION_FUNCS(Decoder, decoder, DECODER, histogram_bits, unsigned int,
+             PyLong_FromUnsignedLong, Long_AsUint32)
 
 static PyGetSetDef Decoder_properties[] = {
     PROPERTY_DEF_RO(Decoder, total_samples),
     PROPERTY_DEF_RW(Decoder, md5_checking),
+    PROPERTY_DEF_RW(Decoder, collect_stats),
+    PROPERTY_DEF_RW(Decoder, histogram_bits),
+    PROPERTY_DEF_RO(Decoder, applications),
+    PROPERTY_DEF_RO(Decoder, md5sum),
     {NULL}
 };
 
@@ -1234,7 +3701,7 @@ plibflac_decoder(PyObject *self, PyObject *args)
 /****************************************************************/
 /* Encoder objects */
 
-typedef struct {
+typedef struct EncoderObject {
     PyObject_HEAD
 
     PyThreadState       *thread_state;
@@ -1243,12 +3710,310 @@ typedef struct {
 
     PyObject            *fileobj;
     FLAC__StreamEncoder *encoder;
+    int                  fd;
     char                 seekable;
 
     int32_t              compression_level;
     PyObject            *apodization;
+
+    uint32_t             seekpoint_interval;
+    uint32_t             max_seekpoints;
+    uint32_t             padding;
+    FLAC__StreamMetadata *metadata[2];
+    unsigned int         n_metadata;
+
+    FLAC__StreamMetadata_SeekTable *seek_table;
+    uint32_t             seek_count;
+    FLAC__uint64         seek_step;
+    FLAC__uint64         seek_next;
+    FLAC__uint64         seek_samples;
+    FLAC__uint64         seek_offset;
+
+    char                 write_metadata;
+    char                 variable_blocksize;
+    FLAC__uint64         first_sample_number;
+    FLAC__uint64         first_frame_number;
+    FLAC__uint64         next_sample_number;
+    FLAC__byte          *frame_buffer;
+    size_t               frame_buffer_size;
+
+    unsigned int         min_framesize;
+    unsigned int         max_framesize;
+    FLAC__byte           md5sum[16];
+
+    uint32_t             envelope_interval;
+    FLAC__int32         *envelope;
+    size_t               envelope_count;
+    size_t               envelope_size;
+    uint32_t             envelope_pos;
+
+    char                 collect_stats;
+    char                 finishing;
+    FLAC__uint64         bytes_written;
+    uint32_t            *stats_numbers;
+    uint32_t            *stats_samples;
+    uint32_t            *stats_bytes;
+    Py_ssize_t           stats_count;
+    Py_ssize_t           stats_size;
 } EncoderObject;
 
+static void
+encoder_clear_stats(EncoderObject *self)
+{
+    PyMem_Free(self->stats_numbers);
+    PyMem_Free(self->stats_samples);
+    PyMem_Free(self->stats_bytes);
+    self->stats_numbers = NULL;
+    self->stats_samples = NULL;
+    self->stats_bytes = NULL;
+    self->stats_count = 0;
+    self->stats_size = 0;
+    self->bytes_written = 0;
+}
+
+static void
+encoder_clear_metadata(EncoderObject *self)
+{
+    unsigned int i;
+
+    for (i = 0; i < self->n_metadata; i++)
+        FLAC__metadata_object_delete(self->metadata[i]);
+    self->n_metadata = 0;
+    self->seek_table = NULL;
+}
+
+/* Create the metadata blocks to be written after STREAMINFO. */
+static int
+encoder_init_metadata(EncoderObject *self)
+{
+    FLAC__StreamMetadata *block;
+    FLAC__uint64 total_samples, n_points, i;
+
+    encoder_clear_metadata(self);
+
+    /* Seek points are filled in by libFLAC when the stream is
+       finished, which requires the output to be seekable.  If the
+       length of the stream is unknown, placeholders are reserved
+       instead, and filled in by encoder_add_seekpoint. */
+    if (self->seekpoint_interval > 0 && self->seekable) {
+        total_samples =
+            FLAC__stream_encoder_get_total_samples_estimate(self->encoder);
+        if (total_samples > 0)
+            n_points = ((total_samples + self->seekpoint_interval - 1)
+                        / self->seekpoint_interval);
+        else
+            n_points = self->max_seekpoints;
+        if (n_points > MAX_SEEK_POINTS) {
+            if (total_samples > 0)
+                PyErr_SetString(PyExc_ValueError,
+                                "seekpoint_interval is too small");
+            else
+                PyErr_SetString(PyExc_ValueError,
+                                "max_seekpoints is too large");
+            return -1;
+        }
+
+        block = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE);
+        if (!block)
+            goto nomem;
+        self->metadata[self->n_metadata++] = block;
+        if (!FLAC__metadata_object_seektable_resize_points(block, n_points))
+            goto nomem;
+        for (i = 0; i < n_points; i++) {
+            if (total_samples > 0)
+                block->data.seek_table.points[i].sample_number =
+                    i * self->seekpoint_interval;
+            else
+                block->data.seek_table.points[i].sample_number =
+                    FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER;
+            block->data.seek_table.points[i].stream_offset = 0;
+            block->data.seek_table.points[i].frame_samples = 0;
+        }
+        if (total_samples == 0 && n_points > 0) {
+            self->seek_table = &block->data.seek_table;
+            self->seek_count = 0;
+            self->seek_step = self->seekpoint_interval;
+            self->seek_next = 0;
+            self->seek_samples = 0;
+            self->seek_offset = 0;
+        }
+    }
+
+    if (self->padding > 0) {
+        block = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
+        if (!block)
+            goto nomem;
+        self->metadata[self->n_metadata++] = block;
+        block->length = self->padding;
+    }
+
+    FLAC__stream_encoder_set_metadata(self->encoder, self->metadata,
+                                      self->n_metadata);
+    return 0;
+
+ nomem:
+    encoder_clear_metadata(self);
+    PyErr_NoMemory();
+    return -1;
+}
+
+/* Fill in a reserved seek point, if the given frame contains the
+   next target sample.  When all of the reserved points have been
+   used, the interval between points is doubled, and points that are
+   no longer needed are discarded.  libFLAC never modifies these
+   points, since they always precede the frame being written. */
+static void
+encoder_add_seekpoint(EncoderObject *self, size_t bytes, uint32_t samples)
+{
+    FLAC__StreamMetadata_SeekTable *table = self->seek_table;
+    FLAC__StreamMetadata_SeekPoint *point;
+    FLAC__uint64 start = self->seek_samples, last;
+    uint32_t i, n;
+
+    self->seek_samples += samples;
+    self->seek_offset += bytes;
+
+    while (start + samples > self->seek_next) {
+        if (self->seek_count < table->num_points) {
+            point = &table->points[self->seek_count++];
+            point->sample_number = start;
+            point->stream_offset = self->seek_offset - bytes;
+            point->frame_samples = samples;
+            self->seek_next = ((start + samples + self->seek_step - 1)
+                               / self->seek_step * self->seek_step);
+            return;
+        }
+
+        self->seek_step *= 2;
+        n = 0;
+        for (i = 0; i < self->seek_count; i++) {
+            point = &table->points[i];
+            last = point->sample_number + point->frame_samples - 1;
+            if (last / self->seek_step * self->seek_step
+                >= point->sample_number)
+                table->points[n++] = *point;
+        }
+        for (i = n; i < self->seek_count; i++) {
+            table->points[i].sample_number =
+                FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER;
+            table->points[i].stream_offset = 0;
+            table->points[i].frame_samples = 0;
+        }
+        self->seek_count = n;
+        self->seek_next = ((self->seek_next + self->seek_step - 1)
+                           / self->seek_step * self->seek_step);
+    }
+}
+
+/* Record the size of a frame (if statistics are enabled) and the
+   total number of bytes written.  This must be called without holding
+   the GIL. */
+static int
+encoder_record_frame(EncoderObject *self,
+                     size_t         bytes,
+                     uint32_t       samples,
+                     uint32_t       current_frame)
+{
+    Py_ssize_t new_size;
+    int ok = 1;
+
+    if (samples == 0 && self->finishing)
+        return 0;
+    self->bytes_written += bytes;
+
+    if (samples == 0)
+        return 0;
+
+    if (self->min_framesize == 0 || bytes < self->min_framesize)
+        self->min_framesize = bytes;
+    if (bytes > self->max_framesize)
+        self->max_framesize = bytes;
+
+    if (self->seek_table)
+        encoder_add_seekpoint(self, bytes, samples);
+
+    if (!self->collect_stats)
+        return 0;
+
+    if (self->stats_count >= self->stats_size) {
+        BEGIN_CALLBACK(self);
+        new_size = self->stats_size * 2 + 256;
+        ok = (PyMem_Resize(self->stats_numbers, uint32_t, new_size) &&
+              PyMem_Resize(self->stats_samples, uint32_t, new_size) &&
+              PyMem_Resize(self->stats_bytes, uint32_t, new_size));
+        if (ok) {
+            self->stats_size = new_size;
+        } else {
+            encoder_clear_stats(self);
+            PyErr_NoMemory();
+        }
+        END_CALLBACK(self);
+        if (!ok)
+            return -1;
+    }
+
+    self->stats_numbers[self->stats_count] = current_frame;
+    self->stats_samples[self->stats_count] = samples;
+    self->stats_bytes[self->stats_count] = bytes;
+    self->stats_count++;
+    return 0;
+}
+
+/* Prepare data to be written to the output file.  If necessary, the
+   frame header is rewritten to change the frame number or blocking
+   strategy.  Returns 0 if the data should be written, 1 if it should
+   be skipped, or -1 on error.  This must be called without holding
+   the GIL. */
+static int
+encoder_prepare_write(EncoderObject     *self,
+                      const FLAC__byte **buffer,
+                      size_t            *bytes,
+                      uint32_t           samples)
+{
+    frame_header h;
+    FLAC__uint64 number;
+    FLAC__byte *new_buffer = NULL;
+    size_t size;
+    int valid;
+
+    if (samples == 0)
+        return (self->write_metadata ? 0 : 1);
+    if (!self->variable_blocksize && self->first_sample_number == 0)
+        return 0;
+
+    valid = parse_frame_header(*buffer, *bytes, &h);
+    size = *bytes + 6;
+    if (valid != 1 || size > self->frame_buffer_size) {
+        BEGIN_CALLBACK(self);
+        if (valid != 1) {
+            PyErr_SetString(get_error_type(self->module),
+                            "invalid frame header");
+        } else {
+            new_buffer = PyMem_Realloc(self->frame_buffer, size);
+            if (new_buffer) {
+                self->frame_buffer = new_buffer;
+                self->frame_buffer_size = size;
+            } else {
+                PyErr_NoMemory();
+            }
+        }
+        END_CALLBACK(self);
+        if (!new_buffer)
+            return -1;
+    }
+
+    if (self->variable_blocksize)
+        number = self->next_sample_number;
+    else
+        number = h.number + self->first_frame_number;
+    self->next_sample_number += samples;
+
+    *bytes = renumber_frame(self->frame_buffer, *buffer, *bytes, &h,
+                            self->variable_blocksize, number);
+    *buffer = self->frame_buffer;
+    return 0;
+}
+
 static FLAC__StreamEncoderWriteStatus
 encoder_write(const FLAC__StreamEncoder *encoder,
               const FLAC__byte           buffer[],
@@ -1259,9 +4024,17 @@ encoder_write(const FLAC__StreamEncoder *encoder,
 {
     EncoderObject *self = client_data;
     PyObject *bytesobj, *count;
-    size_t n;
+    size_t n, total;
     FLAC__StreamEncoderWriteStatus status;
 
+    switch (encoder_prepare_write(self, &buffer, &bytes, samples)) {
+    case 1:
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    case -1:
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+    total = bytes;
+
     BEGIN_CALLBACK(self);
 
     while (bytes > 0) {
@@ -1287,9 +4060,65 @@ encoder_write(const FLAC__StreamEncoder *encoder,
         status = FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
 
     END_CALLBACK(self);
+
+    if (status == FLAC__STREAM_ENCODER_WRITE_STATUS_OK &&
+        encoder_record_frame(self, total, samples, current_frame) < 0)
+        status = FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
     return status;
 }
 
+static FLAC__StreamEncoderWriteStatus
+encoder_write_fd(const FLAC__StreamEncoder *encoder,
+                 const FLAC__byte           buffer[],
+                 size_t                     bytes,
+                 uint32_t                   samples,
+                 uint32_t                   current_frame,
+                 void                      *client_data)
+{
+    EncoderObject *self = client_data;
+    size_t total;
+    Py_ssize_t n;
+    int e;
+
+    switch (encoder_prepare_write(self, &buffer, &bytes, samples)) {
+    case 1:
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    case -1:
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+    total = bytes;
+
+    while (bytes > 0) {
+        BEGIN_CALLBACK(self);
+        PyErr_CheckSignals();
+        e = !!PyErr_Occurred();
+        END_CALLBACK(self);
+
+        if (e)
+            return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+
+        n = write(self->fd, buffer, bytes);
+        if (n < 0) {
+            e = errno;
+            if (e == EINTR)
+                continue;
+            BEGIN_CALLBACK(self);
+            errno = e;
+            if (!PyErr_Occurred())
+                PyErr_SetFromErrno(PyExc_OSError);
+            END_CALLBACK(self);
+            return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+        }
+
+        buffer += n;
+        bytes -= n;
+    }
+
+    if (encoder_record_frame(self, total, samples, current_frame) < 0)
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
 static FLAC__StreamEncoderSeekStatus
 encoder_seek(const FLAC__StreamEncoder *encoder,
              FLAC__uint64               absolute_byte_offset,
@@ -1347,8 +4176,76 @@ encoder_tell(const FLAC__StreamEncoder *encoder,
         status = FLAC__STREAM_ENCODER_TELL_STATUS_OK;
     }
 
-    END_CALLBACK(self);
-    return status;
+    END_CALLBACK(self);
+    return status;
+}
+
+static FLAC__StreamEncoderSeekStatus
+encoder_seek_fd(const FLAC__StreamEncoder *encoder,
+                FLAC__uint64               absolute_byte_offset,
+                void                      *client_data)
+{
+    EncoderObject *self = client_data;
+    int e;
+
+    if (!self->seekable)
+        return FLAC__STREAM_ENCODER_SEEK_STATUS_UNSUPPORTED;
+
+    if (absolute_byte_offset > (FLAC__uint64) OFF_MAX) {
+        errno = EOVERFLOW;
+    } else {
+        if (lseek(self->fd, absolute_byte_offset, SEEK_SET) >= 0)
+            return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+    }
+    e = errno;
+    BEGIN_CALLBACK(self);
+    errno = e;
+    if (!PyErr_Occurred())
+        PyErr_SetFromErrno(PyExc_OSError);
+    END_CALLBACK(self);
+    return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+}
+
+static FLAC__StreamEncoderTellStatus
+encoder_tell_fd(const FLAC__StreamEncoder *encoder,
+                FLAC__uint64              *absolute_byte_offset,
+                void                      *client_data)
+{
+    EncoderObject *self = client_data;
+    off_t pos;
+    int e;
+
+    if (!self->seekable)
+        return FLAC__STREAM_ENCODER_TELL_STATUS_UNSUPPORTED;
+
+    pos = lseek(self->fd, (off_t) 0, SEEK_CUR);
+    if (pos >= 0) {
+        *absolute_byte_offset = (FLAC__uint64) pos;
+        return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+    }
+    e = errno;
+    BEGIN_CALLBACK(self);
+    if (!PyErr_Occurred()) {
+        errno = e;
+        PyErr_SetFromErrno(PyExc_OSError);
+    }
+    END_CALLBACK(self);
+    return FLAC__STREAM_ENCODER_TELL_STATUS_ERROR;
+}
+
+static void
+encoder_metadata(const FLAC__StreamEncoder  *encoder,
+                 const FLAC__StreamMetadata *metadata,
+                 void                       *client_data)
+{
+    EncoderObject *self = client_data;
+
+    /* This is called by FLAC__stream_encoder_finish(), with the
+       final contents of STREAMINFO. */
+    if (metadata && metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+        memcpy(self->md5sum, metadata->data.stream_info.md5sum,
+               sizeof(self->md5sum));
+    }
 }
 
 static EncoderObject *
@@ -1368,12 +4265,39 @@ newEncoderObject(PyObject *module, PyObject *fileobj)
     self->thread_state = NULL;
     self->busy_method = NULL;
     self->encoder = FLAC__stream_encoder_new();
+    self->fd = -1;
     self->module = module;
     Py_XINCREF(self->module);
     self->fileobj = fileobj;
     Py_XINCREF(self->fileobj);
     self->apodization = NULL;
     self->compression_level = 0;
+    self->seekpoint_interval = 0;
+    self->max_seekpoints = 128;
+    self->padding = 0;
+    self->n_metadata = 0;
+    self->seek_table = NULL;
+    self->write_metadata = 1;
+    self->variable_blocksize = 0;
+    self->first_sample_number = 0;
+    self->first_frame_number = 0;
+    self->next_sample_number = 0;
+    self->frame_buffer = NULL;
+    self->frame_buffer_size = 0;
+    self->min_framesize = 0;
+    self->max_framesize = 0;
+    memset(self->md5sum, 0, sizeof(self->md5sum));
+    self->envelope_interval = 0;
+    self->envelope = NULL;
+    self->envelope_count = 0;
+    self->envelope_size = 0;
+    self->envelope_pos = 0;
+    self->collect_stats = 0;
+    self->finishing = 0;
+    self->stats_numbers = NULL;
+    self->stats_samples = NULL;
+    self->stats_bytes = NULL;
+    encoder_clear_stats(self);
 
     PyObject_GC_Track((PyObject *) self);
 
@@ -1417,12 +4341,111 @@ Encoder_dealloc(EncoderObject *self)
     Py_CLEAR(self->fileobj);
     Py_CLEAR(self->apodization);
 
+    encoder_clear_stats(self);
+
     if (self->encoder)
         FLAC__stream_encoder_delete(self->encoder);
 
+    encoder_clear_metadata(self);
+    PyMem_Free(self->frame_buffer);
+    PyMem_Free(self->envelope);
+
     PyObject_GC_Del(self);
 }
 
+/* Update the minimum and maximum of each channel over each interval
+   of envelope_interval samples. */
+static int
+encoder_update_envelope(EncoderObject *self,
+                        const FLAC__int32 * const buffer[],
+                        size_t samples)
+{
+    unsigned int channels, c;
+    size_t i = 0, j, n, size;
+    FLAC__int32 *cur, lo, hi;
+    void *new_envelope;
+
+    channels = FLAC__stream_encoder_get_channels(self->encoder);
+    while (i < samples) {
+        size = (self->envelope_count + 1) * channels * 2;
+        if (size > self->envelope_size) {
+            size = size < 2 * self->envelope_size ? 2 * self->envelope_size
+                                                   : size + 1024;
+            BEGIN_CALLBACK(self);
+            new_envelope = PyMem_Realloc(self->envelope,
+                                         size * sizeof(FLAC__int32));
+            if (new_envelope) {
+                self->envelope = new_envelope;
+                self->envelope_size = size;
+            } else {
+                PyErr_NoMemory();
+            }
+            END_CALLBACK(self);
+            if (!new_envelope)
+                return -1;
+        }
+
+        cur = self->envelope + self->envelope_count * channels * 2;
+        n = self->envelope_interval - self->envelope_pos;
+        if (n > samples - i)
+            n = samples - i;
+        for (c = 0; c < channels; c++) {
+            if (self->envelope_pos == 0) {
+                lo = hi = buffer[c][i];
+            } else {
+                lo = cur[2 * c];
+                hi = cur[2 * c + 1];
+            }
+            for (j = i; j < i + n; j++) {
+                if (buffer[c][j] < lo)
+                    lo = buffer[c][j];
+                if (buffer[c][j] > hi)
+                    hi = buffer[c][j];
+            }
+            cur[2 * c] = lo;
+            cur[2 * c + 1] = hi;
+        }
+        i += n;
+        self->envelope_pos += n;
+        if (self->envelope_pos == self->envelope_interval) {
+            self->envelope_count++;
+            self->envelope_pos = 0;
+        }
+    }
+    return 0;
+}
+
+/* Encode samples; all input passes through this function.  Must be
+   called while processing. */
+static FLAC__bool
+encoder_process(EncoderObject *self, const FLAC__int32 * const buffer[],
+                size_t samples)
+{
+    if (self->envelope_interval > 0 &&
+        encoder_update_envelope(self, buffer, samples) < 0)
+        return 0;
+    return FLAC__stream_encoder_process(self->encoder, buffer, samples);
+}
+
+/* Encode a frame that was decoded by a DecoderObject. */
+static FLAC__bool
+encoder_process_frame(EncoderObject *self, const FLAC__Frame *frame,
+                      const FLAC__int32 * const buffer[])
+{
+    if (frame->header.channels !=
+        FLAC__stream_encoder_get_channels(self->encoder) ||
+        frame->header.bits_per_sample !=
+        FLAC__stream_encoder_get_bits_per_sample(self->encoder)) {
+        BEGIN_CALLBACK(self);
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "format of input "
+                            "does not match encoder settings");
+        END_CALLBACK(self);
+        return 0;
+    }
+    return encoder_process(self, buffer, frame->header.blocksize);
+}
+
 static PyObject *
 Encoder_new(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
 {
@@ -1435,9 +4458,11 @@ Encoder_open(EncoderObject *self, PyObject *args)
 {
     FLAC__StreamEncoderInitStatus status;
     PyObject *seekable, *result = NULL;
+    uint32_t blocksize;
 
     BEGIN_METHOD(self, "open");
-    if (!PyArg_ParseTuple(args, ":open"))
+    self->fd = -1;
+    if (!PyArg_ParseTuple(args, "|i:open", &self->fd))
         goto done;
 
     seekable = PyObject_CallMethod(self->fileobj, "seekable", "()");
@@ -1446,12 +4471,49 @@ Encoder_open(EncoderObject *self, PyObject *args)
     if (PyErr_Occurred())
         goto done;
 
+    /* If frames are renumbered, the caller is responsible for
+       updating the metadata at the end of the stream. */
+    if (!self->write_metadata || self->variable_blocksize)
+        self->seekable = 0;
+
+    blocksize = FLAC__stream_encoder_get_blocksize(self->encoder);
+    if (!self->variable_blocksize && self->first_sample_number != 0 &&
+        (blocksize == 0 || self->first_sample_number % blocksize != 0)) {
+        PyErr_SetString(PyExc_ValueError, "first_sample_number must be "
+                        "a multiple of blocksize");
+        goto done;
+    }
+    self->next_sample_number = self->first_sample_number;
+    self->first_frame_number = 0;
+    if (!self->variable_blocksize && self->first_sample_number != 0)
+        self->first_frame_number = self->first_sample_number / blocksize;
+    self->min_framesize = 0;
+    self->max_framesize = 0;
+    memset(self->md5sum, 0, sizeof(self->md5sum));
+    self->envelope_count = 0;
+    self->envelope_pos = 0;
+
+    encoder_clear_stats(self);
+    self->finishing = 0;
+
+    if (FLAC__stream_encoder_get_state(self->encoder) ==
+        FLAC__STREAM_ENCODER_UNINITIALIZED &&
+        encoder_init_metadata(self) < 0)
+        goto done;
+
     BEGIN_PROCESSING(self);
-    status = FLAC__stream_encoder_init_stream(self->encoder,
-                                              &encoder_write,
-                                              &encoder_seek,
-                                              &encoder_tell,
-                                              NULL, self);
+    if (self->fd >= 0)
+        status = FLAC__stream_encoder_init_stream(self->encoder,
+                                                  &encoder_write_fd,
+                                                  &encoder_seek_fd,
+                                                  &encoder_tell_fd,
+                                                  &encoder_metadata, self);
+    else
+        status = FLAC__stream_encoder_init_stream(self->encoder,
+                                                  &encoder_write,
+                                                  &encoder_seek,
+                                                  &encoder_tell,
+                                                  &encoder_metadata, self);
     END_PROCESSING(self);
 
     if (PyErr_Occurred())
@@ -1483,10 +4545,13 @@ Encoder_close(EncoderObject *self, PyObject *args)
         goto done;
 
 
+    self->finishing = 1;
     BEGIN_PROCESSING(self);
     ok = FLAC__stream_encoder_finish(self->encoder);
     END_PROCESSING(self);
 
+    encoder_clear_metadata(self);
+
     if (PyErr_Occurred())
         goto done;
 
@@ -1567,9 +4632,7 @@ Encoder_write(EncoderObject *self, PyObject *args)
     }
 
     BEGIN_PROCESSING(self);
-    ok = FLAC__stream_encoder_process(self->encoder,
-                                      (const FLAC__int32 **) data,
-                                      nsamples);
+    ok = encoder_process(self, (const FLAC__int32 **) data, nsamples);
     END_PROCESSING(self);
 
     if (PyErr_Occurred())
@@ -1596,13 +4659,188 @@ Encoder_write(EncoderObject *self, PyObject *args)
     return result;
 }
 
+static PyObject *
+Encoder_write_raw(EncoderObject *self, PyObject *args)
+{
+    int fd, e = 0;
+    raw_format fmt;
+    long long limit;
+    FLAC__byte *raw = NULL;
+    FLAC__int32 *data[FLAC__MAX_CHANNELS] = {NULL};
+    unsigned int channels, i;
+    size_t frame_bytes, have = 0, want, nframes;
+    FLAC__uint64 total = 0, remaining;
+    Py_ssize_t n;
+    FLAC__StreamEncoderState state;
+    FLAC__bool ok = 1;
+    PyObject *result = NULL;
+
+    BEGIN_METHOD(self, "write_raw");
+    if (!PyArg_ParseTuple(args, "iIppIL:write_raw", &fd, &fmt.size,
+                          &fmt.big_endian, &fmt.is_unsigned,
+                          &fmt.shift, &limit))
+        goto done;
+
+    if (fmt.size < 1 || fmt.size > 4 || fmt.shift >= fmt.size * 8) {
+        PyErr_SetString(PyExc_ValueError, "invalid sample format");
+        goto done;
+    }
+
+    channels = FLAC__stream_encoder_get_channels(self->encoder);
+    frame_bytes = (size_t) fmt.size * channels;
+    raw = PyMem_Malloc(frame_bytes * RAW_CHUNK_SIZE);
+    if (!raw) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < channels; i++) {
+        data[i] = PyMem_New(FLAC__int32, RAW_CHUNK_SIZE);
+        if (!data[i]) {
+            PyErr_NoMemory();
+            goto done;
+        }
+    }
+
+    remaining = (limit < 0 ? (FLAC__uint64) -1 : (FLAC__uint64) limit);
+
+    BEGIN_PROCESSING(self);
+    while (ok && remaining > 0) {
+        BEGIN_CALLBACK(self);
+        PyErr_CheckSignals();
+        e = !!PyErr_Occurred();
+        END_CALLBACK(self);
+        if (e)
+            break;
+
+        want = frame_bytes * RAW_CHUNK_SIZE - have;
+        if (want > remaining)
+            want = remaining;
+        n = read(fd, raw + have, want);
+        if (n < 0) {
+            e = errno;
+            if (e == EINTR)
+                continue;
+            break;
+        }
+        e = 0;
+        if (n == 0)
+            break;
+        have += n;
+        remaining -= n;
+
+        nframes = have / frame_bytes;
+        raw_to_samples(raw, nframes, channels, &fmt, data);
+        ok = encoder_process(self, (const FLAC__int32 **) data, nframes);
+        total += nframes;
+        have -= nframes * frame_bytes;
+        memmove(raw, raw + nframes * frame_bytes, have);
+    }
+    END_PROCESSING(self);
+
+    if (PyErr_Occurred())
+        goto done;
+
+    if (e != 0) {
+        errno = e;
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto done;
+    }
+
+    if (!ok) {
+        state = FLAC__stream_encoder_get_state(self->encoder);
+        PyErr_Format(get_error_type(self->module),
+                     "process failed (state = %s)",
+                     FLAC__StreamEncoderStateString[state]);
+        goto done;
+    }
+
+    if (have > 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "input ends with an incomplete sample frame");
+        goto done;
+    }
+
+    result = PyLong_FromUnsignedLongLong(total);
+
+ done:
+    END_METHOD(self);
+    PyMem_Free(raw);
+    for (i = 0; i < FLAC__MAX_CHANNELS; i++)
+        PyMem_Free(data[i]);
+    return result;
+}
+
+static PyObject *
+Encoder_stats(EncoderObject *self, PyObject *args)
+{
+    PyObject *numbers = NULL, *samples = NULL, *bytes = NULL, *result = NULL;
+    size_t size;
+
+    BEGIN_METHOD(self, "stats");
+    if (!PyArg_ParseTuple(args, ":stats"))
+        goto done;
+
+    size = self->stats_count * sizeof(uint32_t);
+    numbers = Array_FromMem(self->stats_numbers, size, UINT32_FORMAT);
+    samples = Array_FromMem(self->stats_samples, size, UINT32_FORMAT);
+    bytes = Array_FromMem(self->stats_bytes, size, UINT32_FORMAT);
+    if (numbers && samples && bytes)
+        result = Py_BuildValue("(OOOK)", numbers, samples, bytes,
+                               (unsigned long long) self->bytes_written);
+
+ done:
+    END_METHOD(self);
+    Py_XDECREF(numbers);
+    Py_XDECREF(samples);
+    Py_XDECREF(bytes);
+    return result;
+}
+
+static PyObject *
+Encoder_envelope(EncoderObject *self, PyObject *args)
+{
+    PyObject *result = NULL;
+    size_t count;
+
+    BEGIN_METHOD(self, "envelope");
+    if (!PyArg_ParseTuple(args, ":envelope"))
+        goto done;
+
+    count = self->envelope_count + (self->envelope_pos > 0);
+    count *= FLAC__stream_encoder_get_channels(self->encoder) * 2;
+    result = Array_FromMem(self->envelope, count * sizeof(FLAC__int32),
+                           INT32_FORMAT);
+
+ done:
+    END_METHOD(self);
+    return result;
+}
+
 static PyMethodDef Encoder_methods[] = {
     {"close", (PyCFunction)Encoder_close, METH_VARARGS,
      PyDoc_STR("close() -> None")},
+    {"envelope", (PyCFunction)Encoder_envelope, METH_VARARGS,
+     PyDoc_STR("envelope() -> array")},
     {"open", (PyCFunction)Encoder_open, METH_VARARGS,
-     PyDoc_STR("open() -> None")},
+     PyDoc_STR("open(fd=-1) -> None")},
+    {"stats", (PyCFunction)Encoder_stats, METH_VARARGS,
+     PyDoc_STR("stats() -> (frame_numbers, frame_samples, frame_bytes, "
+               "bytes_written)")},
     {"write", (PyCFunction)Encoder_write, METH_VARARGS,
      PyDoc_STR("write(sample_arrays) -> None")},
+    {"write_raw", (PyCFunction)Encoder_write_raw, METH_VARARGS,
+     PyDoc_STR("write_raw(fd, sample_size, big_endian, is_unsigned, "
+               "shift, limit) -> int")},
+    {NULL}
+};
+
+static PyMemberDef Encoder_members[] = {
+    {"min_framesize", T_UINT,
+     offsetof(EncoderObject, min_framesize),
+     READONLY},
+    {"max_framesize", T_UINT,
+     offsetof(EncoderObject, max_framesize),
+     READONLY},
     {NULL}
 };
 
@@ -1717,6 +4955,36 @@ Encoder_apodization_setter(EncoderObject *self, PyObject *value,
     return 0;
 }
 
+#define ENCODER_OPTION(prop, type, to_pyobj, from_pyobj)                \
+    OPTION_FUNCS(Encoder, encoder, ENCODER, prop, type, to_pyobj, from_pyobj)
+#define ENCODER_OPTION_BOOL(prop)                                       \
+    ENCODER_OPTION(prop, char, PyBool_FromLong, Long_AsBool)
+#define ENCODER_OPTION_UINT32(prop)                                     \
+    ENCODER_OPTION(prop, uint32_t, PyLong_FromUnsignedLong, Long_AsUint32)
+#define ENCODER_OPTION_UINT64(prop)                                     \
+    ENCODER_OPTION(prop, FLAC__uint64,                                  \
+                   PyLong_FromUnsignedLongLong, Long_AsUint64)
+
+ENCODER_OPTION_UINT32(seekpoint_interval)
+ENCODER_OPTION_UINT32(max_seekpoints)
+ENCODER_OPTION_UINT32(padding)
+ENCODER_OPTION_UINT32(envelope_interval)
+ENCODER_OPTION_BOOL(write_metadata)
+ENCODER_OPTION_BOOL(variable_blocksize)
+ENCODER_OPTION_UINT64(first_sample_number)
+ENCODER_OPTION_BOOL(collect_stats)
+
+static PyObject *
+Encoder_md5sum_getter(EncoderObject *self, void *closure)
+{
+    PyObject *value;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    value = PyBytes_FromStringAndSize((char *) self->md5sum,
+                                      sizeof(self->md5sum));
+    Py_END_CRITICAL_SECTION();
+    return value;
+}
+
 static PyObject *
 Encoder_num_threads_getter(EncoderObject *self, void *closure)
 {
@@ -1785,6 +5053,15 @@ static PyGetSetDef Encoder_properties[] = {
     PROPERTY_DEF_RW(Encoder, min_residual_partition_order),
     PROPERTY_DEF_RW(Encoder, max_residual_partition_order),
     PROPERTY_DEF_RW(Encoder, num_threads),
+    PROPERTY_DEF_RW(Encoder, seekpoint_interval),
+    PROPERTY_DEF_RW(Encoder, max_seekpoints),
+    PROPERTY_DEF_RW(Encoder, padding),
+    PROPERTY_DEF_RW(Encoder, envelope_interval),
+    PROPERTY_DEF_RW(Encoder, write_metadata),
+    PROPERTY_DEF_RW(Encoder, variable_blocksize),
+    PROPERTY_DEF_RW(Encoder, first_sample_number),
+    PROPERTY_DEF_RW(Encoder, collect_stats),
+    PROPERTY_DEF_RO(Encoder, md5sum),
     {NULL}
 };
 
@@ -1794,6 +5071,7 @@ static PyType_Slot Encoder_Type_slots[] = {
     {Py_tp_clear,    Encoder_clear},
     {Py_tp_new,      Encoder_new},
     {Py_tp_methods,  Encoder_methods},
+    {Py_tp_members,  Encoder_members},
     {Py_tp_getset,   Encoder_properties},
     {0, 0}
 };
@@ -1835,7 +5113,317 @@ plibflac_flac_version(PyObject *self, PyObject *args)
     return PyUnicode_FromString(FLAC__VERSION_STRING);
 }
 
+static PyObject *
+plibflac_parse_frame_header(PyObject *self, PyObject *args)
+{
+    const char *data;
+    Py_ssize_t len;
+    frame_header h;
+
+    if (!PyArg_ParseTuple(args, "y#:parse_frame_header", &data, &len))
+        return NULL;
+
+    if (parse_frame_header((const FLAC__byte *) data, len, &h) != 1)
+        Py_RETURN_NONE;
+
+    return Py_BuildValue("(NKkkkkk)",
+                         PyBool_FromLong(h.variable_blocksize),
+                         (unsigned long long) h.number,
+                         (unsigned long) h.blocksize,
+                         (unsigned long) h.sample_rate,
+                         (unsigned long) h.channels,
+                         (unsigned long) h.bits_per_sample,
+                         (unsigned long) h.header_length);
+}
+
+static PyObject *
+plibflac_renumber_frame(PyObject *self, PyObject *args)
+{
+    const char *data;
+    Py_ssize_t len;
+    int variable_blocksize;
+    unsigned long long number;
+    frame_header h;
+    FLAC__byte *buf;
+    size_t new_len;
+    PyObject *result;
+
+    if (!PyArg_ParseTuple(args, "y#pK:renumber_frame", &data, &len,
+                          &variable_blocksize, &number))
+        return NULL;
+
+    if (number >> (variable_blocksize ? 36 : 31)) {
+        PyErr_SetString(PyExc_ValueError, "number out of range");
+        return NULL;
+    }
+    if (parse_frame_header((const FLAC__byte *) data, len, &h) != 1 ||
+        (size_t) len < h.header_length + 2) {
+        PyErr_SetString(get_error_type(self), "invalid frame header");
+        return NULL;
+    }
+
+    buf = PyMem_Malloc(len + 6);
+    if (!buf)
+        return PyErr_NoMemory();
+    Py_BEGIN_ALLOW_THREADS
+    new_len = renumber_frame(buf, (const FLAC__byte *) data, len, &h,
+                             variable_blocksize, number);
+    Py_END_ALLOW_THREADS
+    result = PyBytes_FromStringAndSize((const char *) buf, new_len);
+    PyMem_Free(buf);
+    return result;
+}
+
+static PyObject *
+plibflac_scan_frames(PyObject *self, PyObject *args)
+{
+    const char *data;
+    Py_ssize_t len, max_frames;
+    int final;
+    unsigned long channels, bits_per_sample, sample_rate, max_blocksize;
+    unsigned long max_framesize;
+    frame_header ref;
+    frame_record *records;
+    size_t n, i, consumed;
+    PyObject *list = NULL, *item, *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "y#pkkkkkn:scan_frames", &data, &len,
+                          &final, &channels, &bits_per_sample,
+                          &sample_rate, &max_blocksize, &max_framesize,
+                          &max_frames))
+        return NULL;
+
+    if (max_frames <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_frames must be positive");
+        return NULL;
+    }
+    records = PyMem_Malloc(max_frames * sizeof(frame_record));
+    if (!records)
+        return PyErr_NoMemory();
+
+    memset(&ref, 0, sizeof(ref));
+    ref.channels = channels;
+    ref.bits_per_sample = bits_per_sample;
+    ref.sample_rate = sample_rate;
+    ref.blocksize = max_blocksize;
+
+    Py_BEGIN_ALLOW_THREADS
+    n = scan_frames((const FLAC__byte *) data, len, final, &ref,
+                    max_framesize, records, max_frames, &consumed);
+    Py_END_ALLOW_THREADS
+
+    list = PyList_New(n);
+    if (!list)
+        goto done;
+    for (i = 0; i < n; i++) {
+        const frame_header *h = &records[i].header;
+        const FLAC__byte *frame, *end;
+
+        frame = (const FLAC__byte *) data + records[i].offset;
+        end = frame + records[i].length;
+        item = Py_BuildValue("(nnNKkkkkkkk)",
+                             (Py_ssize_t) records[i].offset,
+                             (Py_ssize_t) records[i].length,
+                             PyBool_FromLong(h->variable_blocksize),
+                             (unsigned long long) h->number,
+                             (unsigned long) h->blocksize,
+                             (unsigned long) h->sample_rate,
+                             (unsigned long) h->channels,
+                             (unsigned long) h->channel_assignment,
+                             (unsigned long) h->bits_per_sample,
+                             (unsigned long) frame[h->header_length - 1],
+                             (unsigned long) ((end[-2] << 8) | end[-1]));
+        if (!item || PyList_SetItem(list, i, item) < 0)
+            goto done;
+    }
+    result = Py_BuildValue("(On)", list, (Py_ssize_t) consumed);
+
+ done:
+    Py_XDECREF(list);
+    PyMem_Free(records);
+    return result;
+}
+
+static PyObject *
+plibflac_crc16(PyObject *self, PyObject *args)
+{
+    const char *data;
+    Py_ssize_t len;
+    FLAC__uint16 crc;
+
+    if (!PyArg_ParseTuple(args, "y#:crc16", &data, &len))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    crc = crc16(0, (const FLAC__byte *) data, len);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromLong(crc);
+}
+
+static PyObject *
+plibflac_transcode(PyObject *self, PyObject *args)
+{
+    plibflac_module_state *st;
+    DecoderObject *decoder;
+    EncoderObject *encoder;
+    const FLAC__int32 *buf[FLAC__MAX_CHANNELS];
+    FLAC__StreamDecoderState dstate = FLAC__STREAM_DECODER_END_OF_STREAM;
+    FLAC__StreamEncoderState estate;
+    FLAC__bool ok = 1;
+    PyObject *result = NULL;
+    unsigned int i;
+    int following = 0;
+
+    st = PyModule_GetState(self);
+    if (st == NULL)
+        return NULL;
+
+    if (!PyArg_ParseTuple(args, "O!O!:transcode",
+                          (PyTypeObject *) st->Decoder_Type, &decoder,
+                          (PyTypeObject *) st->Encoder_Type, &encoder))
+        return NULL;
+
+    BEGIN_METHOD(decoder, "transcode");
+    BEGIN_METHOD(encoder, "transcode");
+
+    decoder->sink = encoder;
+    decoder->sink_samples = 0;
+
+    /* Both objects are processing at the same time; callbacks for
+       either one may need to reacquire the GIL. */
+    BEGIN_PROCESSING(decoder);
+    encoder->thread_state = decoder->thread_state;
+
+    /* Samples left over from a previous read() */
+    decoder->follow_output = (decoder->buf_count > 0);
+    if (decoder->buf_count > 0) {
+        for (i = 0; i < decoder->buf_attr.channels; i++)
+            buf[i] = decoder->buf_samples[i] + decoder->buf_start;
+        ok = (decoder_update_stats(decoder, buf, decoder->buf_attr.channels,
+                                   decoder->buf_attr.bits_per_sample,
+                                   0, decoder->buf_count) >= 0 &&
+              encoder_process(encoder, buf, decoder->buf_count));
+        decoder->sink_samples += decoder->buf_count;
+        decoder->buf_count = 0;
+    }
+
+    while (ok) {
+        ok = decoder_process_single(decoder, &dstate);
+        if (dstate == FLAC__STREAM_DECODER_END_OF_STREAM ||
+            dstate == FLAC__STREAM_DECODER_ABORTED)
+            break;
+    }
+
+    /* In follow mode, stop at the end of the data written so far. */
+    if (dstate == FLAC__STREAM_DECODER_ABORTED && decoder->follow_rewind) {
+        following = 1;
+        decoder_follow_rewind(decoder);
+    }
+
+    encoder->thread_state = NULL;
+    END_PROCESSING(decoder);
+
+    decoder->sink = NULL;
+
+    if (dstate == FLAC__STREAM_DECODER_ABORTED && !following)
+        FLAC__stream_decoder_flush(decoder->decoder);
+
+    if (PyErr_Occurred())
+        goto done;
+
+    estate = FLAC__stream_encoder_get_state(encoder->encoder);
+    if (estate != FLAC__STREAM_ENCODER_OK) {
+        PyErr_Format(get_error_type(self),
+                     "process failed (state = %s)",
+                     FLAC__StreamEncoderStateString[estate]);
+        goto done;
+    }
+
+    if (dstate != FLAC__STREAM_DECODER_END_OF_STREAM && !following) {
+        PyErr_Format(get_error_type(self),
+                     "process_single failed (state = %s)",
+                     FLAC__StreamDecoderStateString[dstate]);
+        goto done;
+    }
+
+    result = PyLong_FromUnsignedLongLong(decoder->sink_samples);
+
+ done:
+    END_METHOD(encoder);
+    END_METHOD(decoder);
+    return result;
+}
+
+static PyObject *
+plibflac_shared_cache_configure(PyObject *self, PyObject *args)
+{
+    Py_ssize_t max_size;
+
+    if (!PyArg_ParseTuple(args, "n:shared_cache_configure", &max_size))
+        return NULL;
+    if (max_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be non-negative");
+        return NULL;
+    }
+
+    static_lock_acquire(&shared_cache.lock);
+    if (max_size > 0 && !shared_cache.buckets) {
+        shared_cache.buckets = calloc(SHARED_CACHE_BUCKETS,
+                                      sizeof(shared_frame *));
+        if (!shared_cache.buckets) {
+            static_lock_release(&shared_cache.lock);
+            return PyErr_NoMemory();
+        }
+    }
+    shared_cache.max_size = max_size;
+    shared_cache_trim();
+    static_lock_release(&shared_cache.lock);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+plibflac_shared_cache_clear(PyObject *self, PyObject *args)
+{
+    size_t max_size;
+
+    if (!PyArg_ParseTuple(args, ":shared_cache_clear"))
+        return NULL;
+
+    static_lock_acquire(&shared_cache.lock);
+    max_size = shared_cache.max_size;
+    shared_cache.max_size = 0;
+    shared_cache_trim();
+    shared_cache.max_size = max_size;
+    shared_cache.hits = 0;
+    shared_cache.misses = 0;
+    static_lock_release(&shared_cache.lock);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+plibflac_shared_cache_info(PyObject *self, PyObject *args)
+{
+    unsigned long long hits, misses;
+    size_t size, max_size, count;
+
+    if (!PyArg_ParseTuple(args, ":shared_cache_info"))
+        return NULL;
+
+    static_lock_acquire(&shared_cache.lock);
+    hits = shared_cache.hits;
+    misses = shared_cache.misses;
+    size = shared_cache.size;
+    max_size = shared_cache.max_size;
+    count = shared_cache.count;
+    static_lock_release(&shared_cache.lock);
+
+    return Py_BuildValue("(KKnnn)", hits, misses, (Py_ssize_t) size,
+                         (Py_ssize_t) max_size, (Py_ssize_t) count);
+}
+
 static PyMethodDef plibflac_methods[] = {
+    {"crc16", plibflac_crc16, METH_VARARGS,
+     PyDoc_STR("crc16(data) -> int")},
     {"decoder", plibflac_decoder, METH_VARARGS,
      PyDoc_STR("decoder(fileobj) -> new Decoder object")},
     {"encoder", plibflac_encoder, METH_VARARGS,
@@ -1844,6 +5432,25 @@ static PyMethodDef plibflac_methods[] = {
      PyDoc_STR("flac_vendor() -> str")},
     {"flac_version", plibflac_flac_version, METH_VARARGS,
      PyDoc_STR("flac_version() -> str")},
+    {"parse_frame_header", plibflac_parse_frame_header, METH_VARARGS,
+     PyDoc_STR("parse_frame_header(data) -> (variable_blocksize, number, "
+               "blocksize, sample_rate, channels, bits_per_sample, "
+               "header_length)")},
+    {"renumber_frame", plibflac_renumber_frame, METH_VARARGS,
+     PyDoc_STR("renumber_frame(data, variable_blocksize, number) -> bytes")},
+    {"scan_frames", plibflac_scan_frames, METH_VARARGS,
+     PyDoc_STR("scan_frames(data, final, channels, bits_per_sample, "
+               "sample_rate, max_blocksize, max_framesize, max_frames) -> "
+               "(frames, consumed)")},
+    {"shared_cache_clear", plibflac_shared_cache_clear, METH_VARARGS,
+     PyDoc_STR("shared_cache_clear() -> None")},
+    {"shared_cache_configure", plibflac_shared_cache_configure, METH_VARARGS,
+     PyDoc_STR("shared_cache_configure(max_size) -> None")},
+    {"shared_cache_info", plibflac_shared_cache_info, METH_VARARGS,
+     PyDoc_STR("shared_cache_info() -> (hits, misses, size, max_size, "
+               "frames)")},
+    {"transcode", plibflac_transcode, METH_VARARGS,
+     PyDoc_STR("transcode(decoder, encoder) -> int")},
     {NULL, NULL}
 };
 
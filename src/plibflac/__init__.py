@@ -6,5 +6,23 @@ from _plibflac import __version__
 from _plibflac import Error
 from _plibflac import flac_vendor
 from _plibflac import flac_version
+from plibflac._array import FlacArray
+from plibflac._convert import concatenate
+from plibflac._convert import decode_file
+from plibflac._convert import encode_file
+from plibflac._convert import extract
+from plibflac._convert import transcode
 from plibflac._decoder import Decoder
+from plibflac._decoder import clear_shared_cache
+from plibflac._decoder import set_shared_cache_size
+from plibflac._decoder import shared_cache_info
 from plibflac._encoder import Encoder
+from plibflac._encoder import encode_many
+from plibflac._frames import Frame
+from plibflac._frames import FrameReader
+from plibflac._group import GroupDecoder
+from plibflac._group import GroupEncoder
+from plibflac._multifile import MultiFileDecoder
+from plibflac._seektable import add_seektable
+from plibflac._stacked import read_stacked
+from plibflac._verify import verify
@@ -0,0 +1,277 @@
+"""
+Internal functions for accessing FLAC files as arrays.
+"""
+
+import array
+import bisect
+import collections
+import io
+import operator
+import sys
+
+import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+from plibflac._frames import FrameReader
+
+
+class FlacArray:
+    """
+    Read-only two-dimensional array view of a FLAC file.
+
+    A FlacArray object behaves like an array with one row per sample
+    number and one column per channel.  Indexing it decodes only the
+    frames that contain the requested samples, so that small parts of
+    a very large file can be retrieved quickly without decoding the
+    entire file.  Recently decoded frames are kept in memory, up to a
+    limit of `cache_size` bytes.
+
+    When the FlacArray is created, the file is scanned (without
+    decoding any samples) to find the position of every frame.
+
+    Indexing with a single integer returns the samples of all
+    channels at that sample number, as a ``memoryview`` of 32-bit
+    integers.  Indexing with a slice returns a two-dimensional
+    ``memoryview`` (rows by channels).  A second index selects a
+    channel or range of channels; for example, ``sig[1000:2000, 1]``
+    returns samples 1000 to 1999 of channel 1.  Indexing with two
+    integers returns a single sample value.  Empty selections return
+    an empty one-dimensional ``memoryview``.
+
+    If NumPy is installed, ``numpy.asarray(sig)`` decodes the entire
+    file and returns it as an array.
+
+    To ensure resources are cleaned up, call `close` when the array
+    is no longer needed, or use a ``with`` statement.
+
+    Parameters
+    ----------
+    file : path-like object or binary file object
+        Either the name of the input file, or an existing file object
+        (which must be a readable and seekable binary file).
+    cache_size : int, optional
+        Maximum number of bytes of decoded samples to keep in memory.
+
+    Attributes
+    ----------
+    shape : tuple of int
+        The number of samples per channel and the number of channels.
+    dtype : str
+        The type of the elements (always ``'int32'``).
+    ndim : int
+        The number of dimensions (always 2).
+
+    Raises
+    ------
+    plibflac.Error
+        If the input does not contain a valid FLAC stream, or if any
+        frames are missing or damaged.
+    """
+
+    dtype = 'int32'
+    ndim = 2
+
+    def __init__(self, file, *, cache_size=64 << 20):
+        if cache_size < 0:
+            raise ValueError("cache_size must be non-negative")
+
+        if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+            self._fileobj = open(file, 'rb')
+            self._closefile = True
+        else:
+            self._fileobj = file
+            self._closefile = False
+
+        try:
+            self._scan()
+        except BaseException:
+            self.close()
+            raise
+
+        self._cache_size = cache_size
+        self._cache = collections.OrderedDict()
+        self._cached_bytes = 0
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def __len__(self):
+        return self.shape[0]
+
+    def __array__(self, dtype=None, copy=None):
+        import numpy
+        result = numpy.asarray(self[:])
+        if dtype is not None:
+            result = result.astype(dtype, copy=False)
+        return result
+
+    def __getitem__(self, key):
+        if isinstance(key, tuple):
+            if len(key) != 2:
+                raise IndexError("too many indices for FlacArray")
+            rows, cols = key
+        else:
+            rows, cols = key, slice(None)
+
+        length, channels = self.shape
+        if isinstance(rows, slice):
+            rows = range(*rows.indices(length))
+            single_row = False
+        else:
+            row = _check_index(rows, length, "sample number")
+            rows = range(row, row + 1)
+            single_row = True
+        if isinstance(cols, slice):
+            cols = range(*cols.indices(channels))
+            single_col = False
+        else:
+            col = _check_index(cols, channels, "channel")
+            cols = range(col, col + 1)
+            single_col = True
+
+        if not rows or not cols:
+            return memoryview(b'').cast('i')
+
+        # Decode all the samples between the first and last rows, then
+        # select the requested rows and columns.
+        first = min(rows[0], rows[-1])
+        data = self._read(first, max(rows[0], rows[-1]) + 1)
+        if cols == range(channels) and rows.step == 1:
+            result = memoryview(data)
+        else:
+            flat = memoryview(data).cast('i')
+            start = (rows[0] - first) * channels
+            step = rows.step * channels
+            result = array.array('i', bytes(4 * len(rows) * len(cols)))
+            for i, c in enumerate(cols):
+                column = array.array('i')
+                column.frombytes(flat[start + c::step].tobytes())
+                result[i::len(cols)] = column
+            result = memoryview(result).cast('B')
+
+        if single_row and single_col:
+            return result.cast('i')[0]
+        elif single_row or single_col:
+            return result.cast('i')
+        else:
+            return result.cast('i', (len(rows), len(cols)))
+
+    def close(self):
+        """
+        Close the input file and discard cached samples.
+        """
+        self._cache = collections.OrderedDict()
+        self._cached_bytes = 0
+        if self._closefile:
+            self._closefile = False
+            self._fileobj.close()
+
+    def _scan(self):
+        # Find the offset of each frame.
+        stream_start = self._fileobj.tell()
+        blocks, _ = _metadata.read_blocks(self._fileobj)
+        info = _metadata.unpack_streaminfo(blocks[0][2])
+        self._fileobj.seek(stream_start)
+
+        # Metadata for decoding a series of frames in isolation.
+        self._header = _metadata.pack_blocks([(
+            _metadata.STREAMINFO,
+            _metadata.pack_streaminfo(dict(info, md5sum=bytes(16),
+                                           total_samples=0)),
+        )])
+
+        self._starts = array.array('q')
+        self._offsets = array.array('q')
+        self._ends = array.array('q')
+        expected = 0
+        with FrameReader(self._fileobj) as reader:
+            for frame in reader:
+                if frame.sample_number != expected:
+                    raise _plibflac.Error("missing or damaged frame at "
+                                          "sample {}".format(expected))
+                self._starts.append(frame.sample_number)
+                self._offsets.append(frame.offset)
+                self._ends.append(frame.offset + len(frame.data))
+                expected += frame.blocksize
+        self._starts.append(expected)
+        self.shape = (expected, info['channels'])
+
+    def _read(self, start, stop):
+        # Return the samples from `start` to `stop` as interleaved
+        # native 32-bit integers.
+        channels = self.shape[1]
+        first = bisect.bisect_right(self._starts, start) - 1
+        last = bisect.bisect_left(self._starts, stop)
+        parts = []
+        index = first
+        while index < last:
+            data = self._cache.get(index)
+            if data is not None:
+                self._cache.move_to_end(index)
+                frames = [data]
+            else:
+                run_end = index + 1
+                while run_end < last and run_end not in self._cache:
+                    run_end += 1
+                frames = self._decode(index, run_end)
+            for data in frames:
+                frame_start = self._starts[index]
+                lo = max(start - frame_start, 0) * channels * 4
+                hi = (min(stop, self._starts[index + 1]) - frame_start)
+                parts.append(data[lo:hi * channels * 4])
+                index += 1
+        return b''.join(parts)
+
+    def _decode(self, first, last):
+        # Decode frames `first` to `last` (exclusive), and add them to
+        # the cache.  Return the decoded samples of each frame.
+        self._fileobj.seek(self._offsets[first])
+        data = self._fileobj.read(self._ends[last - 1] - self._offsets[first])
+        chunks = [self._header]
+        for index in range(first, last):
+            lo = self._offsets[index] - self._offsets[first]
+            hi = self._ends[index] - self._offsets[first]
+            chunks.append(data[lo:hi])
+
+        with Decoder(io.BytesIO(b''.join(chunks)), frame_cache=0) as decoder:
+            samples = decoder._decoder.read_bytes(
+                4, sys.byteorder == 'big', False, 0)
+
+        frames = []
+        frame_bytes = self.shape[1] * 4
+        pos = 0
+        for index in range(first, last):
+            size = frame_bytes * (self._starts[index + 1]
+                                  - self._starts[index])
+            frame = bytes(samples[pos:pos + size])
+            if len(frame) != size:
+                raise _plibflac.Error("missing or damaged frame at "
+                                      "sample {}".format(self._starts[index]))
+            pos += size
+            frames.append(frame)
+            self._cache_frame(index, frame)
+        return frames
+
+    def _cache_frame(self, index, frame):
+        # Add a frame to the cache, discarding the least recently used
+        # frames if the cache is full.
+        if len(frame) > self._cache_size:
+            return
+        self._cache[index] = frame
+        self._cached_bytes += len(frame)
+        while self._cached_bytes > self._cache_size:
+            _, old = self._cache.popitem(last=False)
+            self._cached_bytes -= len(old)
+
+
+def _check_index(index, length, name):
+    # Convert an integer index to a non-negative value.
+    index = operator.index(index)
+    if index < 0:
+        index += length
+    if not 0 <= index < length:
+        raise IndexError("{} out of range".format(name))
+    return index
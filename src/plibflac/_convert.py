@@ -0,0 +1,759 @@
+"""
+Internal functions for converting between audio formats.
+"""
+
+import contextlib
+import io
+import queue
+import re
+import struct
+import threading
+
+import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+from plibflac._encoder import Encoder
+from plibflac._frames import FrameReader
+
+# Channel masks for WAVE_FORMAT_EXTENSIBLE, corresponding to the
+# default FLAC channel assignments.
+_WAV_CHANNEL_MASKS = {
+    1: 0x4, 2: 0x3, 3: 0x7, 4: 0x33,
+    5: 0x607, 6: 0x60f, 7: 0x70f, 8: 0x63f,
+}
+
+_WAV_FORMAT_PCM = 1
+_WAV_FORMAT_EXTENSIBLE = 0xfffe
+_WAV_SUBFORMAT_PCM = (b'\x01\x00\x00\x00\x00\x00\x10\x00'
+                      b'\x80\x00\x00\xaa\x00\x38\x9b\x71')
+
+
+def transcode(src, dst, *, threads=False, **options):
+    """
+    Decode a FLAC stream and encode it again with different options.
+
+    The samples are passed from the decoder to the encoder without
+    converting them into Python objects, and without holding the
+    global interpreter lock (except when calling the methods of a
+    Python file object.)  If `threads` is true, decoding and encoding
+    are instead done in parallel, by two separate threads.
+
+    Parameters
+    ----------
+    src : path-like object or binary file object
+        The input FLAC file.
+    dst : path-like object or binary file object
+        The output FLAC file.
+    threads : bool, optional
+        True to decode and encode in separate threads.
+    **options
+        Keyword arguments for the `Encoder`.  By default, the stream
+        properties (`channels`, `bits_per_sample`, `sample_rate`, and
+        `total_samples_estimate`) are the same as the input stream.
+
+    Returns
+    -------
+    int
+        The number of samples (per channel) that were encoded.
+
+    Raises
+    ------
+    plibflac.Error
+        If the input stream is invalid, or an error occurred while
+        encoding the output stream.
+    ValueError
+        If the input stream does not match the specified `channels` or
+        `bits_per_sample`.
+    """
+    with Decoder(src) as decoder:
+        decoder.read_metadata()
+        settings = {
+            'channels': decoder.channels,
+            'bits_per_sample': decoder.bits_per_sample,
+            'sample_rate': decoder.sample_rate,
+        }
+        if decoder.total_samples:
+            settings['total_samples_estimate'] = decoder.total_samples
+        settings.update(options)
+        with Encoder(dst, **settings) as encoder:
+            if threads:
+                return _transcode_threaded(decoder, encoder)
+            else:
+                return encoder._transcode_from(decoder)
+
+
+def _transcode_threaded(decoder, encoder, chunk_size=65536):
+    chunks = queue.Queue(4)
+    stop = threading.Event()
+
+    def _read():
+        try:
+            while not stop.is_set():
+                data = decoder.read(chunk_size)
+                chunks.put(data)
+                if data is None:
+                    return
+        except BaseException as exc:
+            chunks.put(exc)
+
+    thread = threading.Thread(target=_read, daemon=True)
+    thread.start()
+    count = 0
+    try:
+        while True:
+            data = chunks.get()
+            if data is None:
+                return count
+            if isinstance(data, BaseException):
+                raise data
+            encoder.write(data)
+            count += len(data[0])
+    finally:
+        stop.set()
+        while thread.is_alive():
+            try:
+                chunks.get(timeout=0.1)
+            except queue.Empty:
+                pass
+        thread.join()
+
+
+def concatenate(inputs, output, *, seekpoint_interval=None, padding=0):
+    """
+    Join FLAC streams end to end without decoding them.
+
+    The compressed frames of each input are copied to the output, and
+    only the frame or sample number in each frame header (and the
+    frame's CRCs) are rewritten.  All inputs must have the same number
+    of channels, bits per sample, and sample rate.
+
+    If every input uses the same fixed block size, and every input
+    except the last contains a whole number of blocks, the output
+    also uses that fixed block size.  Otherwise, the output uses a
+    variable block size, so that the short final frame of each input
+    can be copied as is.  (Since only the last frame of a stream may
+    contain fewer than 16 samples, a final frame that short is
+    decoded and encoded again together with the following frame.)
+
+    The output contains only STREAMINFO, SEEKTABLE, and PADDING
+    metadata blocks.  Its MD5 signature is left unset, since it cannot
+    be computed without decoding the inputs.
+
+    Parameters
+    ----------
+    inputs : iterable of path-like objects or binary file objects
+        The input FLAC files.  A file object must be seekable.
+    output : path-like object or binary file object
+        The output FLAC file.  If it is not seekable, the seek table
+        is omitted and the frame sizes are not recorded in STREAMINFO.
+    seekpoint_interval : int, optional
+        Number of samples between seek points (by default, ten
+        seconds), or zero to omit the seek table.  The seek table is
+        also omitted if the length of an input is unknown.
+    padding : int, optional
+        The size of the padding block, in bytes, or zero to omit the
+        padding block.
+
+    Returns
+    -------
+    int
+        The number of samples (per channel) in the output stream.
+
+    Raises
+    ------
+    plibflac.Error
+        If an input is not a valid FLAC stream, or contains damaged or
+        missing frames.
+    ValueError
+        If the inputs have different numbers of channels, bits per
+        sample, or sample rates.
+    """
+    # Read the STREAMINFO of every input.  Paths are opened again
+    # later, to avoid keeping many files open at once.
+    sources = []
+    infos = []
+    for source in inputs:
+        start = None if _is_path(source) else source.tell()
+        with FrameReader(source) as reader:
+            infos.append(_reader_info(reader))
+        sources.append((source, start))
+    if not infos:
+        raise ValueError("no inputs")
+    for i, info in enumerate(infos):
+        for name in ('channels', 'bits_per_sample', 'sample_rate'):
+            if info[name] != infos[0][name]:
+                raise ValueError(
+                    "{} of input {} ({}) does not match input 0 ({})"
+                    .format(name, i, info[name], infos[0][name]))
+
+    known_length = all(info['total_samples'] for info in infos)
+    blocksize = infos[0]['fixed_blocksize']
+    if not (known_length and blocksize
+            and all(info['fixed_blocksize'] == blocksize
+                    for info in infos)
+            and all(info['total_samples'] % blocksize == 0
+                    for info in infos[:-1])):
+        blocksize = None
+
+    def _frames():
+        for i, (source, start) in enumerate(sources):
+            if start is not None:
+                source.seek(start)
+            with FrameReader(source) as reader:
+                end = yield from _check_frames(reader, i, 0, None)
+            if infos[i]['total_samples'] not in (0, end):
+                raise _plibflac.Error("input {} is truncated".format(i))
+
+    info = dict(infos[0])
+    info['total_samples'] = (sum(info['total_samples'] for info in infos)
+                             if known_length else 0)
+    info['max_blocksize'] = max(info['max_blocksize'] for info in infos)
+    settings = {
+        'channels': info['channels'],
+        'bits_per_sample': info['bits_per_sample'],
+        'sample_rate': info['sample_rate'],
+        'blocksize': info['max_blocksize'],
+    }
+    with _flac_output(output) as fileobj:
+        return _write_frames(fileobj, info, blocksize,
+                             _merge_short_frames(_frames(), settings),
+                             seekpoint_interval, padding)
+
+
+def extract(src, dst, start, stop, *, seekpoint_interval=None, padding=0,
+            **options):
+    """
+    Copy a range of samples from one FLAC stream into a new stream.
+
+    Frames that lie entirely within the range are copied without
+    decoding them, and only their sample numbers (and CRCs) are
+    rewritten.  Only the partial frames at either end of the range
+    are decoded and encoded again, so the cost is nearly independent
+    of how the input was compressed.  Since the edge frames differ in
+    length from the others, the output uses a variable block size.
+    (If the first edge frame would contain fewer than 16 samples, it
+    is encoded together with the following frame.)
+
+    The output contains only STREAMINFO, SEEKTABLE, and PADDING
+    metadata blocks.  Its MD5 signature is left unset.
+
+    Parameters
+    ----------
+    src : path-like object or binary file object
+        The input FLAC file, which must be seekable.
+    dst : path-like object or binary file object
+        The output FLAC file.  If it is not seekable, the seek table
+        is omitted and the frame sizes are not recorded in STREAMINFO.
+    start : int
+        Sample number of the first sample to copy.
+    stop : int
+        Sample number after the last sample to copy.
+    seekpoint_interval : int, optional
+        Number of samples between seek points (by default, ten
+        seconds), or zero to omit the seek table.
+    padding : int, optional
+        The size of the padding block, in bytes, or zero to omit the
+        padding block.
+    **options
+        Keyword arguments for the `Encoder` used to encode the edge
+        frames, such as `compression_level`.
+
+    Returns
+    -------
+    int
+        The number of samples (per channel) in the output stream.
+
+    Raises
+    ------
+    plibflac.Error
+        If the input stream is invalid.
+    ValueError
+        If `start` or `stop` is out of range.
+    """
+    # The input is read in three passes (the first and last frames are
+    # decoded, and the frames in between are copied), which must not
+    # overlap if they share a file object.
+    stream_start = None if _is_path(src) else src.tell()
+
+    def _open(cls):
+        if stream_start is None:
+            return cls(src)
+        src.seek(stream_start)
+        return cls(src)
+
+    with _open(FrameReader) as reader:
+        info = _reader_info(reader)
+    if not 0 <= start <= stop <= info['total_samples']:
+        raise ValueError("invalid sample range [{}, {}) for stream "
+                         "of length {}".format(start, stop,
+                                               info['total_samples']))
+    settings = {
+        'channels': info['channels'],
+        'bits_per_sample': info['bits_per_sample'],
+        'sample_rate': info['sample_rate'],
+        'blocksize': info['max_blocksize'],
+    }
+    settings.update(options)
+    info['total_samples'] = stop - start
+
+    def _encode(decoder, first, last):
+        # Decode and encode the samples from first to last.
+        decoder.seek(first)
+        stream = io.BytesIO()
+        with Encoder(stream, **settings) as encoder:
+            encoder.write(decoder.read(last - first))
+        stream.seek(0)
+        with FrameReader(stream) as edge:
+            return list(edge)
+
+    def _frames():
+        if start == stop:
+            return
+        with _open(Decoder) as decoder:
+            # Find the end of the frame containing `start`.
+            decoder._decoder.track_position = True
+            decoder.seek(start)
+            decoder._decoder.track_position = False
+            head_end = min(decoder._decoder.frame_end_sample, stop)
+            offset = decoder._decoder.frame_end_offset
+            yield from _encode(decoder, start, head_end)
+        if head_end == stop:
+            return
+
+        with _open(FrameReader) as reader:
+            reader._reset(offset)
+            tail_start = yield from _check_frames(reader, 0, head_end, stop)
+        if tail_start < stop:
+            with _open(Decoder) as decoder:
+                yield from _encode(decoder, tail_start, stop)
+
+    with _flac_output(dst) as output:
+        return _write_frames(output, info, None,
+                             _merge_short_frames(_frames(), settings),
+                             seekpoint_interval, padding)
+
+
+def _is_path(file):
+    return isinstance(file, (str, bytes)) or hasattr(file, '__fspath__')
+
+
+@contextlib.contextmanager
+def _flac_output(file):
+    # Yield a binary file object for writing a FLAC stream.
+    if _is_path(file):
+        with open(file, 'wb') as fileobj:
+            yield fileobj
+    else:
+        yield file
+
+
+def _reader_info(reader):
+    # Stream parameters of a FrameReader.
+    return {
+        'channels': reader.channels,
+        'bits_per_sample': reader.bits_per_sample,
+        'sample_rate': reader.sample_rate,
+        'total_samples': reader.total_samples,
+        'max_blocksize': reader._max_blocksize,
+        'fixed_blocksize': reader._fixed_blocksize,
+    }
+
+
+def _check_frames(reader, index, first, stop):
+    # Yield the frames from a FrameReader, starting at sample number
+    # `first` and ending before the first frame that extends past
+    # `stop`.  Return the sample number following the last frame.
+    expected = first
+    for frame in reader:
+        if frame.sample_number != expected:
+            raise _plibflac.Error("missing or damaged frame in input {} "
+                                  "at sample {}".format(index, expected))
+        if stop is not None and expected + frame.blocksize > stop:
+            break
+        yield frame
+        expected += frame.blocksize
+    return expected
+
+
+def _merge_short_frames(frames, settings):
+    # Yield the given frames, except that a frame shorter than
+    # MIN_BLOCKSIZE (which is only allowed at the end of a stream) is
+    # decoded and encoded again, together with the frames that follow
+    # it.  `settings` are the Encoder options; settings['blocksize']
+    # is the maximum block size.
+    pending = []
+    pending_samples = 0
+    for frame in frames:
+        if pending or frame.blocksize < _metadata.MIN_BLOCKSIZE:
+            pending.append(frame)
+            pending_samples += frame.blocksize
+            if pending_samples >= _metadata.MIN_BLOCKSIZE:
+                yield from _reencode_frames(pending, settings)
+                pending = []
+                pending_samples = 0
+        else:
+            yield frame
+    if len(pending) > 1:
+        yield from _reencode_frames(pending, settings)
+    else:
+        yield from pending
+
+
+def _reencode_frames(frames, settings):
+    # Decode a sequence of frames, and encode their samples again as
+    # frames of nearly equal size, no longer than settings['blocksize'].
+    info = {
+        'min_blocksize': _metadata.MIN_BLOCKSIZE,
+        'max_blocksize': 65535,
+        'min_framesize': 0,
+        'max_framesize': 0,
+        'sample_rate': settings['sample_rate'],
+        'channels': settings['channels'],
+        'bits_per_sample': settings['bits_per_sample'],
+        'total_samples': 0,
+        'md5sum': bytes(16),
+    }
+    parts = [_metadata.pack_blocks([(_metadata.STREAMINFO,
+                                     _metadata.pack_streaminfo(info))])]
+    length = 0
+    for frame in frames:
+        parts.append(_plibflac.renumber_frame(frame.data, True, length))
+        length += frame.blocksize
+    with Decoder(io.BytesIO(b''.join(parts))) as decoder:
+        samples = decoder.read(length)
+
+    n_frames = -(-length // settings['blocksize'])
+    blocksize = max(-(-length // n_frames), _metadata.MIN_BLOCKSIZE)
+    stream = io.BytesIO()
+    with Encoder(stream, **dict(settings, blocksize=blocksize)) as encoder:
+        encoder.write(samples)
+    stream.seek(0)
+    with FrameReader(stream) as reader:
+        return list(reader)
+
+
+def _write_frames(fileobj, info, blocksize, frames, seekpoint_interval,
+                  padding):
+    # Write a FLAC stream consisting of the given frames, renumbering
+    # them as needed.  If `blocksize` is None, the output uses a
+    # variable block size.  info['total_samples'] is the expected
+    # length of the stream, or zero if unknown.  Return the number of
+    # samples written.
+    variable_blocksize = blocksize is None
+    stream_start = fileobj.tell() if fileobj.seekable() else None
+    if seekpoint_interval is None:
+        seekpoint_interval = info['sample_rate'] * 10
+    if (seekpoint_interval and info['total_samples']
+            and stream_start is not None):
+        n_points = -(-info['total_samples'] // seekpoint_interval)
+    else:
+        n_points = 0
+
+    out_info = {
+        'min_blocksize': blocksize or 16,
+        'max_blocksize': blocksize or info['max_blocksize'],
+        'min_framesize': 0,
+        'max_framesize': 0,
+        'sample_rate': info['sample_rate'],
+        'channels': info['channels'],
+        'bits_per_sample': info['bits_per_sample'],
+        'total_samples': info['total_samples'],
+        'md5sum': bytes(16),
+    }
+    points = [(_metadata.SEEKPOINT_PLACEHOLDER, 0, 0)] * n_points
+
+    def _header():
+        blocks = [(_metadata.STREAMINFO,
+                   _metadata.pack_streaminfo(out_info))]
+        if n_points:
+            blocks.append((_metadata.SEEKTABLE,
+                           _metadata.pack_seektable(points)))
+        if padding:
+            blocks.append((_metadata.PADDING, bytes(padding)))
+        return _metadata.pack_blocks(blocks)
+
+    fileobj.write(_header())
+
+    sample_number = 0
+    offset = 0
+    frame_sizes = []
+    block_sizes = []
+    points = []
+    for frame in frames:
+        # Frames are renumbered unless their original numbers are
+        # already correct.
+        data = frame.data
+        if variable_blocksize:
+            number = sample_number
+            old_number = frame.sample_number
+        else:
+            number = sample_number // blocksize
+            old_number = frame.sample_number // blocksize
+        if (data[1] & 1) != variable_blocksize or number != old_number:
+            data = _plibflac.renumber_frame(data, variable_blocksize,
+                                            number)
+        fileobj.write(data)
+
+        # Add a seek point if this frame contains a multiple of
+        # seekpoint_interval.
+        end_number = sample_number + frame.blocksize
+        if n_points and (-(-sample_number // seekpoint_interval)
+                         < -(-end_number // seekpoint_interval)):
+            points.append((sample_number, offset, frame.blocksize))
+        frame_sizes.append(len(data))
+        block_sizes.append(frame.blocksize)
+        sample_number = end_number
+        offset += len(data)
+
+    if stream_start is not None:
+        end = fileobj.tell()
+        if frame_sizes:
+            out_info['min_framesize'] = min(frame_sizes)
+            out_info['max_framesize'] = max(frame_sizes)
+        if variable_blocksize and block_sizes:
+            out_info['min_blocksize'] = min(block_sizes[:-1]
+                                            or block_sizes)
+            out_info['max_blocksize'] = max(block_sizes)
+        out_info['total_samples'] = sample_number
+        points = points[:n_points]
+        points += ([(_metadata.SEEKPOINT_PLACEHOLDER, 0, 0)]
+                   * (n_points - len(points)))
+        fileobj.seek(stream_start)
+        fileobj.write(_header())
+        fileobj.seek(end)
+    return sample_number
+
+
+def encode_file(raw_file, flac_file, layout, **options):
+    """
+    Encode a raw PCM or WAV file as FLAC.
+
+    Samples are read from the input file and passed to the encoder
+    without converting them into Python objects, and without holding
+    the global interpreter lock.
+
+    Parameters
+    ----------
+    raw_file : path-like object or binary file object
+        The input file.  A file object must have a file descriptor,
+        and must be either unbuffered or seekable.
+    flac_file : path-like object or binary file object
+        The output FLAC file.
+    layout : str
+        Format of the input file.  This may be 'wav', or a string such
+        as 'i2', '<i2', or '>u1' describing raw interleaved samples:
+        '<' (the default) for little-endian or '>' for big-endian,
+        followed by 'i' for signed or 'u' for unsigned, followed by
+        the number of bytes per sample (1 to 4).
+    **options
+        Keyword arguments for the `Encoder`.  For WAV input, the
+        stream properties (`channels`, `bits_per_sample`,
+        `sample_rate`, and `total_samples_estimate`) are taken from
+        the WAV header.  For raw input, `bits_per_sample` defaults to
+        the size of the input samples.
+
+    Returns
+    -------
+    int
+        The number of samples (per channel) that were encoded.
+
+    Raises
+    ------
+    plibflac.Error
+        If an error occurred while encoding the output stream.
+    ValueError
+        If `layout` or the WAV header is invalid or unsupported, or
+        if the input ends with an incomplete sample.
+    OSError
+        If the input file cannot be read.
+    """
+    if 'autotune_speed' in options or 'queue_size' in options:
+        raise ValueError("autotune_speed and queue_size are not supported "
+                         "by encode_file")
+    with _raw_file(raw_file, 'rb') as raw:
+        if layout == 'wav':
+            sample_format, limit, settings = _read_wav_header(raw)
+        else:
+            sample_format = _parse_layout(layout)
+            limit = -1
+            settings = {'bits_per_sample': sample_format[0] * 8}
+        settings.update(options)
+        with Encoder(flac_file, **settings) as encoder:
+            return encoder._encode_raw(raw.fileno(), sample_format, limit)
+
+
+def decode_file(flac_file, raw_file, layout):
+    """
+    Decode a FLAC file to raw PCM or WAV.
+
+    Samples are passed from the decoder to the output file without
+    converting them into Python objects, and without holding the
+    global interpreter lock.
+
+    Parameters
+    ----------
+    flac_file : path-like object or binary file object
+        The input FLAC file.
+    raw_file : path-like object or binary file object
+        The output file.  A file object must have a file descriptor.
+    layout : str
+        Format of the output file; see `encode_file`.  For 'wav', the
+        sample size is the smallest that can hold the input samples.
+
+    Returns
+    -------
+    int
+        The number of samples (per channel) that were decoded.
+
+    Raises
+    ------
+    plibflac.Error
+        If the input stream is invalid.
+    ValueError
+        If `layout` is invalid, or the input samples do not fit in the
+        specified sample size.
+    OSError
+        If the output file cannot be written.
+    """
+    if layout != 'wav':
+        sample_format = _parse_layout(layout)
+    with Decoder(flac_file) as decoder, _raw_file(raw_file, 'wb') as raw:
+        if layout == 'wav':
+            size = (decoder.bits_per_sample + 7) // 8
+            sample_format = (size, False, size == 1,
+                             size * 8 - decoder.bits_per_sample)
+            start = raw.tell() if raw.seekable() else None
+            _write_wav_header(raw, decoder.channels, decoder.sample_rate,
+                              decoder.bits_per_sample, sample_format,
+                              decoder.total_samples)
+        n = decoder._decoder.read_raw(raw.fileno(), *sample_format)
+        if layout == 'wav' and n * size * decoder.channels % 2:
+            raw.write(b'\0')
+        if layout == 'wav' and start is not None:
+            end = raw.tell()
+            raw.seek(start)
+            _write_wav_header(raw, decoder.channels, decoder.sample_rate,
+                              decoder.bits_per_sample, sample_format, n)
+            raw.seek(end)
+        return n
+
+
+def _parse_layout(layout):
+    # Convert a layout string to (size, big_endian, is_unsigned, shift).
+    match = re.fullmatch(r'([<>]?)([iu])([1-4])', layout)
+    if not match:
+        raise ValueError("invalid layout {!r}".format(layout))
+    return (int(match.group(3)), match.group(1) == '>',
+            match.group(2) == 'u', 0)
+
+
+@contextlib.contextmanager
+def _raw_file(file, mode):
+    # Yield an unbuffered io.FileIO object, whose position is the
+    # current logical position of `file`.  On exit, the position of
+    # `file` is updated to match.
+    if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+        with open(file, mode, buffering=0) as raw:
+            yield raw
+        return
+
+    if isinstance(file, io.FileIO):
+        yield file
+        return
+
+    raw = getattr(file, 'raw', None)
+    if not isinstance(raw, io.FileIO):
+        raise TypeError("file must be a filesystem path or a file object "
+                        "with a file descriptor, not {!r}".format(type(file)))
+    if file.writable():
+        file.flush()
+    if file.seekable():
+        raw.seek(file.tell())
+    elif file.readable():
+        raise ValueError("buffered input file must be seekable")
+    try:
+        yield raw
+    finally:
+        if file.seekable():
+            file.seek(raw.tell())
+
+
+def _read_exact(raw, size):
+    data = b''
+    while len(data) < size:
+        chunk = raw.read(size - len(data))
+        if not chunk:
+            raise ValueError("unexpected end of WAV header")
+        data += chunk
+    return data
+
+
+def _read_wav_header(raw):
+    # Parse a WAV header, leaving the file positioned at the start of
+    # the sample data.  Return the sample format, the size of the
+    # sample data, and the corresponding Encoder settings.
+    riff, _, wave = struct.unpack('<4sI4s', _read_exact(raw, 12))
+    if riff != b'RIFF' or wave != b'WAVE':
+        raise ValueError("not a WAV file")
+    fmt = None
+    while True:
+        chunk_id, chunk_size = struct.unpack('<4sI', _read_exact(raw, 8))
+        if chunk_id == b'data':
+            break
+        data = _read_exact(raw, chunk_size + (chunk_size & 1))
+        if chunk_id == b'fmt ':
+            fmt = data[:chunk_size]
+    if fmt is None or len(fmt) < 16:
+        raise ValueError("WAV format chunk is missing")
+
+    (tag, channels, sample_rate, _, block_align,
+     container_bits) = struct.unpack('<HHIIHH', fmt[:16])
+    valid_bits = container_bits
+    if tag == _WAV_FORMAT_EXTENSIBLE and len(fmt) >= 40:
+        valid_bits, _, subformat = struct.unpack('<HI16s', fmt[18:40])
+        if subformat == _WAV_SUBFORMAT_PCM:
+            tag = _WAV_FORMAT_PCM
+    size = (container_bits + 7) // 8
+    if (tag != _WAV_FORMAT_PCM or not 1 <= size <= 4
+            or channels < 1 or block_align != size * channels
+            or not 0 < valid_bits <= size * 8):
+        raise ValueError("unsupported WAV format")
+
+    sample_format = (size, False, size == 1, size * 8 - valid_bits)
+    settings = {
+        'channels': channels,
+        'bits_per_sample': valid_bits,
+        'sample_rate': sample_rate,
+    }
+    if chunk_size == 0xffffffff:
+        limit = -1
+    else:
+        limit = chunk_size
+        settings['total_samples_estimate'] = chunk_size // block_align
+    return sample_format, limit, settings
+
+
+def _write_wav_header(raw, channels, sample_rate, bits_per_sample,
+                      sample_format, total_samples):
+    size, _, _, shift = sample_format
+    block_align = size * channels
+    data_size = total_samples * block_align
+    if channels > 2 or size > 2 or shift != 0:
+        fmt = struct.pack('<HHIIHHHHI16s', _WAV_FORMAT_EXTENSIBLE,
+                          channels, sample_rate, sample_rate * block_align,
+                          block_align, size * 8, 22, bits_per_sample,
+                          _WAV_CHANNEL_MASKS.get(channels, 0),
+                          _WAV_SUBFORMAT_PCM)
+    else:
+        fmt = struct.pack('<HHIIHH', _WAV_FORMAT_PCM, channels,
+                          sample_rate, sample_rate * block_align,
+                          block_align, size * 8)
+    # An odd-sized data chunk is followed by a pad byte
+    riff_size = 4 + 8 + len(fmt) + 8 + data_size + (data_size & 1)
+    if riff_size > 0xffffffff:
+        riff_size = data_size = 0xffffffff
+    header = (struct.pack('<4sI4s4sI', b'RIFF', riff_size, b'WAVE',
+                          b'fmt ', len(fmt))
+              + fmt + struct.pack('<4sI', b'data', data_size))
+    while header:
+        header = header[raw.write(header):]
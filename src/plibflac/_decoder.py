@@ -2,10 +2,13 @@
 Internal functions for reading FLAC streams.
 """
 
+import array
 import io
 import logging
+import os
 
 import _plibflac
+from plibflac import _metadata
 
 _LOGGER = logging.getLogger(__name__)
 
@@ -42,6 +45,24 @@ class Decoder:
         exception if the file appears to have been corrupted or
         truncated.  Most applications should leave this set to False
         for better performance.
+    collect_stats : bool, optional
+        True to compute statistics of the decoded samples.
+    histogram_bits : int, optional
+        If nonzero, compute a histogram of the decoded samples, with
+        ``2**histogram_bits`` bins (between 1 and 16 bits).
+    frame_cache : int, optional
+        Number of recently decoded frames to keep in memory, so that
+        seeking back to them does not require decoding them again.
+        Zero disables the cache.
+    follow : float, optional
+        If specified, treat the end of the file as the end of the data
+        written so far, rather than the end of the stream, and wait up
+        to this many seconds for more data to be written.  See
+        `read`.
+    nonblocking : bool, optional
+        True if the input may be a non-blocking pipe or socket.  If
+        no more input is available, `read` raises `BlockingIOError`,
+        and decoding can be resumed later.
 
     Attributes
     ----------
@@ -77,11 +98,45 @@ class Decoder:
     The `channels`, `bits_per_sample`, `sample_rate`, and
     `total_samples` attributes will all be zero until you call `seek`,
     `read`, or `read_metadata` for the first time.
+
+    If `follow` is specified, the decoder can read a file that is
+    still being written by another process.  When the end of the file
+    is reached, `read` returns the samples that have been decoded so
+    far; if there are none, it checks periodically for new data, and
+    returns None if no complete frame is written within `follow`
+    seconds (use ``math.inf`` to wait indefinitely.)  Later calls to
+    `read` continue where the previous call left off, and `skip`
+    works in the same way.  If the metadata is not written within
+    `follow` seconds, `read_metadata` raises `BlockingIOError`.  The
+    input must be a seekable file (not a pipe or an in-memory stream),
+    and the frame cache is not used.
+
+    If `nonblocking` is true, the input can be a non-blocking stream,
+    such as a pipe or socket whose file descriptor is in non-blocking
+    mode, or a file object whose ``readinto`` method returns None when
+    no data is available.  Input that has been received, but does not
+    yet form a complete frame, is kept by the decoder.  When no
+    complete frame is available, `read` and `skip` return the samples
+    decoded so far, or raise `BlockingIOError` if there are none;
+    `read_metadata` raises `BlockingIOError` if the metadata is
+    incomplete.  The same method can be called again when more input
+    is available (for example, as reported by the ``selectors``
+    module), and decoding continues where it left off.  In this mode,
+    the input is treated as unseekable, and the frame cache is not
+    used.
     """
 
-    def __init__(self, file, *, errors='strict', md5_checking=False):
+    def __init__(self, file, *, errors='strict', md5_checking=False,
+                 collect_stats=False, histogram_bits=0, frame_cache=4,
+                 follow=None, nonblocking=False):
         if errors not in ('strict', 'warn', 'ignore'):
             raise ValueError("errors must be 'strict', 'warn', or 'ignore'")
+        if not 0 <= histogram_bits <= 16:
+            raise ValueError("histogram_bits must be between 0 and 16")
+        if frame_cache < 0:
+            raise ValueError("frame_cache must be non-negative")
+        if follow is not None and not follow >= 0:
+            raise ValueError("follow must be non-negative")
 
         if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
             self._fileobj = open(file, 'rb')
@@ -91,6 +146,11 @@ class Decoder:
             self._closefile = False
 
         self._opened = False
+        self._seeked = False
+        self._errors = errors
+        self._follow = follow
+        self._nonblocking = nonblocking
+        self._shared_fd = None
 
         if not (hasattr(self._fileobj, 'readinto') and
                 hasattr(self._fileobj, 'readable') and
@@ -108,6 +168,12 @@ class Decoder:
             elif errors == 'warn':
                 self._decoder.error_callback = _log_stream_error
             self.md5_checking = md5_checking
+            self.collect_stats = collect_stats
+            self.histogram_bits = histogram_bits
+            self.frame_cache = frame_cache
+            if follow is not None:
+                self._decoder.follow_timeout = follow
+            self._decoder.resumable = nonblocking
         except BaseException:
             if self._closefile:
                 self._fileobj.close()
@@ -115,7 +181,11 @@ class Decoder:
 
     def __enter__(self):
         self.open()
-        self.read_metadata()
+        try:
+            self.read_metadata()
+        except BlockingIOError:
+            if not self._nonblocking and self._follow is None:
+                raise
         return self
 
     def __exit__(self, exc_type, exc_val, exc_tb):
@@ -129,8 +199,21 @@ class Decoder:
         applications have no need to call this method.  If the decoder
         has already been opened, this method does nothing.
         """
-        if not self._opened:
+        if not self._opened and self._shared_fd is not None:
             self._original_raw_pos = None
+            self._decoder.open(*self._shared_fd)
+            self._opened = True
+            self._stream_fd = self._shared_fd
+        elif not self._opened:
+            self._original_raw_pos = None
+            file_id = None
+            # Save the starting position before touching the raw
+            # stream, since a buffered stream's position is computed
+            # from the raw stream's position.
+            try:
+                start = self._fileobj.tell()
+            except OSError:
+                start = None
             try:
                 if isinstance(self._fileobj, io.FileIO):
                     fd = self._fileobj.fileno()
@@ -144,13 +227,63 @@ class Decoder:
                     # position.  Save the original raw stream position
                     # for later use.
                     self._original_raw_pos = self._fileobj.raw.tell()
-                    self._fileobj.raw.seek(self._fileobj.tell())
+                    self._fileobj.raw.seek(start)
                 else:
                     fd = -1
+                if (fd >= 0 and start is not None
+                        and _plibflac.shared_cache_info()[3] > 0):
+                    st = os.fstat(fd)
+                    file_id = (st.st_dev, st.st_ino, st.st_mtime_ns,
+                               st.st_size, start)
             except OSError:
                 fd = -1
-            self._decoder.open(fd)
+                file_id = None
+            self._decoder.open(fd, file_id)
             self._opened = True
+            self._stream_fd = None
+            try:
+                if (fd >= 0 and start is not None
+                        and self._fileobj.seekable()):
+                    self._stream_fd = (fd, file_id, start)
+            except OSError:
+                pass
+            if self._follow is not None and self._stream_fd is None:
+                raise ValueError("follow requires a seekable file")
+
+    def clone(self):
+        """
+        Create a new decoder that reads the same input file.
+
+        The new decoder has its own input position, starting at the
+        beginning of the stream, and can be used at the same time as
+        this decoder (for example, by another thread.)  It shares the
+        underlying file descriptor, rather than opening the file
+        again; each decoder reads the file at its own offset, without
+        changing the file position.  It also shares this decoder's
+        `errors` mode and `frame_cache` setting.
+
+        The new decoder does not close the input file.  It must be
+        closed before this decoder is closed.
+
+        Returns
+        -------
+        Decoder
+            The new decoder.
+
+        Raises
+        ------
+        ValueError
+            If the input is not a seekable file (such as a pipe or an
+            in-memory stream.)
+        """
+        self.open()
+        if self._stream_fd is None:
+            raise ValueError("cannot clone a decoder that is not reading "
+                             "a seekable file")
+        decoder = Decoder(self._fileobj, errors=self._errors,
+                          frame_cache=self.frame_cache, follow=self._follow)
+        decoder._shared_fd = self._stream_fd
+        return decoder
 
     def close(self):
         """
@@ -206,6 +339,10 @@ class Decoder:
         ------
         plibflac.Error
             If the input does not contain a valid FLAC stream.
+        BlockingIOError
+            If `nonblocking` is true, and the metadata has not been
+            completely received, or if `follow` is specified, and the
+            metadata is not written in time.
         """
         self.open()
         self._decoder.read_metadata()
@@ -224,6 +361,9 @@ class Decoder:
         of these is a one-dimensional array whose length is
         `n_samples` (or less, if the end of the file is reached.)
 
+        If `follow` was specified, this may return fewer samples, or
+        None, before the end of the stream; see `Decoder`.
+
         Parameters
         ----------
         n_samples : int
@@ -238,10 +378,105 @@ class Decoder:
         ------
         plibflac.Error
             If the input stream is invalid and cannot be decoded.
+        BlockingIOError
+            If `nonblocking` is true, and no samples are available
+            yet.
         """
         self.open()
         return self._decoder.read(n_samples)
 
+    def skip(self, n_samples):
+        """
+        Decode and discard up to `n_samples` samples of each channel.
+
+        This is equivalent to calling `read` and ignoring the result,
+        except that the decoded samples are not copied or converted
+        into Python objects.  If `collect_stats` is true, the skipped
+        samples are included in `stats`; this is the fastest way to
+        compute statistics for an entire stream.
+
+        Parameters
+        ----------
+        n_samples : int
+            Maximum number of samples to skip for each channel.
+
+        Returns
+        -------
+        int
+            Number of samples that were skipped (less than
+            `n_samples` if the end of the file is reached, or if
+            `follow` was specified and no more data is available.)
+
+        Raises
+        ------
+        plibflac.Error
+            If the input stream is invalid and cannot be decoded.
+        BlockingIOError
+            If `nonblocking` is true, and no samples are available
+            yet.
+        """
+        self.open()
+        return self._decoder.skip(n_samples)
+
+    @property
+    def stats(self):
+        """
+        Statistics of the decoded samples.
+
+        If `collect_stats` was set to True before opening the stream,
+        this is a dictionary containing the following items, which
+        cover every sample returned by `read` or discarded by `skip`
+        (or otherwise decoded, for example by `plibflac.transcode` or
+        `plibflac.decode_file`):
+
+        ``samples``
+            Number of samples (per channel).
+        ``min``
+            List of the minimum sample value of each channel.
+        ``max``
+            List of the maximum sample value of each channel.
+        ``sum``
+            List of the sum of the sample values of each channel.
+        ``sum_squares``
+            List of the sum of the squares of the sample values of
+            each channel.
+        ``histogram``
+            List of histograms for each channel, or None if
+            `histogram_bits` is zero.  Each histogram is a
+            ``memoryview`` of unsigned 64-bit integers; bin ``i``
+            counts the samples whose value, divided by
+            ``2**(bits_per_sample - histogram_bits)`` and rounded
+            down, equals ``i - 2**(histogram_bits - 1)``.
+
+        Sums are computed exactly.  If no samples have been decoded,
+        the lists are empty.  If `collect_stats` is false, this is
+        None.
+        """
+        if not self.collect_stats:
+            return None
+        self.open()
+        count, channels = self._decoder.stats()
+        result = {
+            'samples': count,
+            'min': [],
+            'max': [],
+            'sum': [],
+            'sum_squares': [],
+            'histogram': [] if self.histogram_bits else None,
+        }
+        for (low, high, sum_lo, sum_hi, sq_lo, sq_hi,
+             histogram) in channels:
+            total = (sum_hi << 64) | sum_lo
+            if total >= 1 << 127:
+                total -= 1 << 128
+            result['min'].append(low)
+            result['max'].append(high)
+            result['sum'].append(total)
+            result['sum_squares'].append((sq_hi << 64) | sq_lo)
+            if result['histogram'] is not None:
+                result['histogram'].append(histogram)
+        return result
+
     def seek(self, sample_number):
         """
         Jump to a given sample number.
@@ -267,8 +502,174 @@ class Decoder:
         unspecified.
         """
         self.open()
+        self._seeked = True
         self._decoder.seek(sample_number)
 
+    def verify(self):
+        """
+        Check the integrity of the remainder of the stream.
+
+        This decodes the rest of the stream without returning any
+        samples, checks the CRC of every frame, and checks the MD5
+        signature of the stream if possible.  Errors in the stream are
+        reported in the result rather than raising an exception
+        (regardless of the `errors` setting.)  Afterwards, the decoder
+        is closed.
+
+        The MD5 signature can only be checked if `md5_checking` is
+        True (which is the default if `verify` is called before the
+        decoder is opened), the stream has been decoded from the
+        beginning without calling `seek`, and the stream metadata
+        includes an MD5 signature.
+
+        Returns
+        -------
+        dict
+            A dictionary containing the following items:
+
+            ``samples``
+                Number of samples (per channel) that were decoded.
+            ``errors``
+                List of ``(offset, sample_number, message)`` tuples
+                for each error.  `offset` is the byte offset in the
+                file, and `sample_number` is the sample number, of the
+                end of the last valid frame before the error.
+            ``md5``
+                True if the MD5 signature matches, False if it does
+                not, or None if it was not checked.
+            ``ok``
+                True if there were no errors and the MD5 signature
+                did not fail.
+
+        Raises
+        ------
+        plibflac.Error
+            If the input does not contain a valid FLAC stream.
+        """
+        if not self._opened:
+            self.md5_checking = True
+        self.read_metadata()
+        start = self._decoder.frame_end_sample
+        check_md5 = (self.md5_checking and not self._seeked
+                     and self._decoder.md5sum != bytes(16))
+        samples, errors, _ = self._check(None)
+
+        total_samples = self.total_samples
+        if (total_samples and not self._seeked
+                and start + samples != total_samples):
+            errors.append((self._decoder.frame_end_offset,
+                           self._decoder.frame_end_sample,
+                           "expected {} samples".format(total_samples)))
+        try:
+            self.close()
+            md5 = True if check_md5 else None
+        except _plibflac.Error:
+            md5 = False
+        return {
+            'samples': samples,
+            'errors': errors,
+            'md5': md5,
+            'ok': not errors and md5 is not False,
+        }
+
+    def _check(self, sample_format):
+        # Decode the remainder of the stream, recording the position
+        # of each error.  If sample_format is given, return the
+        # decoded samples as bytes in that format.
+        errors = []
+
+        def _record(message):
+            errors.append((self._decoder.frame_end_offset,
+                           self._decoder.frame_end_sample, message))
+
+        error_callback = getattr(self._decoder, 'error_callback', None)
+        self._decoder.error_callback = _record
+        self._decoder.track_position = True
+        samples = 0
+        data = None
+        try:
+            if sample_format is not None:
+                data = self._decoder.read_bytes(*sample_format)
+                samples = len(data) // (sample_format[0] * self.channels)
+            else:
+                n = self._decoder.skip(1 << 30)
+                while n:
+                    samples += n
+                    n = self._decoder.skip(1 << 30)
+        except _plibflac.Error as exc:
+            _record(str(exc))
+        finally:
+            self._decoder.error_callback = error_callback
+            self._decoder.track_position = False
+        return samples, errors, data
+
+    def envelope(self, start, stop, resolution):
+        """
+        Retrieve the minimum and maximum sample values over time.
+
+        If the stream contains an envelope (see
+        `Encoder.envelope_interval`), this returns the minimum and
+        maximum of each channel for each interval of `resolution`
+        samples between `start` and `stop`, without decoding any
+        audio data.  The envelope is stored at a limited number of
+        resolutions, so each interval may include some samples
+        outside of it.
+
+        Parameters
+        ----------
+        start : int
+            Starting sample number.
+        stop : int
+            Ending sample number (exclusive).  This is limited to the
+            length of the stream.
+        resolution : int
+            Number of samples per output interval.
+
+        Returns
+        -------
+        tuple of (array, array) pairs, or None
+            The minimum and maximum arrays for each channel, or None
+            if the stream does not contain an envelope.
+
+        Raises
+        ------
+        plibflac.Error
+            If the input does not contain a valid FLAC stream.
+        ValueError
+            If `resolution` is not positive.
+        """
+        if resolution < 1:
+            raise ValueError("resolution must be positive")
+        self.read_metadata()
+        data = self._decoder.applications.get(_metadata.ENVELOPE_ID)
+        info = data and _metadata.unpack_envelope(data)
+        if not info:
+            return None
+
+        channels = info['channels']
+        stop = min(stop, info['total_samples'])
+        start = max(start, 0)
+        levels = info['levels']
+        size = info['interval']
+        level = 0
+        while (level + 1 < len(levels)
+               and size * info['factor'] <= resolution):
+            level += 1
+            size *= info['factor']
+        values = levels[level]
+        stride = 2 * channels
+
+        result = tuple((array.array('i'), array.array('i'))
+                       for _ in range(channels))
+        for lo in range(start, stop, resolution):
+            hi = min(lo + resolution, stop)
+            first = lo // size * stride
+            last = -(-hi // size) * stride
+            for c, (mins, maxs) in enumerate(result):
+                mins.append(min(values[first + 2 * c:last:stride]))
+                maxs.append(max(values[first + 2 * c + 1:last:stride]))
+        return result
+
     def _prop(name, doc=None):
         def _fget(self):
             return getattr(self._decoder, name)
@@ -324,6 +725,40 @@ class Decoder:
         `read_metadata` for the first time.
         """
     )
+    collect_stats = _prop(
+        'collect_stats',
+        """
+        True to compute statistics of the decoded samples.
+
+        The results can be retrieved using `stats`.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    histogram_bits = _prop(
+        'histogram_bits',
+        """
+        Number of bits of each sample used for histograms.
+
+        If this is nonzero (and `collect_stats` is true), `stats`
+        includes a histogram of each channel with
+        ``2**histogram_bits`` bins (or ``2**bits_per_sample`` bins,
+        if that is smaller.)  The maximum is 16.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    frame_cache = _prop(
+        'frame_cache',
+        """
+        Number of recently decoded frames to keep in memory.
+
+        When `seek` moves to a sample in one of these frames, the
+        samples are copied from memory rather than decoded again.
+        Changing this attribute discards the frames that are currently
+        cached.
+        """
+    )
     md5_checking = _prop(
         'md5_checking',
         """
@@ -339,3 +774,65 @@ class Decoder:
         This attribute must be set before opening the stream.
         """
     )
+
+
+def set_shared_cache_size(size):
+    """
+    Set the size of the shared cache of decoded frames.
+
+    The shared cache holds recently decoded frames, and is used by
+    every `Decoder` in the process.  When a Decoder reads a file that
+    another Decoder has read recently, the cached samples are copied
+    rather than decoded again.  By default, the shared cache is
+    disabled.
+
+    Only Decoders reading from a file on disk (opened after the cache
+    is enabled) use the cache.  Files are identified by their device,
+    inode, modification time, and size.  The cache is not used while
+    `Decoder.md5_checking` is true.
+
+    Parameters
+    ----------
+    size : int
+        Maximum total size of the cached frames, in bytes.  If this is
+        zero, the cache is disabled and all cached frames are
+        discarded.
+    """
+    _plibflac.shared_cache_configure(size)
+
+
+def shared_cache_info():
+    """
+    Retrieve statistics about the shared cache of decoded frames.
+
+    Returns
+    -------
+    dict
+        A dictionary containing the following items:
+
+        ``hits``
+            Number of frames that were found in the cache.
+        ``misses``
+            Number of frames that were not found in the cache.
+        ``size``
+            Current total size of the cached frames, in bytes.
+        ``max_size``
+            Maximum total size (see `set_shared_cache_size`).
+        ``frames``
+            Number of cached frames.
+    """
+    hits, misses, size, max_size, frames = _plibflac.shared_cache_info()
+    return {
+        'hits': hits,
+        'misses': misses,
+        'size': size,
+        'max_size': max_size,
+        'frames': frames,
+    }
+
+
+def clear_shared_cache():
+    """
+    Discard all frames in the shared cache and reset its statistics.
+    """
+    _plibflac.shared_cache_clear()
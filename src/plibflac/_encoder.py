@@ -2,7 +2,131 @@
 Internal functions for writing FLAC streams.
 """
 
+import array
+import bisect
+import concurrent.futures
+import io
+import os
+import queue
+import struct
+import tempfile
+import threading
+import time
+
 import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+
+# Candidate settings for auto-tuning, ranging from the fastest to the
+# strongest of the standard compression levels.
+_AUTOTUNE_NAMES = (
+    'blocksize', 'max_lpc_order', 'apodization', 'do_mid_side_stereo',
+    'min_residual_partition_order', 'max_residual_partition_order',
+)
+_AUTOTUNE_CANDIDATES = (
+    (1152, 0, 'tukey(5e-1)', False, 0, 3),
+    (1152, 0, 'tukey(5e-1)', True, 0, 3),
+    (4096, 6, 'tukey(5e-1)', False, 0, 4),
+    (2048, 8, 'tukey(5e-1)', True, 0, 5),
+    (4096, 8, 'tukey(5e-1)', True, 0, 5),
+    (4608, 8, 'tukey(5e-1);partial_tukey(2)', True, 0, 6),
+    (4096, 12, 'tukey(5e-1);partial_tukey(2)', True, 0, 6),
+    (4096, 12, 'tukey(5e-1);partial_tukey(2);punchout_tukey(3)', True, 0, 6),
+)
+
+# Settings that are copied from the main encoder when auto-tuning.
+_AUTOTUNE_COPY = (
+    'channels', 'bits_per_sample', 'sample_rate', 'compression_level',
+    'streamable_subset', 'loose_mid_side_stereo', 'qlp_coeff_precision',
+    'do_qlp_coeff_prec_search', 'do_exhaustive_model_search',
+)
+
+# Settings that are copied when a low-latency stream is flushed.
+# (compression_level must come first, since setting it resets the
+# other options.)
+_SEGMENT_COPY = (
+    'channels', 'bits_per_sample', 'sample_rate', 'compression_level',
+    'streamable_subset', 'verify', 'blocksize', 'do_mid_side_stereo',
+    'loose_mid_side_stereo', 'max_lpc_order', 'qlp_coeff_precision',
+    'do_qlp_coeff_prec_search', 'do_exhaustive_model_search',
+    'min_residual_partition_order', 'max_residual_partition_order',
+    'num_threads',
+)
+
+# Queue item requesting a flush.
+_FLUSH = object()
+
+_thread_time = getattr(time, 'thread_time', time.perf_counter)
+
+
+def _append_samples(dest, samples):
+    # Append samples to an array of type 'i', using the buffer
+    # protocol if possible.
+    try:
+        view = memoryview(samples)
+    except TypeError:
+        dest.extend(samples)
+        return
+    with view:
+        if (view.ndim == 1 and view.itemsize == dest.itemsize
+                and view.format.lstrip('@=') in ('i', 'l')
+                and view.c_contiguous):
+            dest.frombytes(view.cast('B'))
+        else:
+            dest.extend(view)
+
+
+def _find_trailer(fileobj, audio_start, end):
+    # Find the start of any ID3v1 or APEv2 tags at the end of a
+    # file, which are sometimes appended to FLAC files by other
+    # software.  Return the offset of the first tag, or `end` if there
+    # are none.
+    while True:
+        if end - audio_start >= 128:
+            fileobj.seek(end - 128)
+            if fileobj.read(3) == b'TAG':
+                end -= 128
+                continue
+        if end - audio_start >= 32:
+            fileobj.seek(end - 32)
+            footer = fileobj.read(32)
+            if footer[:8] == b'APETAGEX':
+                size, flags = struct.unpack('<12xI4xI8x', footer)
+                if flags & 0x80000000:
+                    size += 32
+                if 32 <= size <= end - audio_start:
+                    end -= size
+                    continue
+        return end
+
+
+def _find_last_frame(fileobj, audio_start, end, info):
+    # Find the last frame of a FLAC stream, by searching backwards
+    # from the end of the file for a frame header that gives the
+    # expected sample number, and a valid CRC at the end of the file.
+    # Return the frame's offset and parsed header.
+    total_samples = info['total_samples']
+    if total_samples == 0:
+        raise _plibflac.Error("length of existing stream is unknown")
+    size = max(info['max_framesize'] * 2, 65536)
+    while True:
+        start = max(audio_start, end - size)
+        fileobj.seek(start)
+        data = fileobj.read(end - start)
+        pos = data.rfind(b'\xff')
+        while pos >= 0:
+            header = _plibflac.parse_frame_header(data[pos:pos + 16])
+            if header is not None:
+                variable_blocksize, number, blocksize = header[:3]
+                if not variable_blocksize:
+                    number *= info['max_blocksize']
+                if (number + blocksize == total_samples
+                        and _plibflac.crc16(data[pos:]) == 0):
+                    return start + pos, header
+            pos = data.rfind(b'\xff', 0, pos)
+        if start == audio_start:
+            raise _plibflac.Error("cannot find the last frame")
+        size *= 4
 
 
 class Encoder:
@@ -74,6 +198,35 @@ class Encoder:
         The maximum partition order for subdividing residual blocks.
     num_threads : int, optional
         The maximum number of threads to use for encoding.
+    seekpoint_interval : int, optional
+        The number of samples between seek points, or zero to omit the
+        seek table.
+    max_seekpoints : int, optional
+        The number of seek points to reserve if
+        `total_samples_estimate` is zero.
+    padding : int, optional
+        The size of the padding block, in bytes, or zero to omit the
+        padding block.
+    envelope_interval : int, optional
+        If nonzero, store the minimum and maximum of each channel at
+        multiple resolutions, starting with this many samples per
+        interval.
+    autotune_speed : float, optional
+        If specified, automatically select compression options for
+        this stream.  The value is the minimum acceptable encoding
+        speed, in samples per second.
+    autotune_window : int, optional
+        The number of samples to use for auto-tuning.
+    collect_stats : bool, optional
+        True to record the size of each frame, for profiling.
+    queue_size : int, optional
+        If nonzero, encode in a background thread, and allow up to
+        this many calls to `write` to be queued.
+    max_latency_ms : float, optional
+        If specified, encode the stream in low-latency mode, and flush
+        pending samples automatically after this many milliseconds.
+    append : bool, optional
+        True to add samples to the end of an existing FLAC stream.
 
     Notes
     -----
@@ -85,11 +238,63 @@ class Encoder:
 
     Setting the `compression_level` property sets default values for
     the other compression options, which can then be overridden.
+
+    If `autotune_speed` is specified, the encoder will collect the
+    first `autotune_window` samples written to the stream, and encode
+    them with several candidate settings in parallel (varying
+    `blocksize`, `max_lpc_order`, `apodization`, `do_mid_side_stereo`,
+    and the residual partition orders.)  Of the candidates that are at
+    least as fast as `autotune_speed`, the one that produces the
+    smallest output is then used for the entire stream; if none of the
+    candidates is fast enough, the fastest is used.  The selected
+    options can be retrieved using `autotune_result`.
+
+    If `queue_size` is nonzero, `write` copies the samples into a
+    queue and returns immediately; the samples are encoded and written
+    by a background thread.  If the queue is full, `write` waits until
+    space is available.  If an error occurs in the background thread,
+    the exception is raised by the next call to `write`, `flush`, or
+    `close`.
+
+    Normally, the encoder holds up to `blocksize` samples until a
+    complete block is available.  If `max_latency_ms` is specified,
+    the stream is instead written with variable block sizes, so that
+    `flush` can write a partial block immediately.  A flush happens
+    automatically whenever `write` is called (or, if `queue_size` is
+    nonzero, whenever the queue is idle) and the oldest pending
+    samples were written more than `max_latency_ms` milliseconds ago.
+    Use ``math.inf`` to flush only when `flush` is called.  In
+    low-latency mode, no seek table is written, and the MD5 signature
+    of the stream is not recorded.
+
+    If `append` is True, the file must either be empty or contain a
+    FLAC stream (starting at the current file position), and must be
+    readable and seekable.  The stream properties (`channels`,
+    `bits_per_sample`, `sample_rate`, and `blocksize`) are taken from
+    the existing stream, and cannot be changed.  New samples are
+    encoded and written after the existing frames (if the last frame
+    is a partial block, it is decoded and encoded again), and
+    STREAMINFO and the seek table are updated when the encoder is
+    closed.  ID3v1 or APEv2 tags at the end of the file are moved
+    after the new frames.  Since the MD5 signature of the stream
+    cannot be updated, it is cleared.  `append` cannot be combined
+    with `autotune_speed` or `max_latency_ms`.
+
+    If `envelope_interval` is nonzero, the encoder records the
+    minimum and maximum sample values of each channel, and when the
+    encoder is closed, these are stored in an APPLICATION metadata
+    block, which can be retrieved using `Decoder.envelope`.  The
+    output file must be readable and seekable.  If
+    `total_samples_estimate` is set, space for the block is reserved
+    in advance; otherwise (or if the estimate is too small), the
+    frames must be moved when the encoder is closed.
+    `envelope_interval` cannot be combined with `append` or
+    `max_latency_ms`.
     """
     def __init__(self, file, *,
-                 channels=2,
-                 bits_per_sample=16,
-                 sample_rate=44100,
+                 channels=None,
+                 bits_per_sample=None,
+                 sample_rate=None,
                  total_samples_estimate=None,
                  compression_level=5,
                  streamable_subset=True,
@@ -104,15 +309,50 @@ class Encoder:
                  do_exhaustive_model_search=None,
                  min_residual_partition_order=None,
                  max_residual_partition_order=None,
-                 num_threads=None):
+                 num_threads=None,
+                 seekpoint_interval=None,
+                 max_seekpoints=None,
+                 padding=None,
+                 envelope_interval=None,
+                 autotune_speed=None,
+                 autotune_window=65536,
+                 collect_stats=False,
+                 queue_size=0,
+                 max_latency_ms=None,
+                 append=False):
         if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
-            self._fileobj = open(file, 'wb')
+            if envelope_interval:
+                self._fileobj = open(file, 'w+b')
+            elif not append:
+                self._fileobj = open(file, 'wb')
+            else:
+                try:
+                    self._fileobj = open(file, 'r+b')
+                except FileNotFoundError:
+                    self._fileobj = open(file, 'w+b')
             self._closefile = True
         else:
             self._fileobj = file
             self._closefile = False
 
         self._opened = False
+        self._original_raw_pos = None
+        self._pending = None
+        self._autotune_result = None
+        self._encode_time = 0.0
+        self.autotune_speed = autotune_speed
+        self.autotune_window = autotune_window
+        self.queue_size = queue_size
+        self._queue = None
+        self._thread = None
+        self._async_error = None
+        self.max_latency_ms = max_latency_ms
+        self._fd = -1
+        self._flush_deadline = None
+        self._old_stats = []
+        self._segment_samples = 0
+        self._held = None
+        self._append = None
 
         if not (hasattr(self._fileobj, 'readinto') and
                 hasattr(self._fileobj, 'writable') and
@@ -139,6 +379,11 @@ class Encoder:
             'min_residual_partition_order': min_residual_partition_order,
             'max_residual_partition_order': max_residual_partition_order,
             'num_threads': num_threads,
+            'seekpoint_interval': seekpoint_interval,
+            'max_seekpoints': max_seekpoints,
+            'padding': padding,
+            'envelope_interval': envelope_interval,
+            'collect_stats': collect_stats,
         }
 
         try:
@@ -149,6 +394,11 @@ class Encoder:
             for name, value in options.items():
                 if value is not None:
                     setattr(self, name, value)
+            if envelope_interval and (append or max_latency_ms is not None):
+                raise ValueError("envelope_interval cannot be used with "
+                                 "append or max_latency_ms")
+            if append:
+                self._init_append(options)
         except BaseException:
             if self._closefile:
                 self._fileobj.close()
@@ -169,6 +419,9 @@ class Encoder:
         applications have no need to call this method.  If the encoder
         has already been opened, this method does nothing.
 
+        If `autotune_speed` is set, initializing the encoder is
+        deferred until the compression options have been selected.
+
         This corresponds to the start of a ``with`` statement.
 
         Raises
@@ -177,8 +430,295 @@ class Encoder:
             If the encoder properties are invalid or inconsistent.
         """
         if not self._opened:
-            self._encoder.open()
+            if self.autotune_speed is not None:
+                self._pending = [array.array('i')
+                                 for _ in range(self.channels)]
+            else:
+                self._open_stream()
             self._opened = True
+            if self.queue_size:
+                self._queue = queue.Queue(self.queue_size)
+                self._thread = threading.Thread(target=self._run_queue,
+                                                daemon=True)
+                self._thread.start()
+
+    def _init_append(self, options):
+        if self.autotune_speed is not None or self.max_latency_ms is not None:
+            raise ValueError("autotune_speed and max_latency_ms cannot be "
+                             "used with append")
+        fileobj = self._fileobj
+        if not (fileobj.readable() and fileobj.seekable()):
+            raise ValueError("file must be readable and seekable "
+                             "in order to append")
+        start = fileobj.tell()
+        if not fileobj.read(1):
+            # Empty file; write a new stream.
+            return
+        fileobj.seek(start)
+
+        blocks, audio_start = _metadata.read_blocks(fileobj)
+        info = _metadata.unpack_streaminfo(blocks[0][2])
+        for name in ('channels', 'bits_per_sample', 'sample_rate'):
+            if options[name] is not None and options[name] != info[name]:
+                raise ValueError(
+                    "{} ({}) does not match existing stream ({})"
+                    .format(name, options[name], info[name]))
+            setattr(self._encoder, name, info[name])
+
+        file_end = fileobj.seek(0, io.SEEK_END)
+        end = _find_trailer(fileobj, audio_start, file_end)
+        fileobj.seek(end)
+        trailer = fileobj.read(file_end - end)
+        if end > audio_start:
+            offset, header = _find_last_frame(fileobj, audio_start,
+                                              end, info)
+            variable_blocksize, _, last_blocksize = header[:3]
+        else:
+            variable_blocksize, last_blocksize = False, None
+
+        # A fixed-blocksize stream must keep the same block size,
+        # and only its last frame may be shorter, so a partial last
+        # frame must be encoded again.
+        blocksize = info['max_blocksize']
+        if options['blocksize'] is None:
+            self._encoder.blocksize = blocksize
+        elif (options['blocksize'] != blocksize
+              and not variable_blocksize and last_blocksize is not None):
+            raise ValueError("blocksize ({}) does not match existing "
+                             "stream ({})".format(options['blocksize'],
+                                                  blocksize))
+        if (not variable_blocksize and last_blocksize is not None
+                and last_blocksize < blocksize):
+            reencode = last_blocksize
+            write_pos = offset
+        else:
+            reencode = 0
+            write_pos = end
+
+        seektable = None
+        for block_type, block_offset, data in blocks:
+            if block_type == _metadata.SEEKTABLE:
+                seektable = (block_offset, _metadata.unpack_seektable(data))
+
+        self._append = {
+            'info': info,
+            'streaminfo': blocks[0][2],
+            'streaminfo_offset': blocks[0][1],
+            'seektable': seektable,
+            'audio_start': audio_start,
+            'end': end,
+            'trailer': trailer,
+            'write_pos': write_pos,
+            'first_sample': info['total_samples'] - reencode,
+            'reencode': reencode,
+            'variable_blocksize': variable_blocksize,
+            'last_blocksize': last_blocksize,
+        }
+
+    def _prepare_append(self):
+        append = self._append
+        fileobj = self._fileobj
+        pending = None
+        if append['reencode']:
+            # Decode the last frame, so that it can be encoded again
+            # together with the new samples.
+            fileobj.seek(append['write_pos'])
+            frame = fileobj.read(append['end'] - append['write_pos'])
+            stream = (b'fLaC\x80\x00\x00\x22' + append['streaminfo']
+                      + frame)
+            with Decoder(io.BytesIO(stream)) as decoder:
+                pending = decoder.read(append['reencode'])
+        fileobj.seek(append['write_pos'])
+        append['blocksize'] = self._encoder.blocksize
+        self._encoder.write_metadata = False
+        self._encoder.variable_blocksize = append['variable_blocksize']
+        self._encoder.first_sample_number = append['first_sample']
+        if append['seektable'] is not None:
+            self._encoder.collect_stats = True
+        return pending
+
+    def _finish_append(self):
+        append = self._append
+        fileobj = self._fileobj
+        # Tags that followed the existing frames are moved to the
+        # end of the new stream.
+        fileobj.write(append['trailer'])
+        end = fileobj.tell()
+        fileobj.truncate()
+
+        first_sample = append['first_sample']
+        total_samples = first_sample + self._segment_samples
+        info = dict(append['info'])
+        info['total_samples'] = total_samples
+        info['md5sum'] = bytes(16)
+
+        min_framesize = self._encoder.min_framesize
+        max_framesize = self._encoder.max_framesize
+        if append['last_blocksize'] is None:
+            info['min_framesize'] = min_framesize
+            info['max_framesize'] = max_framesize
+            info['min_blocksize'] = append['blocksize']
+            info['max_blocksize'] = append['blocksize']
+        elif max_framesize > 0:
+            if info['min_framesize'] > 0:
+                info['min_framesize'] = min(info['min_framesize'],
+                                            min_framesize)
+            if info['max_framesize'] > 0:
+                info['max_framesize'] = max(info['max_framesize'],
+                                            max_framesize)
+
+        if append['variable_blocksize'] and self._segment_samples > 0:
+            # The previous last frame is no longer the last, so it
+            # counts towards the minimum block size.
+            full, partial = divmod(self._segment_samples,
+                                   append['blocksize'])
+            sizes = ([append['blocksize']] * min(full, 2)
+                     + [partial] * (partial > 0))
+            info['max_blocksize'] = max([info['max_blocksize']] + sizes)
+            sizes[-1] = append['last_blocksize']
+            info['min_blocksize'] = min([info['min_blocksize']] + sizes)
+
+        fileobj.seek(append['streaminfo_offset'])
+        fileobj.write(_metadata.pack_streaminfo(info))
+
+        if append['seektable'] is not None:
+            self._update_seektable(total_samples)
+        fileobj.seek(end)
+
+    def _prepare_envelope(self):
+        fileobj = self._fileobj
+        if not (fileobj.readable() and fileobj.seekable()):
+            raise ValueError("file must be readable and seekable "
+                             "in order to write an envelope")
+        self._envelope_start = fileobj.tell()
+        self._envelope_padding = self._encoder.padding
+        estimate = self.total_samples_estimate
+        if estimate:
+            # Reserve space for the envelope in the padding block.
+            length = _metadata.envelope_length(
+                self.channels, self.bits_per_sample,
+                self.envelope_interval, estimate)
+            if self._envelope_padding:
+                length += 4
+            self._encoder.padding = self._envelope_padding + length
+
+    def _write_envelope(self):
+        # Insert the envelope before the first padding block, using
+        # the padding if possible, and otherwise moving the frames.
+        fileobj = self._fileobj
+        end = fileobj.tell()
+        fileobj.seek(self._envelope_start)
+        blocks, audio_start = _metadata.read_blocks(fileobj)
+        envelope = _metadata.pack_envelope(
+            self._encoder.envelope(), self.channels, self.bits_per_sample,
+            self.envelope_interval, self._segment_samples)
+
+        blocks = [(block_type, data) for block_type, _, data in blocks]
+        for i, (block_type, data) in enumerate(blocks):
+            if block_type == _metadata.PADDING:
+                break
+        else:
+            i = len(blocks)
+        new_blocks = blocks[:i] + [(_metadata.APPLICATION, envelope)]
+        if i < len(blocks):
+            spare = len(blocks[i][1]) - len(envelope)
+            if 0 <= spare < 4:
+                new_blocks[-1] = (_metadata.APPLICATION,
+                                  envelope + bytes(spare))
+            elif spare >= 4:
+                new_blocks.append((_metadata.PADDING, bytes(spare - 4)))
+            elif self._envelope_padding:
+                new_blocks.append((_metadata.PADDING,
+                                   bytes(self._envelope_padding)))
+            new_blocks += blocks[i + 1:]
+        new_start = _metadata.rewrite_blocks(
+            fileobj, self._envelope_start, audio_start, new_blocks)
+        fileobj.seek(end + new_start - audio_start)
+
+    def _update_seektable(self, total_samples):
+        # Fill in seek points that refer to the new frames.
+        append = self._append
+        table_offset, points = append['seektable']
+        _, frame_samples, frame_bytes, _ = self._encoder.stats()
+        starts = []
+        offsets = []
+        sample = append['first_sample']
+        offset = append['write_pos'] - append['audio_start']
+        for samples, size in zip(frame_samples, frame_bytes):
+            starts.append(sample)
+            offsets.append(offset)
+            sample += samples
+            offset += size
+
+        new_points = {}
+        for point in points:
+            target = point[0]
+            if target == _metadata.SEEKPOINT_PLACEHOLDER:
+                continue
+            if ((point[2] == 0 or target >= append['first_sample'])
+                    and target < total_samples and starts):
+                i = bisect.bisect_right(starts, target) - 1
+                if i >= 0:
+                    point = (starts[i], offsets[i], frame_samples[i])
+            new_points.setdefault(point[0], point)
+        new_points = sorted(new_points.values())
+        new_points += ([(_metadata.SEEKPOINT_PLACEHOLDER, 0, 0)]
+                       * (len(points) - len(new_points)))
+        self._fileobj.seek(table_offset)
+        self._fileobj.write(_metadata.pack_seektable(new_points))
+
+    def _open_stream(self):
+        pending = None
+        if self._append is not None:
+            pending = self._prepare_append()
+        if self.envelope_interval:
+            self._prepare_envelope()
+        self._original_raw_pos = None
+        try:
+            if isinstance(self._fileobj, io.FileIO):
+                fd = self._fileobj.fileno()
+            elif (isinstance(self._fileobj, (io.BufferedWriter,
+                                             io.BufferedRandom))
+                  and isinstance(self._fileobj.raw, io.FileIO)
+                  and self._fileobj.seekable()):
+                fd = self._fileobj.fileno()
+                # Flush any data that has been written to the
+                # buffered stream, then set the raw stream
+                # position (where we will begin encoding) to the
+                # current buffered stream position.  Save the
+                # original raw stream position for later use.
+                self._fileobj.flush()
+                self._original_raw_pos = self._fileobj.raw.tell()
+                self._fileobj.raw.seek(self._fileobj.tell())
+            else:
+                fd = -1
+        except OSError:
+            fd = -1
+        self._fd = fd
+        self._segment_samples = 0
+        self._held = None
+        if self.max_latency_ms is not None:
+            self._encoder.variable_blocksize = True
+            self._stream_format = (self.sample_rate, self.channels,
+                                   self.bits_per_sample)
+            try:
+                if self._fileobj.seekable():
+                    self._stream_start = self._fileobj.tell()
+                else:
+                    self._stream_start = None
+            except OSError:
+                self._stream_start = None
+            self._flushed_samples = 0
+            self._blocksize_range = [None, 0]
+            self._framesize_range = [None, 0]
+            self._old_stats = []
+        start = time.perf_counter()
+        try:
+            self._encoder.open(fd)
+        finally:
+            self._encode_time = time.perf_counter() - start
+        if pending is not None:
+            self._encode(pending)
 
     def close(self):
         """
@@ -204,8 +744,47 @@ class Encoder:
         """
         try:
             if self._opened:
+                if self._thread is not None:
+                    self._queue.put(None)
+                    self._thread.join()
+                    self._thread = None
+                    self._queue = None
+                if self._async_error is not None:
+                    self._opened = False
+                    self._pending = None
+                    try:
+                        self._encoder.close()
+                    except Exception:
+                        pass
+                    self._raise_async_error()
+                if self._pending is not None:
+                    self._finish_autotune()
                 self._opened = False
-                self._encoder.close()
+                if self.max_latency_ms is not None:
+                    self._release_held()
+                    self._close_segment(True)
+                else:
+                    start = time.perf_counter()
+                    try:
+                        self._encoder.close()
+                    finally:
+                        self._encode_time += time.perf_counter() - start
+                if self._original_raw_pos is not None:
+                    # Set the buffered stream position equal to the
+                    # current raw stream position (where we finished
+                    # encoding).  In order to ensure the internal
+                    # state of the buffered stream is consistent, we
+                    # must first restore the raw stream to the
+                    # position it had originally.
+                    final_pos = self._fileobj.raw.tell()
+                    self._fileobj.raw.seek(self._original_raw_pos)
+                    self._fileobj.seek(final_pos)
+                if self.max_latency_ms is not None:
+                    self._write_streaminfo()
+                if self._append is not None:
+                    self._finish_append()
+                if self.envelope_interval:
+                    self._write_envelope()
         finally:
             if self._closefile:
                 self._closefile = False
@@ -237,7 +816,400 @@ class Encoder:
             If an error occurred while encoding the output data.
         """
         self.open()
-        self._encoder.write(samples)
+        if self._queue is not None:
+            self._raise_async_error()
+            if len(samples) != self.channels:
+                raise ValueError("length of sequence "
+                                 "must match number of channels")
+            copies = []
+            for channel in samples:
+                copies.append(array.array('i'))
+                _append_samples(copies[-1], channel)
+            for i, copy in enumerate(copies):
+                if len(copy) != len(copies[0]):
+                    raise ValueError(
+                        "length of channel {} ({}) must match length of "
+                        "channel 0 ({})".format(i, len(copy), len(copies[0])))
+            self._queue.put(copies)
+        else:
+            self._write_samples(samples)
+
+    def flush(self):
+        """
+        Write pending data to the output file.
+
+        If `max_latency_ms` is set, all samples that have been passed
+        to `write` are encoded and written to the output file, ending
+        the current block early if necessary.  (Since only the last
+        block of a stream may be shorter than 16 samples, a partial
+        block of fewer than 16 samples is held until more samples are
+        written or the encoder is closed.)  Otherwise, only
+        complete blocks are written; the remaining samples are held
+        until more samples are written or the encoder is closed.
+
+        If `queue_size` is nonzero, this waits until all queued
+        samples have been encoded.
+
+        Raises
+        ------
+        plibflac.Error
+            If an error occurred while encoding the output data.
+        """
+        if self._queue is not None:
+            self._raise_async_error()
+            self._queue.put(_FLUSH)
+            self._queue.join()
+            self._raise_async_error()
+        elif self._opened:
+            self._flush_stream()
+
+    def _run_queue(self):
+        while True:
+            deadline = self._flush_deadline
+            if deadline is None:
+                timeout = None
+            else:
+                timeout = max(0, deadline - time.monotonic())
+            try:
+                samples = self._queue.get(timeout=timeout)
+            except queue.Empty:
+                # The queue is idle, and pending samples need to be
+                # flushed.
+                self._flush_deadline = None
+                if self._async_error is None:
+                    try:
+                        self._flush_stream()
+                    except BaseException as exc:
+                        self._async_error = exc
+                continue
+            try:
+                if samples is None:
+                    return
+                if self._async_error is None:
+                    if samples is _FLUSH:
+                        self._flush_stream()
+                    else:
+                        self._write_samples(samples)
+            except BaseException as exc:
+                self._async_error = exc
+            finally:
+                self._queue.task_done()
+
+    def _raise_async_error(self):
+        if self._async_error is not None:
+            raise self._async_error
+
+    def _write_samples(self, samples):
+        if self._pending is not None:
+            if len(samples) != len(self._pending):
+                raise ValueError("length of sequence "
+                                 "must match number of channels")
+            for pending, channel in zip(self._pending, samples):
+                _append_samples(pending, channel)
+            if len(self._pending[0]) >= self.autotune_window:
+                self._finish_autotune()
+        else:
+            self._encode(samples)
+        if self.max_latency_ms is not None and len(samples[0]) > 0:
+            now = time.monotonic()
+            if self._flush_deadline is None:
+                self._flush_deadline = now + self.max_latency_ms / 1000
+            if now >= self._flush_deadline:
+                self._flush_stream()
+
+    def _encode(self, samples):
+        if self.max_latency_ms is not None:
+            samples = self._hold_short_block(samples)
+        start = time.perf_counter()
+        try:
+            self._encoder.write(samples)
+        finally:
+            self._encode_time += time.perf_counter() - start
+        self._segment_samples += len(samples[0])
+
+    def _hold_short_block(self, samples):
+        # Only the last frame of a stream may be shorter than
+        # MIN_BLOCKSIZE.  If these samples would leave a shorter
+        # partial block, keep them back (to be encoded together with
+        # the following samples), so that a flush never ends a
+        # segment with a short frame.
+        if len(samples) != self.channels:
+            raise ValueError("length of sequence "
+                             "must match number of channels")
+        for i, channel in enumerate(samples):
+            if len(channel) != len(samples[0]):
+                raise ValueError(
+                    "length of channel {} ({}) must match length of "
+                    "channel 0 ({})".format(i, len(channel),
+                                            len(samples[0])))
+        if self._held is not None:
+            held = self._held
+            self._held = None
+            for dest, channel in zip(held, samples):
+                _append_samples(dest, channel)
+            samples = held
+        n = len(samples[0])
+        if self._ends_short_block(self._segment_samples + n):
+            partial = (self._segment_samples + n) % self._encoder.blocksize
+            self._held = [array.array('i') for _ in samples]
+            for dest, channel in zip(self._held, samples):
+                _append_samples(dest, channel[n - partial:])
+            samples = [channel[:n - partial] for channel in samples]
+        return samples
+
+    def _ends_short_block(self, n_samples):
+        # True if a segment of this length would end with a partial
+        # block shorter than MIN_BLOCKSIZE.
+        partial = n_samples % self._encoder.blocksize
+        return 0 < partial < _metadata.MIN_BLOCKSIZE
+
+    def _release_held(self):
+        # Encode samples kept back by _hold_short_block.
+        held = self._held
+        self._held = None
+        if held is not None:
+            start = time.perf_counter()
+            try:
+                self._encoder.write(held)
+            finally:
+                self._encode_time += time.perf_counter() - start
+            self._segment_samples += len(held[0])
+
+    def _flush_stream(self):
+        self._flush_deadline = None
+        if self._pending is not None:
+            self._finish_autotune()
+        # Samples passed directly to libFLAC (by transcoding or by
+        # encoding raw samples) cannot be held back; if they end with
+        # a short partial block, the segment is left open until more
+        # samples are written.
+        if (self.max_latency_ms is not None and self._segment_samples > 0
+                and not self._ends_short_block(self._segment_samples)):
+            # libFLAC can only write a partial block at the end of
+            # the stream.  Finish the current encoder, and start a
+            # new one that continues where the previous one ended.
+            settings = [(name, getattr(self._encoder, name))
+                        for name in _SEGMENT_COPY]
+            apodization = self._encoder.apodization
+            self._close_segment(False)
+            for name, value in settings:
+                setattr(self._encoder, name, value)
+            if apodization is not None:
+                self._encoder.apodization = apodization
+            self._encoder.write_metadata = False
+            self._encoder.first_sample_number = self._flushed_samples
+            start = time.perf_counter()
+            try:
+                self._encoder.open(self._fd)
+            finally:
+                self._encode_time += time.perf_counter() - start
+        if self._fd < 0:
+            self._fileobj.flush()
+
+    def _close_segment(self, final):
+        blocksize = self._encoder.blocksize
+        start = time.perf_counter()
+        try:
+            self._encoder.close()
+        finally:
+            self._encode_time += time.perf_counter() - start
+        if not final:
+            self._old_stats.append(self._encoder.stats())
+
+        # Every block except the last one has the nominal block size.
+        # The last block of the stream is not counted in STREAMINFO's
+        # minimum block size.
+        full, partial = divmod(self._segment_samples, blocksize)
+        sizes = [blocksize] * min(full, 2) + [partial] * (partial > 0)
+        if sizes:
+            self._blocksize_range[1] = max(self._blocksize_range[1],
+                                           max(sizes))
+            if final:
+                sizes.pop()
+        for size in sizes:
+            if (self._blocksize_range[0] is None
+                    or size < self._blocksize_range[0]):
+                self._blocksize_range[0] = size
+
+        if self._encoder.min_framesize > 0:
+            if (self._framesize_range[0] is None
+                    or self._encoder.min_framesize
+                    < self._framesize_range[0]):
+                self._framesize_range[0] = self._encoder.min_framesize
+            self._framesize_range[1] = max(self._framesize_range[1],
+                                           self._encoder.max_framesize)
+
+        self._flushed_samples += self._segment_samples
+        self._segment_samples = 0
+
+    def _write_streaminfo(self):
+        if self._stream_start is None:
+            return
+        sample_rate, channels, bits_per_sample = self._stream_format
+        max_blocksize = self._blocksize_range[1] or 16
+        min_blocksize = self._blocksize_range[0] or max_blocksize
+        info = {
+            'min_blocksize': min_blocksize,
+            'max_blocksize': max_blocksize,
+            'min_framesize': self._framesize_range[0] or 0,
+            'max_framesize': self._framesize_range[1],
+            'sample_rate': sample_rate,
+            'channels': channels,
+            'bits_per_sample': bits_per_sample,
+            'total_samples': self._flushed_samples,
+            'md5sum': bytes(16),
+        }
+        end = self._fileobj.tell()
+        self._fileobj.seek(self._stream_start + 8)
+        self._fileobj.write(_metadata.pack_streaminfo(info))
+        self._fileobj.seek(end)
+
+    def _finish_autotune(self):
+        pending = self._pending
+        self._pending = None
+        if len(pending[0]) > 0:
+            self._autotune([x[:self.autotune_window] for x in pending])
+        self._open_stream()
+        if len(pending[0]) > 0:
+            self._encode(pending)
+
+    def _transcode_from(self, decoder):
+        # Encode all remaining samples from a Decoder.  Apart from
+        # samples that are needed for auto-tuning, the samples are
+        # passed directly from libFLAC's decoder to the encoder.
+        if self._queue is not None:
+            raise ValueError("cannot transcode with queue_size")
+        self.open()
+        count = 0
+        while self._pending is not None:
+            data = decoder.read(self.autotune_window)
+            if data is None:
+                self._finish_autotune()
+            else:
+                self._write_samples(data)
+                count += len(data[0])
+        self._release_held()
+        start = time.perf_counter()
+        try:
+            n = _plibflac.transcode(decoder._decoder, self._encoder)
+        finally:
+            self._encode_time += time.perf_counter() - start
+        self._segment_samples += n
+        return count + n
+
+    def _encode_raw(self, fd, sample_format, limit):
+        # Encode raw PCM samples read from a file descriptor, until
+        # end of file or until `limit` bytes have been read.
+        if self._queue is not None:
+            raise ValueError("cannot encode raw samples with queue_size")
+        if self.autotune_speed is not None:
+            raise ValueError("cannot encode raw samples with autotune_speed")
+        self.open()
+        self._release_held()
+        start = time.perf_counter()
+        try:
+            n = self._encoder.write_raw(fd, *sample_format, limit)
+        finally:
+            self._encode_time += time.perf_counter() - start
+        self._segment_samples += n
+        return n
+
+    def _autotune(self, samples):
+        settings = [(name, getattr(self._encoder, name))
+                    for name in _AUTOTUNE_COPY]
+
+        def _trial(values):
+            with tempfile.TemporaryFile() as fileobj:
+                encoder = _plibflac.encoder(fileobj)
+                for name, value in settings:
+                    setattr(encoder, name, value)
+                for name, value in zip(_AUTOTUNE_NAMES, values):
+                    setattr(encoder, name, value)
+                start = _thread_time()
+                encoder.open(fileobj.fileno())
+                encoder.write(samples)
+                encoder.close()
+                elapsed = _thread_time() - start
+                size = os.fstat(fileobj.fileno()).st_size
+            if elapsed > 0:
+                return (len(samples[0]) / elapsed, size, values)
+            else:
+                return (float('inf'), size, values)
+
+        with concurrent.futures.ThreadPoolExecutor(
+                len(_AUTOTUNE_CANDIDATES)) as executor:
+            results = list(executor.map(_trial, _AUTOTUNE_CANDIDATES))
+
+        fast = [r for r in results if r[0] >= self.autotune_speed]
+        if fast:
+            best = min(fast, key=lambda r: (r[1], -r[0]))
+        else:
+            best = max(results, key=lambda r: r[0])
+
+        self._autotune_result = dict(zip(_AUTOTUNE_NAMES, best[2]))
+        for name, value in self._autotune_result.items():
+            setattr(self._encoder, name, value)
+
+    @property
+    def autotune_result(self):
+        """
+        Compression options selected by auto-tuning.
+
+        If `autotune_speed` is set, this is a dictionary of the
+        encoder properties that were selected, once enough samples
+        have been written (or the stream has been closed.)  Otherwise,
+        this is None.
+        """
+        return self._autotune_result
+
+    @property
+    def stats(self):
+        """
+        Encoding statistics.
+
+        If `collect_stats` was set to True before opening the stream,
+        this is a dictionary containing the following items:
+
+        ``frame_number``
+            Array of frame numbers.
+        ``frame_samples``
+            Array of the number of samples (per channel) in each
+            frame.
+        ``frame_bytes``
+            Array of the compressed size of each frame, in bytes.
+        ``bytes_written``
+            Total number of bytes written to the output file
+            (including metadata.)
+        ``encode_time``
+            Total time spent encoding the stream, in seconds.
+
+        The arrays are ``memoryview`` objects containing unsigned
+        32-bit integers, and include every frame written since the
+        stream was opened (or, if the encoder has been closed, every
+        frame in the stream.)  If `collect_stats` was False, the
+        arrays are empty.
+        """
+        numbers, samples, sizes, total = self._encoder.stats()
+        if self._old_stats:
+            # Combine statistics from each part of a low-latency
+            # stream.
+            parts = self._old_stats + [(numbers, samples, sizes, total)]
+            arrays = [array.array(numbers.format) for _ in range(3)]
+            total = 0
+            for part in parts:
+                offset = len(arrays[0])
+                arrays[0].extend(n + offset for n in part[0])
+                arrays[1].extend(part[1])
+                arrays[2].extend(part[2])
+                total += part[3]
+            numbers, samples, sizes = (memoryview(a) for a in arrays)
+        return {
+            'frame_number': numbers,
+            'frame_samples': samples,
+            'frame_bytes': sizes,
+            'bytes_written': total,
+            'encode_time': self._encode_time,
+        }
 
     def _prop(name, doc=None):
         def _fget(self):
@@ -248,6 +1220,22 @@ class Encoder:
 
         return property(_fget, _fset, None, doc)
 
+    def _option(name, doc=None):
+        # Option that is handled by this class rather than by libFLAC,
+        # but likewise cannot be changed after the encoder is opened.
+        attr = '_' + name
+
+        def _fget(self):
+            return getattr(self, attr)
+
+        def _fset(self, value):
+            if self._opened:
+                raise ValueError("cannot set '{}' after open()"
+                                 .format(name))
+            setattr(self, attr, value)
+
+        return property(_fget, _fset, None, doc)
+
     channels = _prop(
         'channels',
         """
@@ -445,6 +1433,84 @@ class Encoder:
         This attribute must be set before opening the stream.
         """
     )
+    seekpoint_interval = _prop(
+        'seekpoint_interval',
+        """
+        Number of samples between seek points.
+
+        If this is nonzero, a seek table is written at the start of
+        the stream, with one seek point for every `seekpoint_interval`
+        samples, up to `total_samples_estimate`.  A seek table allows
+        a decoder to jump quickly to any position in the stream.  To
+        place a seek point every N seconds, set this to N times
+        `sample_rate`.
+
+        If `total_samples_estimate` is zero, `max_seekpoints` points
+        are reserved instead.  If the stream is too long for that
+        many points, the interval is doubled as many times as needed.
+
+        This corresponds to the ``-S`` option for the ``flac``
+        command-line tool.  The seek table can only be filled in if
+        the output file is seekable.  The default value is 0 (no seek
+        table.)
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    max_seekpoints = _prop(
+        'max_seekpoints',
+        """
+        Number of seek points to reserve for a stream of unknown length.
+
+        If `seekpoint_interval` is nonzero and `total_samples_estimate`
+        is zero, the seek table is created with this many placeholder
+        points, which are filled in as the stream is written.  Unused
+        points are left as placeholders.  The default value is 128.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    padding = _prop(
+        'padding',
+        """
+        Size of the padding block, in bytes.
+
+        If this is nonzero, a padding block is written at the start of
+        the stream, which allows metadata to be added to the file
+        later without rewriting the entire file.
+
+        This corresponds to the ``-P`` option for the ``flac``
+        command-line tool.  The default value is 0 (no padding.)
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    envelope_interval = _prop(
+        'envelope_interval',
+        """
+        Number of samples per interval of the stored envelope.
+
+        If this is nonzero, the minimum and maximum sample values of
+        each channel are stored in an APPLICATION metadata block, for
+        intervals of this many samples, and for successively larger
+        intervals (each four times larger than the last), so that an
+        overview of the stream can be displayed quickly at any scale.
+        See `Decoder.envelope`.  The default value is 0 (no envelope.)
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    collect_stats = _prop(
+        'collect_stats',
+        """
+        True to record the size of each frame, for profiling.
+
+        Recording frame sizes has a negligible effect on encoding
+        speed.  The results can be retrieved using `stats`.
+
+        This attribute must be set before opening the stream.
+        """
+    )
     num_threads = _prop(
         'num_threads',
         """
@@ -458,3 +1524,89 @@ class Encoder:
         This attribute must be set before opening the stream.
         """
     )
+    autotune_speed = _option(
+        'autotune_speed',
+        """
+        Minimum acceptable encoding speed, in samples per second.
+
+        If this is not None, compression options are selected
+        automatically; see `Encoder`.  The default value is None.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    autotune_window = _option(
+        'autotune_window',
+        """
+        Number of samples to use for auto-tuning.
+
+        The default value is 65536.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    queue_size = _option(
+        'queue_size',
+        """
+        Number of calls to `write` that may be queued for encoding.
+
+        If nonzero, samples are encoded in a background thread; see
+        `Encoder`.  The default value is 0.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+    max_latency_ms = _option(
+        'max_latency_ms',
+        """
+        Maximum time to hold pending samples, in milliseconds.
+
+        If not None, the stream is encoded in low-latency mode; see
+        `Encoder`.  The default value is None.
+
+        This attribute must be set before opening the stream.
+        """
+    )
+
+
+def encode_many(jobs, *, max_workers=None):
+    """
+    Encode and write a batch of FLAC files in parallel.
+
+    Each job is a tuple ``(file, samples)`` or ``(file, samples,
+    options)``.  The `samples` are written to `file` as if by calling
+    `Encoder.write`, using an `Encoder` created with the keyword
+    arguments in `options` (a dictionary).  Jobs are distributed among
+    a pool of worker threads.
+
+    Encoding is done without holding the global interpreter lock,
+    except when calling the methods of a Python file object.  For best
+    performance, each `file` should be a filesystem path or an
+    unbuffered or buffered file object, which allows output data to be
+    written directly to the underlying file descriptor.
+
+    Parameters
+    ----------
+    jobs : iterable of tuples
+        Output files, sample data, and encoder options.
+    max_workers : int, optional
+        Maximum number of threads to use.  By default, this depends on
+        the number of CPU cores.
+
+    Raises
+    ------
+    plibflac.Error
+        If an error occurred while encoding any of the output files.
+        All jobs are run to completion before the first error (in the
+        order the jobs were given) is raised.
+    """
+    def _encode(job):
+        file, samples = job[0], job[1]
+        options = job[2] if len(job) > 2 else {}
+        with Encoder(file, **options) as encoder:
+            encoder.write(samples)
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers) as executor:
+        futures = [executor.submit(_encode, job) for job in jobs]
+    for future in futures:
+        future.result()
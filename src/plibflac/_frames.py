@@ -0,0 +1,204 @@
+"""
+Internal functions for reading compressed FLAC frames.
+"""
+
+import collections
+
+import _plibflac
+from plibflac import _metadata
+
+# Maximum number of frames to parse at once.
+_MAX_FRAMES = 1024
+
+_CHANNEL_ASSIGNMENTS = {
+    8: 'left_side',
+    9: 'right_side',
+    10: 'mid_side',
+}
+
+Frame = collections.namedtuple('Frame', [
+    'offset', 'sample_number', 'blocksize', 'sample_rate', 'channels',
+    'channel_assignment', 'bits_per_sample', 'header_crc', 'crc', 'data',
+])
+Frame.__doc__ = """
+A compressed frame of a FLAC stream.
+
+Attributes
+----------
+offset : int
+    Byte offset of the start of the frame in the input file.
+sample_number : int
+    Sample number of the first sample in the frame.
+blocksize : int
+    Number of samples (per channel) in the frame.
+sample_rate : int
+    Sampling frequency, in samples per second.
+channels : int
+    Number of channels.
+channel_assignment : str
+    Stereo decorrelation mode: ``'independent'``, ``'left_side'``,
+    ``'right_side'``, or ``'mid_side'``.
+bits_per_sample : int
+    Resolution of each sample.
+header_crc : int
+    CRC-8 of the frame header.
+crc : int
+    CRC-16 of the frame.
+data : bytes
+    Contents of the frame, including the header and CRC.
+"""
+
+
+class FrameReader:
+    """
+    Reader for the compressed frames of a FLAC stream.
+
+    A FrameReader object scans a FLAC file for frames, without
+    decoding any samples, and yields a `Frame` for each frame when
+    iterated.  This is useful for copying, indexing, or checking the
+    structure of a stream.  Damaged frames (those whose CRC does not
+    match) are skipped.
+
+    To ensure resources are cleaned up, call `close` when the reader
+    is no longer needed, or use a ``with`` statement.
+
+    Parameters
+    ----------
+    file : path-like object or binary file object
+        Either the name of the input file, or an existing file object
+        (which must be a readable binary file, but need not be
+        seekable).
+    buffer_size : int, optional
+        Number of bytes to read from the file at once.
+
+    Attributes
+    ----------
+    channels : int
+        The number of channels in the input stream.
+    bits_per_sample : int
+        The resolution of each sample in the input stream.
+    sample_rate : int
+        The sampling frequency of the input stream, in samples per
+        second.
+    total_samples : int
+        The length of the input stream, in samples, or zero if
+        unknown.
+    audio_start : int
+        Byte offset of the first frame in the input file.
+
+    Raises
+    ------
+    plibflac.Error
+        If the input does not begin with a valid FLAC header.
+    """
+
+    def __init__(self, file, *, buffer_size=1 << 20):
+        if buffer_size <= 0:
+            raise ValueError("buffer_size must be positive")
+
+        if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+            self._fileobj = open(file, 'rb')
+            self._closefile = True
+        else:
+            self._fileobj = file
+            self._closefile = False
+
+        try:
+            try:
+                offset = self._fileobj.tell()
+            except OSError:
+                offset = 0
+            blocks, self.audio_start = _metadata.read_blocks(self._fileobj,
+                                                             offset)
+        except BaseException:
+            self.close()
+            raise
+
+        info = _metadata.unpack_streaminfo(blocks[0][2])
+        self.channels = info['channels']
+        self.bits_per_sample = info['bits_per_sample']
+        self.sample_rate = info['sample_rate']
+        self.total_samples = info['total_samples']
+        self._max_blocksize = info['max_blocksize']
+        self._max_framesize = info['max_framesize']
+        if info['min_blocksize'] == info['max_blocksize']:
+            self._fixed_blocksize = info['max_blocksize']
+        else:
+            self._fixed_blocksize = None
+
+        self._buffer_size = buffer_size
+        self._buffer = b''
+        self._offset = self.audio_start
+        self._eof = False
+        self._frames = collections.deque()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        if not self._frames and not self._scan():
+            raise StopIteration
+        return self._frames.popleft()
+
+    def close(self):
+        """
+        Close the input file.
+        """
+        if self._closefile:
+            self._closefile = False
+            self._fileobj.close()
+
+    def _reset(self, offset):
+        # Continue reading from a frame at the given offset.
+        self._fileobj.seek(offset)
+        self._buffer = b''
+        self._offset = offset
+        self._eof = False
+        self._frames.clear()
+
+    def _scan(self):
+        # Parse frames from the buffered data, reading more data if
+        # needed.  Return False at the end of the stream.
+        while True:
+            data = self._buffer
+            frames, consumed = _plibflac.scan_frames(
+                data, self._eof, self.channels, self.bits_per_sample,
+                self.sample_rate, self._max_blocksize,
+                self._max_framesize, _MAX_FRAMES)
+            for (offset, length, variable_blocksize, number, blocksize,
+                 sample_rate, channels, channel_assignment,
+                 bits_per_sample, header_crc, crc) in frames:
+                if not variable_blocksize:
+                    if self._fixed_blocksize is None:
+                        self._fixed_blocksize = blocksize
+                    number *= self._fixed_blocksize
+                self._frames.append(Frame(
+                    offset=self._offset + offset,
+                    sample_number=number,
+                    blocksize=blocksize,
+                    sample_rate=sample_rate or self.sample_rate,
+                    channels=channels,
+                    channel_assignment=_CHANNEL_ASSIGNMENTS.get(
+                        channel_assignment, 'independent'),
+                    bits_per_sample=bits_per_sample or self.bits_per_sample,
+                    header_crc=header_crc,
+                    crc=crc,
+                    data=data[offset:offset + length],
+                ))
+            self._buffer = data[consumed:]
+            self._offset += consumed
+            if frames:
+                return True
+            if self._eof:
+                return False
+            chunk = self._fileobj.read(max(self._buffer_size,
+                                           len(self._buffer)))
+            if not chunk:
+                self._eof = True
+            self._buffer += chunk
@@ -0,0 +1,406 @@
+"""
+Internal functions for records divided into groups of channels.
+"""
+
+import array
+import bisect
+import concurrent.futures
+
+import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+from plibflac._encoder import Encoder
+
+# Maximum number of channels in a single FLAC stream.
+_MAX_CHANNELS = 8
+
+
+class GroupEncoder:
+    """
+    Encoder for a record with more channels than a FLAC stream allows.
+
+    A GroupEncoder object writes a record with any number of channels
+    as a group of FLAC files (shards), each containing some of the
+    channels.  The channels are divided among the shards in order, as
+    evenly as possible; for example, 20 channels written to three
+    files are stored as channels 0 to 6, 7 to 13, and 14 to 19.
+
+    Samples are written to all of the shards in parallel, so the
+    shards always contain the same number of samples.  The group can
+    be read using `GroupDecoder`.
+
+    To ensure the files are written completely, call `close` when the
+    encoder is no longer needed, or use a ``with`` statement.
+
+    Parameters
+    ----------
+    files : iterable of path-like objects or binary file objects
+        The output shards, in order.  There must be at least one shard
+        for every 8 channels, and at least one channel per shard.
+    channels : int
+        The total number of channels in the record.
+    **options
+        Other stream properties and compression options (such as
+        `bits_per_sample`, `sample_rate`, and `compression_level`),
+        which are applied to every shard.  See `Encoder`.
+
+    Attributes
+    ----------
+    channels : int
+        The total number of channels in the record.
+    shard_channels : list of int
+        The number of channels in each shard.
+
+    Raises
+    ------
+    ValueError
+        If the number of channels cannot be divided among the shards.
+    """
+
+    def __init__(self, files, *, channels, **options):
+        files = list(files)
+        if not 0 < len(files) <= channels <= len(files) * _MAX_CHANNELS:
+            raise ValueError("cannot store {} channels in {} files"
+                             .format(channels, len(files)))
+        self.channels = channels
+        self.shard_channels = [
+            (channels + i) // len(files) for i in range(len(files))
+        ][::-1]
+        self._starts = [0]
+        for n in self.shard_channels:
+            self._starts.append(self._starts[-1] + n)
+
+        self._encoders = []
+        self._executor = None
+        try:
+            for file, n in zip(files, self.shard_channels):
+                self._encoders.append(Encoder(file, channels=n, **options))
+        except BaseException:
+            self.close()
+            raise
+        if len(files) > 1:
+            self._executor = concurrent.futures.ThreadPoolExecutor(len(files))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def write(self, samples):
+        """
+        Encode and write data to the output files.
+
+        The argument must contain an array of samples for every
+        channel, as for `Encoder.write`.  Each shard's channels are
+        encoded in a separate thread.
+
+        Parameters
+        ----------
+        samples : sequence of array-like objects
+            Sequence of sample arrays.
+
+        Raises
+        ------
+        plibflac.Error
+            If an error occurred while encoding the output data.
+        """
+        if len(samples) != self.channels:
+            raise ValueError("length of sequence "
+                             "must match number of channels")
+        for i in range(1, len(samples)):
+            if len(samples[i]) != len(samples[0]):
+                raise ValueError(
+                    "length of channel {} ({}) must match length of "
+                    "channel 0 ({})".format(i, len(samples[i]),
+                                            len(samples[0])))
+        self._run(lambda i, encoder: encoder.write(
+            samples[self._starts[i]:self._starts[i + 1]]))
+
+    def flush(self):
+        """
+        Write pending data to the output files.
+
+        See `Encoder.flush`.
+
+        Raises
+        ------
+        plibflac.Error
+            If an error occurred while encoding the output data.
+        """
+        self._run(lambda i, encoder: encoder.flush())
+
+    def close(self):
+        """
+        Finish encoding and close all of the shards.
+
+        Files that were passed as file objects are not closed.
+
+        Raises
+        ------
+        plibflac.Error
+            If an error occurred while encoding the remaining output
+            data.
+        """
+        try:
+            if self._encoders:
+                self._run(lambda i, encoder: encoder.close())
+        finally:
+            self._encoders = []
+            if self._executor is not None:
+                self._executor.shutdown()
+                self._executor = None
+
+    def _run(self, function):
+        # Call function(index, encoder) for every shard, in parallel.
+        # All calls are run to completion before the first error is
+        # raised.
+        if self._executor is None:
+            for i, encoder in enumerate(self._encoders):
+                function(i, encoder)
+        else:
+            futures = [self._executor.submit(function, i, encoder)
+                       for i, encoder in enumerate(self._encoders)]
+            for future in futures:
+                future.result()
+
+
+class GroupDecoder:
+    """
+    Decoder for a record divided into a group of FLAC files.
+
+    A GroupDecoder object reads a group of FLAC files (shards), each
+    containing some of the channels of a record, as if they were a
+    single stream.  The channels of the first shard are numbered
+    first, followed by the channels of the second shard, and so on.
+    Groups of files created by `GroupEncoder` can be read in this way.
+
+    The metadata of every shard is read when the GroupDecoder is
+    created.  The shards must all have the same sampling frequency and
+    length.  A shard is only opened and decoded when its channels are
+    first requested, and when samples are read from several shards,
+    the shards are decoded in parallel.
+
+    To ensure resources are cleaned up, call `close` when the decoder
+    is no longer needed, or use a ``with`` statement.
+
+    Parameters
+    ----------
+    files : iterable of path-like objects or binary file objects
+        The input shards, in order.  File objects must be seekable.
+    errors : str, optional
+        Error handling mode; may be set to ``'strict'``, ``'warn'``,
+        or ``'ignore'``.  See `Decoder`.
+
+    Attributes
+    ----------
+    channels : int
+        The total number of channels in all shards.
+    shard_channels : list of int
+        The number of channels in each shard.
+    bits_per_sample : list of int
+        The resolution of each shard.
+    sample_rate : int
+        The sampling frequency of the input streams, in samples per
+        second.
+    total_samples : int
+        The length of the input streams, in samples, or zero if
+        unknown.
+
+    Raises
+    ------
+    plibflac.Error
+        If an input does not begin with a valid FLAC header, or the
+        shards do not match.
+    ValueError
+        If `files` is empty.
+    """
+
+    def __init__(self, files, *, errors='strict'):
+        self._files = list(files)
+        if not self._files:
+            raise ValueError("at least one file is required")
+        self._errors = errors
+        self._decoders = [None] * len(self._files)
+        self._shard_positions = [0] * len(self._files)
+        self._executor = None
+        self._position = 0
+
+        info = None
+        self._positions = []
+        self.shard_channels = []
+        self.bits_per_sample = []
+        for index, file in enumerate(self._files):
+            if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+                self._positions.append(None)
+                with open(file, 'rb') as fileobj:
+                    blocks, _ = _metadata.read_blocks(fileobj)
+            else:
+                self._positions.append(file.tell())
+                try:
+                    blocks, _ = _metadata.read_blocks(file)
+                finally:
+                    file.seek(self._positions[-1])
+            shard_info = _metadata.unpack_streaminfo(blocks[0][2])
+            if info is None:
+                info = shard_info
+            elif any(shard_info[key] != info[key]
+                     for key in ('sample_rate', 'total_samples')):
+                raise _plibflac.Error("format of shard {} does not match"
+                                      .format(index))
+            self.shard_channels.append(shard_info['channels'])
+            self.bits_per_sample.append(shard_info['bits_per_sample'])
+
+        self._starts = [0]
+        for n in self.shard_channels:
+            self._starts.append(self._starts[-1] + n)
+        self.channels = self._starts[-1]
+        self.sample_rate = info['sample_rate']
+        self.total_samples = info['total_samples']
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def close(self):
+        """
+        Close all open shards.
+
+        Files that were passed as file objects are not closed.
+        """
+        for index, decoder in enumerate(self._decoders):
+            if decoder is not None:
+                decoder.close()
+                self._decoders[index] = None
+        if self._executor is not None:
+            self._executor.shutdown()
+            self._executor = None
+        self._files = []
+
+    def read(self, n_samples, channels=None, *, interleave=False):
+        """
+        Read and decode up to `n_samples` samples of each channel.
+
+        Only the shards containing the requested channels are decoded.
+
+        Parameters
+        ----------
+        n_samples : int
+            Maximum number of samples to return for each channel.
+        channels : list of int, optional
+            Channel numbers to return.  By default, all channels are
+            returned.
+        interleave : bool, optional
+            True to return a single two-dimensional array, with one
+            row per sample number and one column per channel.
+
+        Returns
+        -------
+        tuple of memoryviews, memoryview, or None
+            Arrays of decoded samples for each requested channel (or a
+            single array, if `interleave` is true), or None at the end
+            of the input streams.
+
+        Raises
+        ------
+        plibflac.Error
+            If an input stream is invalid and cannot be decoded, or
+            if the shards have different lengths.
+        """
+        if not self._files:
+            raise ValueError("I/O operation on closed decoder")
+        if channels is None:
+            channels = range(self.channels)
+        locations = []
+        for c in channels:
+            if not 0 <= c < self.channels:
+                raise ValueError("channel {} out of range".format(c))
+            index = bisect.bisect_right(self._starts, c) - 1
+            locations.append((index, c - self._starts[index]))
+        shards = sorted(set(index for index, _ in locations))
+        if not shards or (self.total_samples
+                          and self._position >= self.total_samples):
+            return None
+
+        def _read(index):
+            samples = self._open(index).read(n_samples)
+            if samples is not None:
+                self._shard_positions[index] += len(samples[0])
+            return samples
+
+        if len(shards) == 1:
+            results = {shards[0]: _read(shards[0])}
+        else:
+            if self._executor is None:
+                self._executor = concurrent.futures.ThreadPoolExecutor(
+                    len(self._files))
+            futures = [self._executor.submit(_read, index)
+                       for index in shards]
+            results = dict(zip(shards, (f.result() for f in futures)))
+
+        lengths = set(0 if samples is None else len(samples[0])
+                      for samples in results.values())
+        if len(lengths) != 1:
+            raise _plibflac.Error("shards have different lengths")
+        length = lengths.pop()
+        self._position += length
+        if length == 0:
+            return None
+
+        columns = [results[index][c] for index, c in locations]
+        if not interleave:
+            return tuple(columns)
+        data = array.array('i', bytes(4 * length * len(columns)))
+        for i, column in enumerate(columns):
+            data[i::len(columns)] = array.array('i', column.tobytes())
+        return memoryview(data).cast('B').cast('i', (length, len(columns)))
+
+    def seek(self, sample_number):
+        """
+        Jump to a given sample number.
+
+        Each shard is positioned when its channels are next read.
+
+        Parameters
+        ----------
+        sample_number : int
+            New input sample number.
+
+        Raises
+        ------
+        plibflac.Error
+            If the given sample number is beyond the end of the input
+            streams, or if an input stream is invalid and cannot be
+            decoded.
+        """
+        if not self._files:
+            raise ValueError("I/O operation on closed decoder")
+        if sample_number < 0:
+            raise ValueError("sample_number must be non-negative")
+        if self.total_samples and sample_number > self.total_samples:
+            raise _plibflac.Error("sample number {} is beyond the end "
+                                  "of the stream".format(sample_number))
+        self._position = sample_number
+
+    def _open(self, index):
+        # Return the decoder for a shard, opening it if necessary, and
+        # move it to the current position.
+        decoder = self._decoders[index]
+        if decoder is None:
+            file = self._files[index]
+            if self._positions[index] is not None:
+                file.seek(self._positions[index])
+            decoder = Decoder(file, errors=self._errors)
+            try:
+                decoder.read_metadata()
+            except BaseException:
+                decoder.close()
+                raise
+            self._decoders[index] = decoder
+            self._shard_positions[index] = 0
+        if self._shard_positions[index] != self._position:
+            decoder.seek(self._position)
+            self._shard_positions[index] = self._position
+        return decoder
@@ -0,0 +1,258 @@
+"""
+Internal functions for reading and writing FLAC metadata blocks.
+"""
+
+import array
+import io
+import struct
+import sys
+
+from _plibflac import Error
+
+STREAMINFO = 0
+PADDING = 1
+APPLICATION = 2
+SEEKTABLE = 3
+VORBIS_COMMENT = 4
+
+STREAMINFO_LENGTH = 34
+
+# Smallest block size allowed, except for the last frame of a stream.
+MIN_BLOCKSIZE = 16
+
+SEEKPOINT_PLACEHOLDER = 0xffffffffffffffff
+
+MAX_BLOCK_LENGTH = 0xffffff
+
+# Envelope (APPLICATION block) format: a header ('<BBBBIQ': version,
+# channels, value size in bytes, reduction factor, samples per
+# interval of the first level, total samples), followed by one or more
+# levels.  Level k contains the minimum and maximum of each channel
+# over each interval of (interval * factor**k) samples, as
+# little-endian signed integers, ordered by interval and then by
+# channel.  The last level contains a single interval.
+ENVELOPE_ID = b'plEv'
+ENVELOPE_VERSION = 1
+ENVELOPE_FACTOR = 4
+_ENVELOPE_HEADER = struct.Struct('<BBBBIQ')
+
+
+def unpack_streaminfo(data):
+    # Decode the contents of a STREAMINFO block.
+    (min_blocksize, max_blocksize, framesizes, fmt,
+     md5sum) = struct.unpack('>HH6sQ16s', data[:STREAMINFO_LENGTH])
+    framesizes = int.from_bytes(framesizes, 'big')
+    return {
+        'min_blocksize': min_blocksize,
+        'max_blocksize': max_blocksize,
+        'min_framesize': framesizes >> 24,
+        'max_framesize': framesizes & 0xffffff,
+        'sample_rate': fmt >> 44,
+        'channels': ((fmt >> 41) & 7) + 1,
+        'bits_per_sample': ((fmt >> 36) & 31) + 1,
+        'total_samples': fmt & 0xfffffffff,
+        'md5sum': md5sum,
+    }
+
+
+def pack_streaminfo(info):
+    # Encode the contents of a STREAMINFO block.
+    framesizes = (info['min_framesize'] << 24) | info['max_framesize']
+    total_samples = info['total_samples']
+    if total_samples > 0xfffffffff:
+        total_samples = 0
+    fmt = ((info['sample_rate'] << 44)
+           | ((info['channels'] - 1) << 41)
+           | ((info['bits_per_sample'] - 1) << 36)
+           | total_samples)
+    return struct.pack('>HH6sQ16s', info['min_blocksize'],
+                       info['max_blocksize'], framesizes.to_bytes(6, 'big'),
+                       fmt, info['md5sum'])
+
+
+def read_blocks(fileobj, offset=None):
+    # Read the metadata blocks from the current position of a FLAC
+    # stream.  Return a list of (block_type, offset, data) for each
+    # block, and the offset of the first frame.  If the file is not
+    # seekable, `offset` must be the current position.
+    if offset is None:
+        offset = fileobj.tell()
+    if fileobj.read(4) != b'fLaC':
+        raise Error("not a FLAC stream")
+    offset += 4
+    blocks = []
+    is_last = False
+    while not is_last:
+        header = fileobj.read(4)
+        if len(header) < 4:
+            raise Error("unexpected end of metadata")
+        header = int.from_bytes(header, 'big')
+        is_last = bool(header & 0x80000000)
+        block_type = (header >> 24) & 0x7f
+        length = header & 0xffffff
+        data = fileobj.read(length)
+        if len(data) < length:
+            raise Error("unexpected end of metadata")
+        blocks.append((block_type, offset + 4, data))
+        offset += 4 + length
+    if not blocks or blocks[0][0] != STREAMINFO:
+        raise Error("STREAMINFO block is missing")
+    return blocks, offset
+
+
+def unpack_seektable(data):
+    # Decode the contents of a SEEKTABLE block, as a list of
+    # (sample_number, stream_offset, frame_samples) tuples.
+    return [struct.unpack('>QQH', data[i:i + 18])
+            for i in range(0, len(data) - 17, 18)]
+
+
+def pack_seektable(points):
+    # Encode the contents of a SEEKTABLE block.
+    return b''.join(struct.pack('>QQH', *point) for point in points)
+
+
+def pack_blocks(blocks):
+    # Encode a list of (block_type, data) as a complete metadata
+    # header, including the 'fLaC' signature.
+    parts = [b'fLaC']
+    for i, (block_type, data) in enumerate(blocks):
+        if len(data) > MAX_BLOCK_LENGTH:
+            raise ValueError("metadata block is too large")
+        is_last = (i == len(blocks) - 1)
+        header = (is_last << 31) | (block_type << 24) | len(data)
+        parts.append(header.to_bytes(4, 'big'))
+        parts.append(data)
+    return b''.join(parts)
+
+
+def rewrite_blocks(fileobj, stream_start, audio_start, blocks,
+                   chunk_size=1 << 20):
+    # Replace the metadata of the stream starting at `stream_start`,
+    # moving the frames if the size of the metadata changes.  Return
+    # the new offset of the first frame.
+    header = pack_blocks(blocks)
+    delta = stream_start + len(header) - audio_start
+    if delta != 0:
+        end = fileobj.seek(0, io.SEEK_END)
+        if delta > 0:
+            pos = end
+            while pos > audio_start:
+                n = min(chunk_size, pos - audio_start)
+                pos -= n
+                fileobj.seek(pos)
+                data = fileobj.read(n)
+                fileobj.seek(pos + delta)
+                fileobj.write(data)
+        else:
+            pos = audio_start
+            while pos < end:
+                fileobj.seek(pos)
+                data = fileobj.read(chunk_size)
+                fileobj.seek(pos + delta)
+                fileobj.write(data)
+                pos += len(data)
+            fileobj.truncate(end + delta)
+    fileobj.seek(stream_start)
+    fileobj.write(header)
+    return audio_start + delta
+
+
+def _envelope_counts(count, factor):
+    # Number of intervals in each level of an envelope.
+    counts = [count]
+    while count > 1:
+        count = -(-count // factor)
+        counts.append(count)
+    return counts
+
+
+def envelope_length(channels, bits_per_sample, interval, total_samples):
+    # Size of the APPLICATION block data for an envelope.
+    value_size = 2 if bits_per_sample <= 16 else 4
+    count = -(-total_samples // interval)
+    while True:
+        counts = _envelope_counts(count, ENVELOPE_FACTOR)
+        length = (len(ENVELOPE_ID) + _ENVELOPE_HEADER.size
+                  + sum(counts) * channels * 2 * value_size)
+        if length <= MAX_BLOCK_LENGTH or count <= 1:
+            return length
+        count = -(-count // ENVELOPE_FACTOR)
+
+
+def _reduce_envelope(values, channels, factor):
+    # Combine each group of `factor` intervals into one.
+    stride = 2 * channels
+    count = len(values) // stride
+    new_count = -(-count // factor)
+    result = array.array('i', [0]) * (new_count * stride)
+    for k in range(stride):
+        column = values[k::stride]
+        pick = max if k % 2 else min
+        reduced = array.array('i', map(pick, *(column[i::factor]
+                                               for i in range(factor))))
+        if count % factor:
+            reduced.append(pick(column[count - count % factor:]))
+        result[k::stride] = reduced
+    return result
+
+
+def pack_envelope(values, channels, bits_per_sample, interval,
+                  total_samples):
+    # Encode the APPLICATION block data for an envelope, given the
+    # minimum and maximum for each interval of `interval` samples.
+    # If the result would be too large, the first levels are omitted.
+    value_size = 2 if bits_per_sample <= 16 else 4
+    levels = [values]
+    while len(levels[-1]) > 2 * channels:
+        levels.append(_reduce_envelope(levels[-1], channels,
+                                       ENVELOPE_FACTOR))
+    header_length = len(ENVELOPE_ID) + _ENVELOPE_HEADER.size
+    while (len(levels) > 1 and MAX_BLOCK_LENGTH < header_length
+           + sum(len(level) for level in levels) * value_size):
+        levels.pop(0)
+        interval *= ENVELOPE_FACTOR
+
+    parts = [ENVELOPE_ID, _ENVELOPE_HEADER.pack(
+        ENVELOPE_VERSION, channels, value_size, ENVELOPE_FACTOR,
+        interval, total_samples)]
+    for level in levels:
+        if value_size == 2:
+            level = array.array('h', level)
+        if sys.byteorder == 'big':
+            level = array.array(level.typecode, level)
+            level.byteswap()
+        parts.append(level.tobytes())
+    return b''.join(parts)
+
+
+def unpack_envelope(data):
+    # Decode the contents of an envelope APPLICATION block (not
+    # including the application ID.)  Return a dictionary, or None if
+    # the format is not supported.
+    if len(data) < _ENVELOPE_HEADER.size:
+        return None
+    (version, channels, value_size, factor, interval,
+     total_samples) = _ENVELOPE_HEADER.unpack_from(data)
+    if (version != ENVELOPE_VERSION or value_size not in (2, 4)
+            or channels < 1 or factor < 2 or interval < 1):
+        return None
+    pos = _ENVELOPE_HEADER.size
+    levels = []
+    for count in _envelope_counts(-(-total_samples // interval), factor):
+        size = count * channels * 2 * value_size
+        if pos + size > len(data):
+            return None
+        level = array.array('h' if value_size == 2 else 'i')
+        level.frombytes(data[pos:pos + size])
+        if sys.byteorder == 'big':
+            level.byteswap()
+        levels.append(level)
+        pos += size
+    return {
+        'channels': channels,
+        'factor': factor,
+        'interval': interval,
+        'total_samples': total_samples,
+        'levels': levels,
+    }
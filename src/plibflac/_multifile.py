@@ -0,0 +1,259 @@
+"""
+Internal functions for reading records divided into multiple files.
+"""
+
+import bisect
+import concurrent.futures
+
+import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+
+
+class MultiFileDecoder:
+    """
+    Decoder for a series of FLAC files forming one continuous stream.
+
+    A MultiFileDecoder object reads a list of FLAC files (segments),
+    one after another, as if they were a single stream.  The sample
+    numbers used by `seek` count from the start of the first segment.
+
+    The metadata of every segment is read when the MultiFileDecoder is
+    created, to find the sample number where each segment begins.  The
+    segments must all have the same number of channels, resolution,
+    and sampling frequency, and the length of every segment except the
+    last must be recorded in its metadata.
+
+    While one segment is being read, the next segment is opened in a
+    background thread, so that reading across the boundary does not
+    need to wait for it.
+
+    To ensure resources are cleaned up, call `close` when the decoder
+    is no longer needed, or use a ``with`` statement.
+
+    Parameters
+    ----------
+    files : iterable of path-like objects or binary file objects
+        The input segments, in order.  File objects must be seekable.
+    errors : str, optional
+        Error handling mode; may be set to ``'strict'``, ``'warn'``,
+        or ``'ignore'``.  See `Decoder`.
+    prefetch : bool, optional
+        True to open the next segment in the background.
+
+    Attributes
+    ----------
+    channels : int
+        The number of channels in the input stream.
+    bits_per_sample : int
+        The resolution of each sample in the input stream.
+    sample_rate : int
+        The sampling frequency of the input stream, in samples per
+        second.
+    total_samples : int
+        The total length of all segments, in samples, or zero if the
+        length of the last segment is unknown.
+    segment_starts : list of int
+        The sample number where each segment begins.
+
+    Raises
+    ------
+    plibflac.Error
+        If an input does not begin with a valid FLAC header, or the
+        segments do not match.
+    ValueError
+        If `files` is empty.
+    """
+
+    def __init__(self, files, *, errors='strict', prefetch=True):
+        self._files = list(files)
+        if not self._files:
+            raise ValueError("at least one file is required")
+        self._errors = errors
+        self._decoder = None
+        self._index = None
+        self._next = None
+        self._executor = None
+
+        info = None
+        self.segment_starts = []
+        self._positions = []
+        start = 0
+        for index, file in enumerate(self._files):
+            if start is None:
+                raise _plibflac.Error("length of segment {} is unknown"
+                                      .format(index - 1))
+            if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+                self._positions.append(None)
+            else:
+                self._positions.append(file.tell())
+            segment_info = _read_streaminfo(file)
+            if info is None:
+                info = segment_info
+            elif any(segment_info[key] != info[key]
+                     for key in ('channels', 'bits_per_sample',
+                                 'sample_rate')):
+                raise _plibflac.Error("format of segment {} does not match"
+                                      .format(index))
+            self.segment_starts.append(start)
+            if segment_info['total_samples']:
+                start += segment_info['total_samples']
+            else:
+                start = None
+
+        self.channels = info['channels']
+        self.bits_per_sample = info['bits_per_sample']
+        self.sample_rate = info['sample_rate']
+        self.total_samples = start or 0
+
+        if prefetch and len(self._files) > 1:
+            self._executor = concurrent.futures.ThreadPoolExecutor(1)
+        self._switch(0)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def close(self):
+        """
+        Close all open segments.
+
+        Files that were passed as file objects are not closed.
+        """
+        if self._next is not None:
+            _discard(self._next)
+            self._next = None
+        if self._decoder is not None:
+            self._decoder.close()
+            self._decoder = None
+        if self._executor is not None:
+            self._executor.shutdown()
+            self._executor = None
+
+    def read(self, n_samples):
+        """
+        Read and decode up to `n_samples` samples of each channel.
+
+        Samples are read from the following segments as needed.
+
+        Parameters
+        ----------
+        n_samples : int
+            Maximum number of samples to return for each channel.
+
+        Returns
+        -------
+        tuple of memoryviews, or None
+            Arrays of decoded samples for each channel, or None at the
+            end of the last segment.
+
+        Raises
+        ------
+        plibflac.Error
+            If an input stream is invalid and cannot be decoded.
+        """
+        if self._decoder is None:
+            raise ValueError("I/O operation on closed decoder")
+        parts = []
+        remaining = n_samples
+        while remaining > 0:
+            samples = self._decoder.read(remaining)
+            if samples is not None:
+                parts.append(samples)
+                remaining -= len(samples[0])
+            if remaining > 0:
+                if self._index + 1 >= len(self._files):
+                    break
+                self._switch(self._index + 1)
+
+        if not parts:
+            return None
+        if len(parts) == 1:
+            return parts[0]
+        return tuple(memoryview(b''.join(channel)).cast('i')
+                     for channel in zip(*parts))
+
+    def seek(self, sample_number):
+        """
+        Jump to a given sample number.
+
+        Parameters
+        ----------
+        sample_number : int
+            New input sample number (zero is the start of the first
+            segment).
+
+        Raises
+        ------
+        plibflac.Error
+            If the given sample number is beyond the end of the last
+            segment, or if an input stream is invalid and cannot be
+            decoded.
+        """
+        if self._decoder is None:
+            raise ValueError("I/O operation on closed decoder")
+        if sample_number < 0:
+            raise ValueError("sample_number must be non-negative")
+        index = bisect.bisect_right(self.segment_starts, sample_number) - 1
+        if index != self._index:
+            self._switch(index)
+        self._decoder.seek(sample_number - self.segment_starts[index])
+
+    def _switch(self, index):
+        # Make the given segment current, and start opening the one
+        # after it.
+        if self._decoder is not None:
+            self._decoder.close()
+            self._decoder = None
+        if self._next is not None and self._next[0] == index:
+            self._decoder = self._next[1].result()
+        else:
+            if self._next is not None:
+                _discard(self._next)
+            self._decoder = _open(self._files[index],
+                                  self._positions[index], self._errors)
+        self._next = None
+        self._index = index
+
+        if self._executor is not None and index + 1 < len(self._files):
+            self._next = (index + 1, self._executor.submit(
+                _open, self._files[index + 1], self._positions[index + 1],
+                self._errors))
+
+
+def _read_streaminfo(file):
+    # Read the STREAMINFO of a file without moving its position.
+    if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+        with open(file, 'rb') as fileobj:
+            blocks, _ = _metadata.read_blocks(fileobj)
+    else:
+        position = file.tell()
+        try:
+            blocks, _ = _metadata.read_blocks(file)
+        finally:
+            file.seek(position)
+    return _metadata.unpack_streaminfo(blocks[0][2])
+
+
+def _open(file, position, errors):
+    # Open a segment and read its metadata.  If `file` is a file
+    # object, the stream begins at `position`.
+    if position is not None:
+        file.seek(position)
+    decoder = Decoder(file, errors=errors)
+    try:
+        decoder.read_metadata()
+    except BaseException:
+        decoder.close()
+        raise
+    return decoder
+
+
+def _discard(pending):
+    # Close a segment that was being opened in the background.
+    try:
+        pending[1].result().close()
+    except Exception:
+        pass
@@ -0,0 +1,88 @@
+"""
+Internal functions for adding seek tables to existing FLAC files.
+"""
+
+from plibflac import _metadata
+from plibflac._frames import FrameReader
+
+
+def add_seektable(file, interval=None):
+    """
+    Add or replace the seek table of an existing FLAC file.
+
+    The frames of the stream are scanned, without decoding them, to
+    find the position of every `interval`-th sample.  The new
+    SEEKTABLE block replaces any existing seek table.  If the existing
+    metadata has enough padding, the seek table takes its place, and
+    only the metadata at the start of the file is rewritten.
+    Otherwise, the frames are moved to make room (but not encoded
+    again.)
+
+    Parameters
+    ----------
+    file : path-like object or binary file object
+        The FLAC file.  A file object must be readable, writable, and
+        seekable.
+    interval : int, optional
+        Number of samples between seek points (by default, ten
+        seconds.)
+
+    Returns
+    -------
+    int
+        The number of seek points.
+
+    Raises
+    ------
+    plibflac.Error
+        If the input does not contain a valid FLAC stream.
+    ValueError
+        If `interval` is not positive, or the seek table would be too
+        large.
+    """
+    if interval is not None and interval <= 0:
+        raise ValueError("interval must be positive")
+    if isinstance(file, (str, bytes)) or hasattr(file, '__fspath__'):
+        with open(file, 'r+b') as fileobj:
+            return _add_seektable(fileobj, interval)
+    else:
+        return _add_seektable(file, interval)
+
+
+def _add_seektable(fileobj, interval):
+    stream_start = fileobj.tell()
+    with FrameReader(fileobj) as reader:
+        audio_start = reader.audio_start
+        if interval is None:
+            interval = reader.sample_rate * 10
+        points = []
+        for frame in reader:
+            # Add a seek point if this frame contains a multiple of
+            # interval.
+            end = frame.sample_number + frame.blocksize
+            if (-(-frame.sample_number // interval)
+                    < -(-end // interval)):
+                points.append((frame.sample_number,
+                               frame.offset - audio_start,
+                               frame.blocksize))
+
+    fileobj.seek(stream_start)
+    blocks, _ = _metadata.read_blocks(fileobj)
+
+    # Replace the existing seek table and padding.  Any space left
+    # over becomes padding at the end of the metadata, if possible.
+    spare = 0
+    new_blocks = []
+    for block_type, _, data in blocks:
+        if block_type in (_metadata.SEEKTABLE, _metadata.PADDING):
+            spare += 4 + len(data)
+        else:
+            new_blocks.append((block_type, data))
+    seektable = _metadata.pack_seektable(points)
+    new_blocks.insert(1, (_metadata.SEEKTABLE, seektable))
+    spare -= 4 + len(seektable)
+    if spare >= 4:
+        new_blocks.append((_metadata.PADDING, bytes(spare - 4)))
+
+    _metadata.rewrite_blocks(fileobj, stream_start, audio_start, new_blocks)
+    return len(points)
@@ -0,0 +1,111 @@
+"""
+Internal functions for reading from many files at once.
+"""
+
+import concurrent.futures
+import os
+
+import _plibflac
+from plibflac._decoder import Decoder
+
+# Number of samples to decode at once.
+_CHUNK_SIZE = 1 << 16
+
+
+def read_stacked(paths, start, stop, *, channels=None, threads=None):
+    """
+    Read the same range of samples from many FLAC files.
+
+    The files are decoded in parallel, and the samples from `start` to
+    `stop` are stored in a single three-dimensional array, indexed by
+    file number, channel number, and sample number (relative to
+    `start`).  Samples that cannot be read (because a file is too
+    short, or cannot be read at all) are set to zero.
+
+    Parameters
+    ----------
+    paths : iterable of path-like objects
+        The input files.
+    start : int
+        Starting sample number.
+    stop : int
+        Ending sample number (exclusive).
+    channels : list of int, optional
+        Channel numbers to read from each file.  By default, all of
+        the channels of the first file are read.
+    threads : int, optional
+        Number of worker threads (by default, the number of CPUs.)
+
+    Returns
+    -------
+    data : memoryview
+        Array of 32-bit integers, whose shape is ``(len(paths),
+        len(channels), stop - start)``.
+    status : list
+        For each file, either the number of samples that were read
+        (less than ``stop - start`` if the file is too short), or the
+        exception that was raised if the file could not be read.
+
+    Raises
+    ------
+    ValueError
+        If `start` or `stop` is negative.
+    """
+    if start < 0 or stop < 0:
+        raise ValueError("start and stop must be non-negative")
+    if threads is None:
+        threads = os.cpu_count() or 1
+    paths = list(paths)
+    length = max(stop - start, 0)
+
+    if channels is None:
+        channels = []
+        for path in paths:
+            try:
+                with Decoder(path) as decoder:
+                    channels = list(range(decoder.channels))
+                break
+            except (OSError, _plibflac.Error):
+                pass
+    channels = list(channels)
+
+    size = len(paths) * len(channels) * length
+    data = memoryview(bytearray(4 * size)).cast('i')
+    with concurrent.futures.ThreadPoolExecutor(threads) as executor:
+        futures = [executor.submit(_read_file, path, start, length, channels,
+                                   data, index * len(channels) * length)
+                   for index, path in enumerate(paths)]
+        status = []
+        for future in futures:
+            try:
+                status.append(future.result())
+            except (OSError, ValueError, _plibflac.Error) as exc:
+                status.append(exc)
+
+    if size > 0:
+        data = data.cast('B').cast('i', (len(paths), len(channels), length))
+    return data, status
+
+
+def _read_file(path, start, length, channels, data, offset):
+    # Read samples from one file into data[offset:].  Return the
+    # number of samples read.
+    count = 0
+    with Decoder(path, frame_cache=0) as decoder:
+        for c in channels:
+            if not 0 <= c < decoder.channels:
+                raise ValueError("channel {} out of range".format(c))
+        if length == 0 or (decoder.total_samples
+                           and start >= decoder.total_samples):
+            return 0
+        decoder.seek(start)
+        while count < length:
+            samples = decoder.read(min(length - count, _CHUNK_SIZE))
+            if samples is None:
+                break
+            n = len(samples[0])
+            for i, c in enumerate(channels):
+                pos = offset + i * length + count
+                data[pos:pos + n] = samples[c]
+            count += n
+    return count
@@ -0,0 +1,222 @@
+"""
+Internal functions for checking the integrity of FLAC files.
+"""
+
+import collections
+import concurrent.futures
+import hashlib
+import io
+import os
+
+import _plibflac
+from plibflac import _metadata
+from plibflac._decoder import Decoder
+
+# Large files are divided into segments of approximately this many
+# bytes, which are decoded in parallel.
+_SEGMENT_SIZE = 1 << 22
+
+
+def verify(paths, *, threads=None):
+    """
+    Check the integrity of one or more FLAC files.
+
+    Each file is decoded completely, without returning any samples,
+    to check the CRC of every frame and the MD5 signature of the
+    stream.  Files are checked in parallel.  Large files are also
+    divided at frame boundaries into segments that are decoded in
+    parallel; the segments' samples are then added to the MD5 hash in
+    order.  If any errors are found in a large file, the whole file is
+    checked again sequentially, so that errors are reported in the
+    same way as by `Decoder.verify`.
+
+    Parameters
+    ----------
+    paths : iterable of path-like objects
+        The input files.
+    threads : int, optional
+        Number of worker threads (by default, the number of CPUs.)
+
+    Returns
+    -------
+    list of dict
+        The result for each input file, in the same order as `paths`.
+        See `Decoder.verify` for details.  A file that is not a valid
+        FLAC stream is reported as an error at offset zero.
+
+    Raises
+    ------
+    OSError
+        If an input file cannot be opened or read.
+    """
+    if threads is None:
+        threads = os.cpu_count() or 1
+    paths = list(paths)
+    results = [None] * len(paths)
+    tasks = _tasks(paths, threads)
+    with concurrent.futures.ThreadPoolExecutor(threads) as executor:
+        # Results are consumed in order, so limit the number of
+        # pending tasks to avoid holding too many segments in memory.
+        pending = collections.deque()
+        state = None
+        while True:
+            while len(pending) < 2 * threads:
+                task = next(tasks, None)
+                if task is None:
+                    break
+                index, info, is_last, function, args = task
+                pending.append((index, info, is_last,
+                                executor.submit(function, *args)))
+            if not pending:
+                break
+            index, info, is_last, future = pending.popleft()
+            result = future.result()
+            if info is None:
+                results[index] = result
+                continue
+
+            # Segment of a large file: combine the results in order.
+            samples, errors, data = result
+            if state is None:
+                state = {'samples': 0, 'errors': [], 'md5': hashlib.md5()}
+            state['samples'] += samples
+            state['errors'] += errors
+            if data is not None:
+                state['md5'].update(data)
+            if is_last:
+                results[index] = _finish(paths[index], info, state)
+                state = None
+    return results
+
+
+def _tasks(paths, threads):
+    # Generate the tasks for verifying each file, as tuples of (index,
+    # info, is_last, function, args).  `info` is the STREAMINFO of a
+    # file that is divided into segments, or None for a complete file.
+    for index, path in enumerate(paths):
+        if threads > 1 and os.path.getsize(path) > 2 * _SEGMENT_SIZE:
+            try:
+                info, segments = _split(path)
+            except _plibflac.Error:
+                segments = []
+            for i, segment in enumerate(segments):
+                yield (index, info, i == len(segments) - 1,
+                       _verify_segment, (path,) + segment)
+            if segments:
+                continue
+        yield (index, None, True, _verify_file, (path,))
+
+
+def _verify_file(path):
+    # Verify a complete file.
+    decoder = Decoder(path)
+    try:
+        return decoder.verify()
+    except _plibflac.Error as exc:
+        return {
+            'samples': 0,
+            'errors': [(0, 0, str(exc))],
+            'md5': None,
+            'ok': False,
+        }
+    finally:
+        try:
+            decoder.close()
+        except _plibflac.Error:
+            pass
+
+
+def _split(path):
+    # Divide a file into segments at frame boundaries.  Return the
+    # STREAMINFO and a list of (header, start, end, sample_format) for
+    # each segment, where `header` is the metadata
+    # of a stream that can be used to decode the segment in isolation.
+    with open(path, 'rb') as fileobj:
+        blocks, audio_start = _metadata.read_blocks(fileobj)
+        info = _metadata.unpack_streaminfo(blocks[0][2])
+        end = fileobj.seek(0, io.SEEK_END)
+        bounds = [audio_start]
+        pos = audio_start + _SEGMENT_SIZE
+        while pos < end - _SEGMENT_SIZE:
+            frame_start = _find_frame(fileobj, pos, end, info)
+            if frame_start is None:
+                break
+            bounds.append(frame_start)
+            pos = frame_start + _SEGMENT_SIZE
+    bounds.append(end)
+
+    header = _metadata.pack_blocks([(
+        _metadata.STREAMINFO,
+        _metadata.pack_streaminfo(dict(info, md5sum=bytes(16),
+                                       total_samples=0)),
+    )])
+    if info['md5sum'] == bytes(16):
+        sample_format = None
+    else:
+        sample_format = ((info['bits_per_sample'] + 7) // 8, False, False, 0)
+    segments = [(header, start, next_start, sample_format)
+                for start, next_start in zip(bounds, bounds[1:])]
+    return info, segments
+
+
+def _find_frame(fileobj, pos, end, info):
+    # Find the first frame header at or after `pos` that is consistent
+    # with the STREAMINFO.  Return its offset, or None if there is
+    # none.
+    size = max(info['max_framesize'] * 2, 65536)
+    while pos < end:
+        fileobj.seek(pos)
+        data = fileobj.read(min(size, end - pos))
+        limit = len(data) - 16 if pos + len(data) < end else len(data)
+        i = data.find(b'\xff', 0, limit)
+        while i >= 0:
+            header = _plibflac.parse_frame_header(data[i:i + 16])
+            if header is not None:
+                (variable_blocksize, number, blocksize, sample_rate,
+                 channels, bits_per_sample) = header[:6]
+                if not variable_blocksize:
+                    number *= info['max_blocksize']
+                if (channels == info['channels']
+                        and bits_per_sample in (0, info['bits_per_sample'])
+                        and sample_rate in (0, info['sample_rate'])
+                        and blocksize <= info['max_blocksize']
+                        and (number < info['total_samples']
+                             or info['total_samples'] == 0)):
+                    return pos + i
+            i = data.find(b'\xff', i + 1, limit)
+        if limit <= 0:
+            break
+        pos += limit
+    return None
+
+
+def _verify_segment(path, header, start, end, sample_format):
+    # Verify one segment of a file.  Return the number of samples, a
+    # list of errors, and the decoded samples (if sample_format is
+    # not None.)
+    with open(path, 'rb') as fileobj:
+        fileobj.seek(start)
+        data = fileobj.read(end - start)
+    with Decoder(io.BytesIO(header + data)) as decoder:
+        return decoder._check(sample_format)
+
+
+def _finish(path, info, state):
+    # Combine the results of verifying each segment of a file.
+    total_samples = info['total_samples']
+    if state['errors'] or (total_samples
+                           and state['samples'] != total_samples):
+        # A damaged frame may be handled differently when a segment
+        # is decoded in isolation.  Verify the whole file to report
+        # the same errors as Decoder.verify.
+        return _verify_file(path)
+    if info['md5sum'] == bytes(16):
+        md5 = None
+    else:
+        md5 = (state['md5'].digest() == info['md5sum'])
+    return {
+        'samples': state['samples'],
+        'errors': [],
+        'md5': md5,
+        'ok': md5 is not False,
+    }
@@ -6,12 +6,30 @@ Test cases for decoding using plibflac.
 
 import io
 import os
+import tempfile
 import threading
+import time
 import unittest
 
 import plibflac
 
 
+class _CountingBytesIO(io.BytesIO):
+    def __init__(self, data):
+        super().__init__(data)
+        self.bytes_read = 0
+
+    def read(self, size=-1):
+        data = super().read(size)
+        self.bytes_read += len(data)
+        return data
+
+    def readinto(self, buffer):
+        n = super().readinto(buffer)
+        self.bytes_read += n
+        return n
+
+
 class TestDecoder(unittest.TestCase):
     def test_read_null(self):
         """
@@ -134,6 +152,64 @@ class TestDecoder(unittest.TestCase):
                     decoder.seek(0)
             t.join()
 
+    def test_read_nonblocking(self):
+        """
+        Test reading from non-blocking streams.
+        """
+        with open(self.data_path('100s.flac'), 'rb') as fileobj:
+            flac_data = fileobj.read()
+        with plibflac.Decoder(io.BytesIO(flac_data)) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+
+        class _NonBlockingStream(io.RawIOBase):
+            def __init__(self):
+                self.data = bytearray()
+                self.finished = False
+
+            def readable(self):
+                return True
+
+            def readinto(self, buffer):
+                if not self.data:
+                    return 0 if self.finished else None
+                n = min(len(buffer), len(self.data))
+                buffer[:n] = self.data[:n]
+                del self.data[:n]
+                return n
+
+        def _test(decoder, write, finish):
+            result = [[] for _ in expected]
+            with self.assertRaises(BlockingIOError):
+                decoder.read_metadata()
+            for pos in range(0, len(flac_data), 7777):
+                write(flac_data[pos:pos + 7777])
+                if pos == 0:
+                    decoder.read_metadata()
+                    self.assertEqual(decoder.channels, 2)
+                while True:
+                    try:
+                        samples = decoder.read(5000)
+                    except BlockingIOError:
+                        break
+                    self.assertIsNotNone(samples)
+                    for i, x in enumerate(samples):
+                        result[i] += x
+            finish()
+            self.assertIsNone(decoder.read(5000))
+            self.assertEqual(result, expected)
+
+        stream = _NonBlockingStream()
+        with plibflac.Decoder(stream, nonblocking=True) as decoder:
+            _test(decoder, stream.data.extend,
+                  lambda: setattr(stream, 'finished', True))
+
+        rfd, wfd = os.pipe()
+        os.set_blocking(rfd, False)
+        with open(rfd, 'rb', buffering=0) as rpipe, \
+             open(wfd, 'wb', buffering=0) as wpipe:
+            with plibflac.Decoder(rpipe, nonblocking=True) as decoder:
+                _test(decoder, wpipe.write, wpipe.close)
+
     def _test_read_sequential(self, decoder):
         # Samples 0 to 10 (unbuffered)
         samples = decoder.read(10)
@@ -215,6 +291,380 @@ class TestDecoder(unittest.TestCase):
         for s1a, s1b, s2 in zip(samples_1a, samples_1b, samples_2):
             self.assertEqual(list(s1a) + list(s1b), list(s2))
 
+    def test_read_cached(self):
+        """
+        Test seeking to recently decoded frames.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac'),
+                              frame_cache=0) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+        total = len(expected[0])
+
+        with plibflac.Decoder(self.data_path('100s.flac'),
+                              frame_cache=2) as decoder:
+            # Overlapping windows, crossing frame boundaries
+            for start in range(0, 20000, 1500):
+                decoder.seek(start)
+                samples = decoder.read(3000)
+                self.assertEqual([list(x) for x in samples],
+                                 [x[start:start + 3000] for x in expected])
+
+            # Cached frames followed by frames that are not cached
+            decoder.seek(100)
+            samples = decoder.read(30000)
+            self.assertEqual([list(x) for x in samples],
+                             [x[100:30100] for x in expected])
+            decoder.seek(29000)
+            self.assertEqual(decoder.skip(total), total - 29000)
+
+            # Cached frames at the end of the stream
+            decoder.seek(total - 5000)
+            samples = decoder.read(10000)
+            self.assertEqual([list(x) for x in samples],
+                             [x[-5000:] for x in expected])
+            decoder.seek(0)
+            decoder.read(10)
+            decoder.seek(total - 10)
+            samples = decoder.read(10000)
+            self.assertEqual([list(x) for x in samples],
+                             [x[-10:] for x in expected])
+            self.assertIsNone(decoder.read(10))
+
+        # Seeking back after reading sequentially does not read the
+        # file again
+        with open(self.data_path('100s.flac'), 'rb') as fileobj:
+            data = fileobj.read()
+        for frame_cache in (0, 2):
+            fileobj = _CountingBytesIO(data)
+            with plibflac.Decoder(fileobj, frame_cache=frame_cache) as decoder:
+                decoder.read(10000)
+                bytes_read = fileobj.bytes_read
+                for start in (9000, 8500, 8192):
+                    decoder.seek(start)
+                    samples = decoder.read(500)
+                    self.assertEqual([list(x) for x in samples],
+                                     [x[start:start + 500] for x in expected])
+                self.assertEqual(fileobj.bytes_read, bytes_read)
+                if frame_cache:
+                    decoder.seek(5000)
+                    samples = decoder.read(1000)
+                    self.assertEqual([list(x) for x in samples],
+                                     [x[5000:6000] for x in expected])
+                    self.assertEqual(fileobj.bytes_read, bytes_read)
+                samples = decoder.read(20000)
+                self.assertEqual([list(x) for x in samples],
+                                 [x[8692:28692] if not frame_cache
+                                  else x[6000:26000] for x in expected])
+
+        # Damaged frames are not cached, so seeking back to them
+        # fails rather than returning silence
+        with plibflac.FrameReader(self.data_path('100s.flac')) as reader:
+            frames = list(reader)
+        damaged = bytearray(data)
+        damaged[frames[3].offset + len(frames[3].data) - 1] ^= 1
+        with plibflac.Decoder(io.BytesIO(damaged), errors='warn') as decoder:
+            decoder.seek(frames[2].sample_number)
+            with self.assertLogs('plibflac', 'WARNING'):
+                decoder.read(4096 * 3)
+            with self.assertRaises(plibflac.Error):
+                decoder.seek(frames[3].sample_number + 100)
+
+    def test_clone(self):
+        """
+        Test reading one file with several independent decoders.
+        """
+        with open(self.data_path('100s.flac'), 'rb') as fileobj:
+            flac_data = fileobj.read()
+        with plibflac.Decoder(io.BytesIO(flac_data)) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+            with self.assertRaises(ValueError):
+                decoder.clone()
+
+        with tempfile.TemporaryFile() as fileobj:
+            fileobj.write(b'junk' + flac_data)
+            fileobj.seek(4)
+            with plibflac.Decoder(fileobj, frame_cache=0) as decoder:
+                self.assertEqual([list(x) for x in decoder.read(1000)],
+                                 [x[:1000] for x in expected])
+                clones = [decoder.clone() for _ in range(4)]
+                results = [None] * len(clones)
+
+                def read_window(index):
+                    with clones[index] as clone:
+                        clone.seek(index * 5000)
+                        results[index] = clone.read(3000)
+
+                threads = [threading.Thread(target=read_window, args=(i,))
+                           for i in range(len(clones))]
+                for thread in threads:
+                    thread.start()
+                for thread in threads:
+                    thread.join()
+                for i, samples in enumerate(results):
+                    self.assertEqual(
+                        [list(x) for x in samples],
+                        [x[i * 5000:i * 5000 + 3000] for x in expected])
+
+                # The original decoder's position is unchanged
+                self.assertEqual([list(x) for x in decoder.read(1000)],
+                                 [x[1000:2000] for x in expected])
+
+        # Decoder opened after a partial read from a buffered file
+        with tempfile.TemporaryDirectory() as tempdir:
+            path = os.path.join(tempdir, 'prefixed.flac')
+            with open(path, 'wb') as fileobj:
+                fileobj.write(bytes(1000) + flac_data)
+            with open(path, 'rb') as fileobj:
+                fileobj.read(1000)
+                with plibflac.Decoder(fileobj) as decoder:
+                    with decoder.clone() as clone:
+                        clone.seek(5000)
+                        self.assertEqual(
+                            [list(x) for x in clone.read(3000)],
+                            [x[5000:8000] for x in expected])
+                    self.assertEqual([list(x) for x in decoder.read(1000)],
+                                     [x[:1000] for x in expected])
+
+    def test_follow(self):
+        """
+        Test reading a file while it is being written.
+        """
+        with open(self.data_path('100s.flac'), 'rb') as fileobj:
+            flac_data = fileobj.read()
+        with plibflac.Decoder(io.BytesIO(flac_data)) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            path = os.path.join(tempdir, 'test.flac')
+
+            # Stream ends in the middle of a frame
+            with open(path, 'wb') as fileobj:
+                fileobj.write(flac_data[:len(flac_data) // 2])
+            with plibflac.Decoder(path, follow=0) as decoder:
+                samples = decoder.read(len(expected[0]))
+                count = len(samples[0])
+                self.assertGreater(count, 0)
+                self.assertLess(count, len(expected[0]))
+                self.assertEqual([list(x) for x in samples],
+                                 [x[:count] for x in expected])
+                self.assertIsNone(decoder.read(1000))
+
+                with open(path, 'ab') as fileobj:
+                    fileobj.write(flac_data[len(flac_data) // 2:])
+                samples = decoder.read(len(expected[0]))
+                self.assertEqual([list(x) for x in samples],
+                                 [x[count:] for x in expected])
+                self.assertIsNone(decoder.read(1000))
+
+            # Skipping past the end of the data written so far
+            with open(path, 'wb') as fileobj:
+                fileobj.write(flac_data[:len(flac_data) // 2])
+            with plibflac.Decoder(path, follow=0) as decoder:
+                count = decoder.skip(len(expected[0]))
+                self.assertGreater(count, 0)
+                self.assertLess(count, len(expected[0]))
+                self.assertEqual(decoder.skip(1000), 0)
+
+                with open(path, 'ab') as fileobj:
+                    fileobj.write(flac_data[len(flac_data) // 2:])
+                self.assertEqual(decoder.skip(1000), 1000)
+                samples = decoder.read(len(expected[0]))
+                self.assertEqual([list(x) for x in samples],
+                                 [x[count + 1000:] for x in expected])
+
+            # Metadata is not written in time
+            with open(path, 'wb') as fileobj:
+                fileobj.write(flac_data[:10])
+            with plibflac.Decoder(path, follow=0) as decoder:
+                with self.assertRaises(BlockingIOError):
+                    decoder.read_metadata()
+                self.assertIsNone(decoder.read(1000))
+                self.assertEqual(decoder.skip(1000), 0)
+
+                with open(path, 'ab') as fileobj:
+                    fileobj.write(flac_data[10:])
+                decoder.read_metadata()
+                self.assertEqual(decoder.total_samples, len(expected[0]))
+                self.assertEqual([list(x) for x in decoder.read(1000)],
+                                 [x[:1000] for x in expected])
+
+            # Stream is written while decoder is waiting
+            with open(path, 'wb') as fileobj:
+                fileobj.write(flac_data[:10])
+
+            def write_data():
+                with open(path, 'ab') as fileobj:
+                    for pos in range(10, len(flac_data), 50000):
+                        time.sleep(0.05)
+                        fileobj.write(flac_data[pos:pos + 50000])
+                        fileobj.flush()
+
+            thread = threading.Thread(target=write_data)
+            thread.start()
+            try:
+                result = [[] for _ in expected]
+                with plibflac.Decoder(path, follow=10) as decoder:
+                    while len(result[0]) < len(expected[0]):
+                        samples = decoder.read(len(expected[0]))
+                        self.assertIsNotNone(samples)
+                        for i, x in enumerate(samples):
+                            result[i] += x
+                self.assertEqual(result, expected)
+            finally:
+                thread.join()
+
+        with self.assertRaises(ValueError):
+            plibflac.Decoder(io.BytesIO(flac_data), follow=1).open()
+
+    def test_shared_cache(self):
+        """
+        Test reading frames decoded by another Decoder.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+
+        plibflac.set_shared_cache_size(1 << 24)
+        try:
+            with plibflac.Decoder(path) as decoder:
+                decoder.seek(100000)
+                decoder.read(50000)
+            info = plibflac.shared_cache_info()
+            self.assertEqual(info['hits'], 0)
+            self.assertGreater(info['frames'], 0)
+
+            # Frames that are cached, followed by frames that are not
+            with plibflac.Decoder(path) as decoder:
+                decoder.seek(110000)
+                samples = decoder.read(100000)
+            self.assertEqual([list(x) for x in samples],
+                             [x[110000:210000] for x in expected])
+            self.assertGreater(plibflac.shared_cache_info()['hits'], 0)
+
+            # Streams that start after the beginning of a file, opened
+            # after reading from a buffered file object
+            with open(path, 'rb') as fileobj:
+                data = fileobj.read()
+            with tempfile.TemporaryDirectory() as tempdir:
+                prefixed_path = os.path.join(tempdir, 'prefixed.flac')
+                with open(prefixed_path, 'wb') as fileobj:
+                    fileobj.write(bytes(1000) + data)
+                for buffering in (0, -1):
+                    hits = plibflac.shared_cache_info()['hits']
+                    with open(prefixed_path, 'rb', buffering) as fileobj:
+                        fileobj.read(1000)
+                        with plibflac.Decoder(fileobj) as decoder:
+                            decoder.seek(4096 * 73)
+                            samples = decoder.read(1000)
+                    self.assertEqual([list(x) for x in samples],
+                                     [x[4096 * 73:4096 * 73 + 1000]
+                                      for x in expected])
+                self.assertGreater(plibflac.shared_cache_info()['hits'], hits)
+
+                # Damaged frames are not shared
+                with plibflac.FrameReader(path) as reader:
+                    frames = list(reader)
+                damaged = bytearray(data)
+                damaged[frames[10].offset + len(frames[10].data) - 1] ^= 1
+                damaged_path = os.path.join(tempdir, 'damaged.flac')
+                with open(damaged_path, 'wb') as fileobj:
+                    fileobj.write(damaged)
+                with plibflac.Decoder(damaged_path,
+                                      errors='ignore') as decoder:
+                    decoder.seek(frames[9].sample_number)
+                    decoder.read(4096 * 3)
+                with plibflac.Decoder(damaged_path) as decoder:
+                    with self.assertRaises(plibflac.Error):
+                        decoder.seek(frames[10].sample_number + 100)
+                        decoder.read(1000)
+
+            # Limit the size of the cache
+            plibflac.set_shared_cache_size(100000)
+            info = plibflac.shared_cache_info()
+            self.assertLessEqual(info['size'], 100000)
+
+            plibflac.clear_shared_cache()
+            self.assertEqual(plibflac.shared_cache_info(), {
+                'hits': 0,
+                'misses': 0,
+                'size': 0,
+                'max_size': 100000,
+                'frames': 0,
+            })
+        finally:
+            plibflac.set_shared_cache_size(0)
+            plibflac.clear_shared_cache()
+
+    def test_multi_file_decoder(self):
+        """
+        Test reading a series of files as one stream.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+        total = len(expected[0])
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            bounds = [0, 100000, 100001, 350000, total]
+            paths = []
+            for i in range(len(bounds) - 1):
+                paths.append(os.path.join(tempdir, '{}.flac'.format(i)))
+                plibflac.extract(path, paths[i], bounds[i], bounds[i + 1])
+
+            with open(paths[1], 'rb') as fileobj:
+                files = [paths[0], fileobj, paths[2], paths[3]]
+                with plibflac.MultiFileDecoder(files) as decoder:
+                    self.assertEqual(decoder.segment_starts, bounds[:-1])
+                    self.assertEqual(decoder.total_samples, total)
+                    self.assertEqual(decoder.channels, 2)
+
+                    samples = decoder.read(total + 10)
+                    self.assertEqual([list(x) for x in samples], expected)
+                    self.assertIsNone(decoder.read(10))
+
+                    for start in (99000, 100000, 100001, 5000, 349999):
+                        decoder.seek(start)
+                        samples = decoder.read(20000)
+                        self.assertEqual(
+                            [list(x) for x in samples],
+                            [x[start:start + 20000] for x in expected])
+
+                    with self.assertRaises(plibflac.Error):
+                        decoder.seek(total + 1)
+
+    def test_read_stacked(self):
+        """
+        Test reading the same samples from many files.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            short_path = os.path.join(tempdir, 'short.flac')
+            plibflac.extract(path, short_path, 0, 300000)
+            missing_path = os.path.join(tempdir, 'missing.flac')
+
+            paths = [path, short_path, missing_path, path]
+            data, status = plibflac.read_stacked(paths, 250000, 350000)
+            self.assertEqual(data.shape, (4, 2, 100000))
+            self.assertEqual(status[:2], [100000, 50000])
+            self.assertIsInstance(status[2], OSError)
+            self.assertEqual(status[3], 100000)
+            data = data.tolist()
+            for c in range(2):
+                self.assertEqual(data[0][c], expected[c][250000:350000])
+                self.assertEqual(data[1][c], (expected[c][250000:300000]
+                                              + [0] * 50000))
+                self.assertEqual(data[2][c], [0] * 100000)
+
+            data, status = plibflac.read_stacked(paths[:1], 5, 10,
+                                                 channels=[1])
+            self.assertEqual(data.tolist(), [[expected[1][5:10]]])
+            data, status = plibflac.read_stacked(paths[:1], 0, 10,
+                                                 channels=[2])
+            self.assertIsInstance(status[0], ValueError)
+
     def test_properties(self):
         """
         Test setting decoder properties.
@@ -253,6 +703,190 @@ class TestDecoder(unittest.TestCase):
             with self.assertRaises(plibflac.Error):
                 decoder.close()
 
+    def test_stats(self):
+        """
+        Test computing sample statistics while decoding.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+
+        def _check(stats, samples):
+            self.assertEqual(stats['samples'], len(samples[0]))
+            self.assertEqual(stats['min'], [min(x) for x in samples])
+            self.assertEqual(stats['max'], [max(x) for x in samples])
+            self.assertEqual(stats['sum'], [sum(x) for x in samples])
+            self.assertEqual(stats['sum_squares'],
+                             [sum(v * v for v in x) for x in samples])
+            for histogram, x in zip(stats['histogram'], samples):
+                expected = [0] * 256
+                for v in x:
+                    expected[(v >> 8) + 128] += 1
+                self.assertEqual(list(histogram), expected)
+
+        with plibflac.Decoder(path, collect_stats=True,
+                              histogram_bits=8) as decoder:
+            self.assertEqual(decoder.stats['min'], [])
+            self.assertEqual(decoder.skip(1000), 1000)
+            part = decoder.read(500)
+            self.assertEqual(part, tuple(x[1000:1500] for x in data))
+            _check(decoder.stats, tuple(x[:1500] for x in data))
+            self.assertEqual(decoder.skip(10 ** 9), len(data[0]) - 1500)
+            self.assertEqual(decoder.skip(1000), 0)
+            _check(decoder.stats, data)
+
+            # Options cannot be changed while the stream is open
+            with self.assertRaises(ValueError):
+                decoder.collect_stats = False
+            with self.assertRaises(ValueError):
+                decoder.histogram_bits = 4
+            self.assertTrue(decoder.collect_stats)
+            self.assertEqual(decoder.histogram_bits, 8)
+
+        with plibflac.Decoder(path) as decoder:
+            self.assertIsNone(decoder.stats)
+            decoder.skip(123)
+            self.assertEqual(decoder.read(10),
+                             tuple(x[123:133] for x in data))
+
+        with self.assertRaises(ValueError):
+            plibflac.Decoder(path, histogram_bits=17)
+
+    def test_verify(self):
+        """
+        Test checking stream integrity.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            total_samples = decoder.total_samples
+
+        result = plibflac.Decoder(path).verify()
+        self.assertEqual(result, {'samples': total_samples, 'errors': [],
+                                  'md5': True, 'ok': True})
+
+        with open(path, 'rb') as fileobj:
+            data = bytearray(fileobj.read())
+        data[len(data) // 2] ^= 0x55
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            bad_path = os.path.join(tempdir, 'bad.flac')
+            with open(bad_path, 'wb') as fileobj:
+                fileobj.write(data)
+
+            result = plibflac.Decoder(bad_path).verify()
+            self.assertFalse(result['ok'])
+            self.assertFalse(result['md5'])
+            self.assertTrue(result['errors'])
+            for offset, sample_number, message in result['errors']:
+                self.assertLess(offset, len(data) // 2)
+                self.assertLess(sample_number, total_samples)
+
+            results = plibflac.verify([path, bad_path])
+            self.assertEqual(results[0]['md5'], True)
+            self.assertEqual(results[1], result)
+
+            # Divide the files into segments to be decoded in parallel.
+            segment_size = plibflac._verify._SEGMENT_SIZE
+            plibflac._verify._SEGMENT_SIZE = 30000
+            try:
+                results = plibflac.verify([path, bad_path], threads=4)
+            finally:
+                plibflac._verify._SEGMENT_SIZE = segment_size
+            self.assertEqual(results[0], {'samples': total_samples,
+                                          'errors': [], 'md5': True,
+                                          'ok': True})
+            self.assertFalse(results[1]['ok'])
+            self.assertFalse(results[1]['md5'])
+            self.assertEqual(results[1]['errors'], result['errors'])
+
+    def test_frame_reader(self):
+        """
+        Test reading compressed frames.
+        """
+        path = self.data_path('100s.flac')
+        with open(path, 'rb') as fileobj:
+            data = fileobj.read()
+        with plibflac.Decoder(path) as decoder:
+            decoder.read_metadata()
+            total_samples = decoder.total_samples
+
+        with plibflac.FrameReader(path) as reader:
+            self.assertEqual(reader.total_samples, total_samples)
+            frames = list(reader)
+        offset = frames[0].offset
+        sample_number = 0
+        for frame in frames:
+            self.assertEqual(frame.offset, offset)
+            self.assertEqual(frame.sample_number, sample_number)
+            self.assertEqual(frame.channels, 2)
+            self.assertEqual(frame.bits_per_sample, 16)
+            self.assertEqual(frame.crc, int.from_bytes(frame.data[-2:],
+                                                       'big'))
+            offset += len(frame.data)
+            sample_number += frame.blocksize
+        self.assertEqual(offset, len(data))
+        self.assertEqual(sample_number, total_samples)
+
+        # Read from a non-seekable file with a small buffer, and skip
+        # a damaged frame.
+        damaged = bytearray(data)
+        damaged[frames[5].offset + 100] ^= 0x55
+        rfd, wfd = os.pipe()
+        with open(rfd, 'rb') as rpipe, open(wfd, 'wb') as wpipe:
+            def copy_data():
+                try:
+                    wpipe.write(damaged)
+                finally:
+                    wpipe.close()
+            t = threading.Thread(target=copy_data)
+            t.start()
+            with plibflac.FrameReader(rpipe, buffer_size=1000) as reader:
+                self.assertEqual(list(reader), frames[:5] + frames[6:])
+            t.join()
+
+        # A damaged frame does not cause the rest of the file to be
+        # read into memory.
+        fileobj = _CountingBytesIO(damaged)
+        with plibflac.FrameReader(fileobj, buffer_size=1000) as reader:
+            for frame in reader:
+                if frame.offset >= frames[6].offset:
+                    break
+            self.assertEqual(frame, frames[6])
+            self.assertLess(fileobj.bytes_read, frames[8].offset)
+
+    def test_flac_array(self):
+        """
+        Test indexing a FLAC file as an array.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            expected = [list(x) for x in decoder.read(decoder.total_samples)]
+        total = len(expected[0])
+
+        with plibflac.FlacArray(path, cache_size=100000) as sig:
+            self.assertEqual(sig.shape, (total, 2))
+            self.assertEqual(len(sig), total)
+
+            self.assertEqual(sig[5].tolist(),
+                             [expected[0][5], expected[1][5]])
+            self.assertEqual(sig[-1, 1], expected[1][-1])
+            self.assertEqual(sig[100000:120000, 1].tolist(),
+                             expected[1][100000:120000])
+            self.assertEqual(sig[4000:4200].tolist(),
+                             [list(x) for x in zip(expected[0][4000:4200],
+                                                   expected[1][4000:4200])])
+            self.assertEqual(sig[-10:-30000:-7, :1].tolist(),
+                             [[x] for x in expected[0][-10:-30000:-7]])
+            self.assertEqual(sig[4000:4200, ::-1].tolist(),
+                             [list(x) for x in zip(expected[1][4000:4200],
+                                                   expected[0][4000:4200])])
+            self.assertEqual(sig[10:10].tolist(), [])
+
+            with self.assertRaises(IndexError):
+                sig[total]
+            with self.assertRaises(IndexError):
+                sig[0, 2]
+
     def data_path(self, name):
         return os.path.join(os.path.dirname(__file__), 'data', name)
 
@@ -6,19 +6,50 @@ Test cases for encoding using plibflac.
 
 import array
 import io
+import math
 import os
 import random
+import struct
+import sys
+import tempfile
 import unittest
+import wave
 
 import plibflac
 
 
+def _metadata_blocks(data):
+    # Parse the metadata blocks at the start of a FLAC stream.
+    assert data[:4] == b'fLaC'
+    pos = 4
+    is_last = False
+    while not is_last:
+        header = struct.unpack('>I', data[pos:pos + 4])[0]
+        is_last = bool(header & 0x80000000)
+        block_type = (header >> 24) & 0x7f
+        length = header & 0xffffff
+        yield (block_type, data[pos + 4:pos + 4 + length])
+        pos += 4 + length
+
+
 def _random_array(seed, length, min_value, max_value):
     rng = random.Random(seed)
     samples = (rng.randint(min_value, max_value) for _ in range(length))
     return array.array('i', samples)
 
 
+class _UnseekableBytesIO(io.BytesIO):
+    def seekable(self):
+        return False
+
+
+class _FailingBytesIO(io.BytesIO):
+    def write(self, data):
+        if self.tell() > 10000:
+            raise OSError("disk full")
+        return super().write(data)
+
+
 class TestEncoder(unittest.TestCase):
     def test_write_empty(self):
         """
@@ -96,6 +127,771 @@ class TestEncoder(unittest.TestCase):
                               num_threads=10) as encoder:
             encoder.write(data)
 
+    def test_write_buffered(self):
+        """
+        Test encoding into a buffered file object.
+        """
+        channel0 = _random_array(1234, 5000, -32768, 32767)
+        channel1 = _random_array(5678, 5000, -32768, 32767)
+
+        with tempfile.TemporaryFile() as fileobj:
+            # Data written to the buffered stream before and after
+            # encoding should be preserved.
+            fileobj.write(b'header')
+            with plibflac.Encoder(fileobj) as encoder:
+                encoder.write([channel0, channel1])
+            fileobj.seek(0, io.SEEK_END)
+            fileobj.write(b'trailer')
+
+            fileobj.seek(0)
+            self.assertEqual(fileobj.read(6), b'header')
+            with plibflac.Decoder(fileobj) as decoder:
+                data = decoder.read(5000)
+            self.assertEqual(data[0], channel0)
+            self.assertEqual(data[1], channel1)
+            fileobj.seek(-7, io.SEEK_END)
+            self.assertEqual(fileobj.read(), b'trailer')
+
+    def test_encode_many(self):
+        """
+        Test encoding multiple files in parallel.
+        """
+        with tempfile.TemporaryDirectory() as tempdir:
+            jobs = []
+            for i in range(8):
+                path = os.path.join(tempdir, '{}.flac'.format(i))
+                samples = [_random_array(i, 3000 + i, -128, 127)]
+                options = {'channels': 1, 'bits_per_sample': 8}
+                jobs.append((path, samples, options))
+            jobs.append((io.BytesIO(), [array.array('i')] * 2))
+
+            plibflac.encode_many(jobs, max_workers=4)
+
+            for path, samples, _ in jobs[:-1]:
+                with plibflac.Decoder(path) as decoder:
+                    self.assertEqual(decoder.channels, 1)
+                    self.assertEqual(decoder.bits_per_sample, 8)
+                    data = decoder.read(decoder.total_samples)
+                    self.assertEqual(data[0], samples[0])
+
+        with self.assertRaises(plibflac.Error):
+            plibflac.encode_many([(io.BytesIO(), [array.array('i', [0])],
+                                   {'channels': 1, 'bits_per_sample': 2})])
+
+    def test_group(self):
+        """
+        Test writing and reading a record divided into multiple files.
+        """
+        samples = [_random_array(i, 5000, -128, 127) for i in range(20)]
+        shards = [io.BytesIO() for _ in range(3)]
+        with plibflac.GroupEncoder(shards, channels=20,
+                                   bits_per_sample=8) as encoder:
+            self.assertEqual(encoder.shard_channels, [7, 7, 6])
+            encoder.write([s[:3000] for s in samples])
+            encoder.write([s[3000:] for s in samples])
+
+        for shard in shards:
+            shard.seek(0)
+        with plibflac.GroupDecoder(shards) as decoder:
+            self.assertEqual(decoder.channels, 20)
+            self.assertEqual(decoder.shard_channels, [7, 7, 6])
+            self.assertEqual(decoder.total_samples, 5000)
+
+            data = decoder.read(1000, [15, 2])
+            self.assertEqual(data[0], samples[15][:1000])
+            self.assertEqual(data[1], samples[2][:1000])
+            self.assertIsNone(decoder._decoders[1])
+
+            data = decoder.read(2000)
+            self.assertEqual(len(data), 20)
+            for i in range(20):
+                self.assertEqual(data[i], samples[i][1000:3000])
+
+            decoder.seek(4990)
+            data = decoder.read(100, [19, 0], interleave=True)
+            self.assertEqual(data.shape, (10, 2))
+            self.assertEqual(data.tolist(),
+                             [[samples[19][i], samples[0][i]]
+                              for i in range(4990, 5000)])
+            self.assertIsNone(decoder.read(100))
+
+        with self.assertRaises(ValueError):
+            plibflac.GroupEncoder([io.BytesIO()], channels=9)
+
+    def test_autotune(self):
+        """
+        Test automatic selection of compression options.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(100000)
+
+        # Record the number of samples used for auto-tuning
+        trial_lengths = []
+
+        class _Encoder(plibflac.Encoder):
+            def _autotune(self, samples):
+                trial_lengths.append(len(samples[0]))
+                super()._autotune(samples)
+
+        results = []
+        for speed in (0, 1e300):
+            fileobj = io.BytesIO()
+            with _Encoder(fileobj, autotune_speed=speed,
+                          autotune_window=20000) as encoder:
+                self.assertIsNone(encoder.autotune_result)
+                encoder.write([x[:5000] for x in data])
+                self.assertIsNone(encoder.autotune_result)
+                with self.assertRaises(ValueError):
+                    encoder.autotune_speed = None
+                with self.assertRaises(ValueError):
+                    encoder.autotune_window = 1000
+                encoder.write([x[5000:] for x in data])
+                result = encoder.autotune_result
+                self.assertIsNotNone(result)
+                self.assertEqual(encoder.blocksize, result['blocksize'])
+                self.assertEqual(encoder.max_lpc_order,
+                                 result['max_lpc_order'])
+            results.append(result)
+
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.total_samples, 100000)
+                self.assertEqual(decoder.read(100000), data)
+
+        # With no speed limit, the best compression should be chosen;
+        # with an impossible limit, one of the candidates (whichever
+        # was measured to be fastest) should be chosen.
+        self.assertEqual(trial_lengths, [20000, 20000])
+        self.assertGreater(results[0]['max_lpc_order'], 0)
+        candidates = [dict(zip(plibflac._encoder._AUTOTUNE_NAMES, values))
+                      for values in plibflac._encoder._AUTOTUNE_CANDIDATES]
+        self.assertIn(results[1], candidates)
+
+        # Stream shorter than the auto-tuning window
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, autotune_speed=0) as encoder:
+            encoder.write([x[:1000] for x in data])
+        self.assertIsNotNone(encoder.autotune_result)
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.read(2000),
+                             tuple(x[:1000] for x in data))
+
+    def test_stats(self):
+        """
+        Test collecting encoder statistics.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(10000)
+
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, collect_stats=True,
+                              blocksize=1024) as encoder:
+            encoder.write(data)
+            with self.assertRaises(ValueError):
+                encoder.collect_stats = False
+            stats = encoder.stats
+            self.assertEqual(list(stats['frame_number']), list(range(9)))
+            self.assertEqual(list(stats['frame_samples']), [1024] * 9)
+        stats = encoder.stats
+
+        self.assertEqual(list(stats['frame_number']), list(range(10)))
+        self.assertEqual(list(stats['frame_samples']),
+                         [1024] * 9 + [10000 - 9 * 1024])
+        self.assertEqual(stats['bytes_written'], len(fileobj.getvalue()))
+        self.assertLess(sum(stats['frame_bytes']), stats['bytes_written'])
+        self.assertGreater(stats['encode_time'], 0)
+
+        with plibflac.Encoder(io.BytesIO()) as encoder:
+            encoder.write(data)
+        self.assertEqual(len(encoder.stats['frame_bytes']), 0)
+
+    def test_seektable(self):
+        """
+        Test writing a seek table and padding.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(decoder.total_samples)
+
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, total_samples_estimate=len(data[0]),
+                              seekpoint_interval=96000,
+                              padding=1000) as encoder:
+            encoder.write(data)
+
+        blocks = dict(_metadata_blocks(fileobj.getvalue()))
+        self.assertEqual(sorted(blocks), [0, 1, 3, 4])
+        self.assertEqual(len(blocks[1]), 1000)
+
+        points = [struct.unpack('>QQH', blocks[3][i:i + 18])
+                  for i in range(0, len(blocks[3]), 18)]
+        self.assertEqual(len(points), 7)
+        for i, (sample, offset, frame_samples) in enumerate(points):
+            self.assertLessEqual(sample, i * 96000)
+            self.assertGreater(sample + frame_samples, i * 96000)
+        self.assertEqual(points[0][1], 0)
+        self.assertEqual(sorted(points), points)
+
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            decoder.seek(400000)
+            self.assertEqual(decoder.read(10),
+                             tuple(x[400000:400010] for x in data))
+
+        # Seek points are reserved if the length is unknown
+        for max_seekpoints, interval, count in ((None, 96000, 7),
+                                                (4, 192000, 4),
+                                                (5, 192000, 4)):
+            fileobj = io.BytesIO()
+            with plibflac.Encoder(fileobj, seekpoint_interval=96000,
+                                  max_seekpoints=max_seekpoints) as encoder:
+                for i in range(0, len(data[0]), 10000):
+                    encoder.write([x[i:i + 10000] for x in data])
+
+            blocks = dict(_metadata_blocks(fileobj.getvalue()))
+            points = [struct.unpack('>QQH', blocks[3][i:i + 18])
+                      for i in range(0, len(blocks[3]), 18)]
+            self.assertEqual(len(points), max_seekpoints or 128)
+            for i, (sample, offset, frame_samples) in enumerate(points):
+                if i < count:
+                    self.assertLessEqual(sample, i * interval)
+                    self.assertGreater(sample + frame_samples, i * interval)
+                else:
+                    self.assertEqual(sample, 0xffffffffffffffff)
+
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                for i, (sample, offset, frame_samples) in enumerate(points):
+                    if i < count:
+                        decoder.seek(sample)
+                        self.assertEqual(decoder.read(10), tuple(
+                            x[sample:sample + 10] for x in data))
+                decoder.seek(400000)
+                self.assertEqual(decoder.read(10),
+                                 tuple(x[400000:400010] for x in data))
+
+        # Seek table is omitted if output isn't seekable
+        fileobj = _UnseekableBytesIO()
+        with plibflac.Encoder(fileobj, total_samples_estimate=len(data[0]),
+                              seekpoint_interval=96000) as encoder:
+            encoder.write(data)
+        blocks = dict(_metadata_blocks(fileobj.getvalue()))
+        self.assertEqual(sorted(blocks), [0, 4])
+
+    def test_write_async(self):
+        """
+        Test encoding in a background thread.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(decoder.total_samples)
+
+        sync_fileobj = io.BytesIO()
+        with plibflac.Encoder(sync_fileobj) as encoder:
+            for i in range(0, len(data[0]), 10000):
+                encoder.write([x[i:i + 10000] for x in data])
+
+        async_fileobj = io.BytesIO()
+        buffers = [array.array('i', [0] * 10000) for _ in data]
+        with plibflac.Encoder(async_fileobj, queue_size=4) as encoder:
+            for i in range(0, len(data[0]), 10000):
+                # Caller may reuse buffers after write returns
+                for buf, x in zip(buffers, data):
+                    del buf[:]
+                    buf.extend(x[i:i + 10000])
+                encoder.write(buffers)
+            with self.assertRaises(ValueError):
+                encoder.write([data[0]])
+            with self.assertRaises(ValueError):
+                encoder.queue_size = 0
+
+        self.assertEqual(async_fileobj.getvalue(), sync_fileobj.getvalue())
+
+        # Errors are reported by a later call to write or close
+        encoder = plibflac.Encoder(_FailingBytesIO(), queue_size=1)
+        with self.assertRaises(OSError):
+            for i in range(0, len(data[0]), 10000):
+                encoder.write([x[i:i + 10000] for x in data])
+        with self.assertRaises(OSError):
+            encoder.close()
+        encoder.close()
+
+    def test_flush(self):
+        """
+        Test flushing partial blocks in low-latency mode.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(20000)
+
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, blocksize=4096, collect_stats=True,
+                              max_latency_ms=math.inf) as encoder:
+            for start, end, flushed in ((0, 1000, 1000),
+                                        (1000, 6000, 6000),
+                                        (6000, 6010, 6000),
+                                        (6010, 6020, 6020)):
+                encoder.write([x[start:end] for x in data])
+                encoder.flush()
+                with self.assertRaises(ValueError):
+                    encoder.max_latency_ms = None
+
+                # Everything written so far can be decoded, except
+                # for blocks that would be shorter than 16 samples
+                with plibflac.Decoder(io.BytesIO(fileobj.getvalue())) as d:
+                    self.assertEqual(d.read(20000),
+                                     tuple(x[:flushed] for x in data))
+            encoder.write([x[6020:] for x in data])
+
+        self.assertEqual(list(encoder.stats['frame_number']),
+                         list(range(8)))
+        self.assertEqual(list(encoder.stats['frame_samples']),
+                         [1000, 4096, 904, 20, 4096, 4096, 4096, 1692])
+
+        info = dict(_metadata_blocks(fileobj.getvalue()))[0]
+        min_blocksize, max_blocksize, total = struct.unpack(
+            '>HH6xQ16x', info)
+        self.assertGreaterEqual(min_blocksize, 16)
+        self.assertEqual(max_blocksize, 4096)
+        self.assertEqual(total & 0xfffffffff, 20000)
+
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.total_samples, 20000)
+            self.assertEqual(decoder.read(20000), data)
+            decoder.seek(5000)
+            self.assertEqual(decoder.read(10),
+                             tuple(x[5000:5010] for x in data))
+
+        # Samples are flushed automatically after max_latency_ms
+        with tempfile.TemporaryFile() as fileobj:
+            with plibflac.Encoder(fileobj, max_latency_ms=0) as encoder:
+                for i in range(0, 20000, 3000):
+                    encoder.write([x[i:i + 3000] for x in data])
+                    self.assertEqual(encoder.stats['bytes_written'],
+                                     os.fstat(fileobj.fileno()).st_size)
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.read(20000), data)
+
+    def test_append(self):
+        """
+        Test appending samples to an existing stream.
+        """
+        with plibflac.Decoder(self.data_path('100s.flac')) as decoder:
+            data = decoder.read(20000)
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            path = os.path.join(tempdir, 'test.flac')
+            with plibflac.Encoder(path, append=True, blocksize=4096,
+                                  total_samples_estimate=20000,
+                                  seekpoint_interval=4096) as encoder:
+                encoder.write([x[:10000] for x in data])
+            for start, end in ((10000, 10000), (10000, 15000),
+                               (15000, 20000)):
+                with plibflac.Encoder(path, append=True) as encoder:
+                    self.assertEqual(encoder.blocksize, 4096)
+                    encoder.write([x[start:end] for x in data])
+
+            with self.assertRaises(ValueError):
+                plibflac.Encoder(path, append=True, channels=1)
+            with self.assertRaises(ValueError):
+                plibflac.Encoder(path, append=True, blocksize=1024)
+
+            with open(path, 'rb') as fileobj:
+                blocks = dict(_metadata_blocks(fileobj.read()))
+            total, md5sum = struct.unpack('>10xQ16s', blocks[0])
+            self.assertEqual(total & 0xfffffffff, 20000)
+            self.assertEqual(md5sum, bytes(16))
+            points = [struct.unpack('>QQH', blocks[3][i:i + 18])
+                      for i in range(0, len(blocks[3]), 18)]
+            self.assertEqual([p[0] for p in points],
+                             [0, 4096, 8192, 12288, 16384])
+            self.assertEqual([p[2] for p in points],
+                             [4096, 4096, 4096, 4096, 3616])
+
+            with plibflac.Decoder(path) as decoder:
+                self.assertEqual(decoder.total_samples, 20000)
+                self.assertEqual(decoder.read(20000), data)
+                decoder.seek(13000)
+                self.assertEqual(decoder.read(10),
+                                 tuple(x[13000:13010] for x in data))
+
+        # Appending to a variable-blocksize stream
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, max_latency_ms=0) as encoder:
+            encoder.write([x[:3000] for x in data])
+        fileobj.seek(0)
+        with plibflac.Encoder(fileobj, append=True) as encoder:
+            encoder.write([x[3000:] for x in data])
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.total_samples, 20000)
+            self.assertEqual(decoder.read(20000), data)
+
+        # Tags at the end of the file are moved after the new frames
+        id3 = b'TAG' + bytes(125)
+        ape = (b'APETAGEX' + struct.pack('<IIII', 2000, 32, 0, 0)
+               + bytes(8))
+        for trailer in (id3, ape, ape + id3):
+            fileobj = io.BytesIO()
+            with plibflac.Encoder(fileobj, blocksize=4096) as encoder:
+                encoder.write([x[:10000] for x in data])
+            fileobj.seek(0, io.SEEK_END)
+            fileobj.write(trailer)
+            fileobj.seek(0)
+            with plibflac.Encoder(fileobj, append=True) as encoder:
+                encoder.write([x[10000:] for x in data])
+            self.assertTrue(fileobj.getvalue().endswith(trailer))
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.total_samples, 20000)
+                self.assertEqual(decoder.read(20000), data)
+
+    def test_transcode(self):
+        """
+        Test decoding and re-encoding a stream.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+
+        for options in ({}, {'threads': True},
+                        {'autotune_speed': 0, 'autotune_window': 10000}):
+            with tempfile.TemporaryFile() as fileobj:
+                count = plibflac.transcode(path, fileobj,
+                                           compression_level=0,
+                                           **options)
+                self.assertEqual(count, len(data[0]))
+                fileobj.seek(0)
+                with plibflac.Decoder(fileobj) as decoder:
+                    self.assertEqual(decoder.sample_rate, 96000)
+                    self.assertEqual(decoder.total_samples, len(data[0]))
+                    self.assertEqual(decoder.read(len(data[0]) + 1), data)
+
+        # Remaining samples are encoded after reading part of the stream
+        fileobj = io.BytesIO()
+        with plibflac.Decoder(path) as decoder:
+            decoder.read(1000)
+            with plibflac.Encoder(fileobj, channels=2,
+                                  sample_rate=96000) as encoder:
+                encoder._transcode_from(decoder)
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.read(len(data[0])),
+                             tuple(x[1000:] for x in data))
+
+        with self.assertRaises(ValueError):
+            plibflac.transcode(path, io.BytesIO(), bits_per_sample=24)
+
+    def test_concatenate(self):
+        """
+        Test joining streams without re-encoding.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+        n = len(data[0])
+
+        # Inputs with a partial block: variable block size
+        fileobj = io.BytesIO()
+        self.assertEqual(plibflac.concatenate([path, path], fileobj), 2 * n)
+        fileobj.seek(0)
+        with plibflac.FrameReader(fileobj) as reader:
+            self.assertTrue(next(reader).data[1] & 1)
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj, md5_checking=True) as decoder:
+            self.assertEqual(decoder.total_samples, 2 * n)
+            self.assertEqual(decoder.read(n), data)
+            self.assertEqual(decoder.read(n + 1), data)
+            decoder.seek(n + 12345)
+            self.assertEqual(decoder.read(10),
+                             tuple(x[12345:12355] for x in data))
+
+        # Inputs with whole blocks: fixed block size
+        parts = []
+        for start, end in ((0, 40960), (40960, 81920), (81920, 100000)):
+            part = io.BytesIO()
+            with plibflac.Encoder(part, channels=2, bits_per_sample=16,
+                                  sample_rate=96000, blocksize=4096) as enc:
+                enc.write(tuple(x[start:end] for x in data))
+            part.seek(0)
+            parts.append(part)
+        fileobj = io.BytesIO()
+        self.assertEqual(plibflac.concatenate(parts, fileobj,
+                                              seekpoint_interval=0),
+                         100000)
+        fileobj.seek(0)
+        with plibflac.FrameReader(fileobj) as reader:
+            frames = list(reader)
+        self.assertFalse(any(frame.data[1] & 1 for frame in frames))
+        self.assertEqual([frame.sample_number for frame in frames],
+                         list(range(0, 100000, 4096)))
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.read(100001),
+                             tuple(x[:100000] for x in data))
+
+        # Final frames shorter than 16 samples are merged with the
+        # following frame
+        parts = []
+        for start, end in ((0, 8202), (8202, 8207), (8207, 20000)):
+            part = io.BytesIO()
+            with plibflac.Encoder(part, channels=2, bits_per_sample=16,
+                                  sample_rate=96000, blocksize=4096) as enc:
+                enc.write(tuple(x[start:end] for x in data))
+            part.seek(0)
+            parts.append(part)
+        fileobj = io.BytesIO()
+        self.assertEqual(plibflac.concatenate(parts, fileobj), 20000)
+        fileobj.seek(0)
+        with plibflac.FrameReader(fileobj) as reader:
+            sizes = [frame.blocksize for frame in reader]
+        self.assertEqual(sum(sizes), 20000)
+        self.assertGreaterEqual(min(sizes[:-1]), 16)
+        self.assertLessEqual(max(sizes), 4096)
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.read(20001),
+                             tuple(x[:20000] for x in data))
+
+        other = io.BytesIO()
+        with plibflac.Encoder(other, channels=2, bits_per_sample=16,
+                              sample_rate=44100) as encoder:
+            encoder.write(tuple(x[:1000] for x in data))
+        other.seek(0)
+        with self.assertRaises(ValueError):
+            plibflac.concatenate([path, other], io.BytesIO())
+
+    def test_extract(self):
+        """
+        Test copying part of a stream.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+        with plibflac.FrameReader(path) as reader:
+            bodies = {frame.data[-64:-2] for frame in reader}
+        n = len(data[0])
+
+        for start, stop in ((0, n), (12345, 600000), (4096, 8192),
+                            (5000, 5001), (100, 100), (n - 10, n),
+                            (4095, 20000), (4090, 4100)):
+            fileobj = io.BytesIO()
+            self.assertEqual(plibflac.extract(path, fileobj, start, stop),
+                             stop - start)
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.total_samples, stop - start)
+                self.assertEqual(decoder.read(n),
+                                 tuple(x[start:stop] for x in data)
+                                 if stop > start else None)
+
+            # Whole frames are copied, apart from the header and CRC.
+            # Only the last frame may be shorter than 16 samples.
+            fileobj.seek(0)
+            with plibflac.FrameReader(fileobj) as reader:
+                frames = list(reader)
+            copied = sum(frame.data[-64:-2] in bodies for frame in frames)
+            self.assertGreaterEqual(copied, (stop - start) // 4096 - 1)
+            self.assertGreaterEqual(
+                min([frame.blocksize for frame in frames[:-1]] or [16]), 16)
+
+        with self.assertRaises(ValueError):
+            plibflac.extract(path, io.BytesIO(), 10, n + 1)
+
+    def test_add_seektable(self):
+        """
+        Test adding a seek table to an existing file.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+        with open(path, 'rb') as fileobj:
+            original = fileobj.read()
+
+        def _check(fileobj, interval, size):
+            self.assertEqual(fileobj.seek(0, io.SEEK_END), size)
+            fileobj.seek(0)
+            with plibflac.FrameReader(fileobj) as reader:
+                offsets = {frame.sample_number:
+                           frame.offset - reader.audio_start
+                           for frame in reader}
+            fileobj.seek(0)
+            blocks = list(_metadata_blocks(fileobj.read()))
+            seektables = [body for block_type, body in blocks
+                          if block_type == 3]
+            self.assertEqual(len(seektables), 1)
+            points = [struct.unpack('>QQH', seektables[0][i:i + 18])
+                      for i in range(0, len(seektables[0]), 18)]
+            self.assertEqual(len(points), -(-len(data[0]) // interval))
+            for sample_number, offset, samples in points:
+                self.assertEqual(offsets[sample_number], offset)
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                decoder.seek(500000)
+                self.assertEqual(decoder.read(10),
+                                 tuple(x[500000:500010] for x in data))
+
+        # No padding: the frames are moved.
+        fileobj = io.BytesIO(original)
+        self.assertEqual(plibflac.add_seektable(fileobj, 96000), 7)
+        _check(fileobj, 96000, len(original) + 4 + 7 * 18)
+
+        with tempfile.TemporaryDirectory() as tempdir:
+            path = os.path.join(tempdir, 'padded.flac')
+            with plibflac.Encoder(path, channels=2, bits_per_sample=16,
+                                  sample_rate=96000, padding=1000) as enc:
+                enc.write(data)
+            size = os.path.getsize(path)
+
+            # The seek table fits in the existing padding.
+            self.assertEqual(plibflac.add_seektable(path), 1)
+            with open(path, 'rb') as fileobj:
+                _check(fileobj, 960000, size)
+
+            # The seek table is replaced, and the frames are moved.
+            self.assertEqual(plibflac.add_seektable(path, 9600), 68)
+            with open(path, 'rb') as fileobj:
+                _check(fileobj, 9600, size - 1004 + 4 + 68 * 18)
+
+    def test_convert_raw(self):
+        """
+        Test converting between FLAC and raw PCM or WAV files.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+        n = len(data[0])
+
+        with tempfile.TemporaryFile() as wav:
+            self.assertEqual(plibflac.decode_file(path, wav, 'wav'), n)
+            wav.seek(0)
+            with wave.open(wav, 'rb') as reader:
+                self.assertEqual(reader.getnchannels(), 2)
+                self.assertEqual(reader.getsampwidth(), 2)
+                self.assertEqual(reader.getframerate(), 96000)
+                self.assertEqual(reader.getnframes(), n)
+                frames = reader.readframes(n)
+            samples = array.array('h', frames)
+            if sys.byteorder == 'big':
+                samples.byteswap()
+            self.assertEqual(list(samples[0::2]), list(data[0]))
+            self.assertEqual(list(samples[1::2]), list(data[1]))
+
+            wav.seek(0)
+            fileobj = io.BytesIO()
+            self.assertEqual(plibflac.encode_file(wav, fileobj, 'wav'), n)
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.sample_rate, 96000)
+                self.assertEqual(decoder.read(n + 1), data)
+
+        for layout in ('>i4', 'i3', '<i2'):
+            with tempfile.TemporaryFile() as raw:
+                self.assertEqual(plibflac.decode_file(path, raw, layout), n)
+                self.assertEqual(raw.tell(), n * 2 * int(layout[-1]))
+                raw.seek(0)
+                fileobj = io.BytesIO()
+                plibflac.encode_file(raw, fileobj, layout, channels=2,
+                                     bits_per_sample=16, sample_rate=96000)
+                fileobj.seek(0)
+                with plibflac.Decoder(fileobj) as decoder:
+                    self.assertEqual(decoder.read(n + 1), data)
+
+        # 8-bit samples are unsigned in WAV files; odd-sized data
+        # chunks are padded
+        data8 = (array.array('i', [-128, -1, 0, 1, 127]),)
+        flac8 = io.BytesIO()
+        with plibflac.Encoder(flac8, channels=1, bits_per_sample=8) as encoder:
+            encoder.write(data8)
+        for layout in ('u1', 'wav'):
+            flac8.seek(0)
+            with tempfile.TemporaryFile() as raw:
+                plibflac.decode_file(flac8, raw, layout)
+                raw.seek(0)
+                contents = raw.read()
+                if layout == 'u1':
+                    self.assertEqual(contents, bytes([0, 127, 128, 129, 255]))
+                else:
+                    self.assertEqual(contents[-6:],
+                                     bytes([0, 127, 128, 129, 255, 0]))
+                    riff_size, = struct.unpack('<I', contents[4:8])
+                    self.assertEqual(riff_size, len(contents) - 8)
+                raw.seek(0)
+                fileobj = io.BytesIO()
+                plibflac.encode_file(raw, fileobj, layout, channels=1)
+                fileobj.seek(0)
+                with plibflac.Decoder(fileobj) as decoder:
+                    self.assertEqual(decoder.read(10), data8)
+
+        with self.assertRaises(ValueError):
+            plibflac.decode_file(path, io.BytesIO(), 'x2')
+        with tempfile.TemporaryFile() as raw:
+            with self.assertRaises(ValueError):
+                plibflac.decode_file(path, raw, 'i1')
+            raw.write(bytes(5))
+            raw.seek(0)
+            with self.assertRaises(ValueError):
+                plibflac.encode_file(raw, io.BytesIO(), 'i2', channels=2)
+
+    def test_envelope(self):
+        """
+        Test storing and retrieving a min/max envelope.
+        """
+        path = self.data_path('100s.flac')
+        with plibflac.Decoder(path) as decoder:
+            data = decoder.read(decoder.total_samples)
+        n = len(data[0])
+
+        def _expected(start, stop, resolution):
+            return tuple(
+                (array.array('i', [min(x[i:i + resolution])
+                                   for i in range(start, stop, resolution)]),
+                 array.array('i', [max(x[i:i + resolution])
+                                   for i in range(start, stop, resolution)]))
+                for x in data)
+
+        for options in ({},
+                        {'total_samples_estimate': n, 'padding': 100},
+                        {'total_samples_estimate': n // 2, 'padding': 100},
+                        {'seekpoint_interval': 10000}):
+            fileobj = io.BytesIO()
+            with plibflac.Encoder(fileobj, channels=2, sample_rate=96000,
+                                  envelope_interval=50, **options) as encoder:
+                encoder.write(tuple(x[:5000] for x in data))
+                encoder.write(tuple(x[5000:] for x in data))
+
+            blocks = list(_metadata_blocks(fileobj.getvalue()))
+            self.assertIn(2, [block_type for block_type, _ in blocks])
+            if options.get('padding'):
+                self.assertIn((1, bytes(100)), blocks)
+
+            fileobj.seek(0)
+            with plibflac.Decoder(fileobj) as decoder:
+                self.assertEqual(decoder.envelope(0, n, 50),
+                                 _expected(0, n, 50))
+                self.assertEqual(decoder.envelope(800, 4000, 800),
+                                 _expected(800, 4000, 800))
+                self.assertEqual(decoder.envelope(0, n * 2, n),
+                                 _expected(0, n, n))
+                decoder.seek(5000)
+                self.assertEqual(decoder.read(n),
+                                 tuple(x[5000:] for x in data))
+
+        fileobj = io.BytesIO()
+        with plibflac.Encoder(fileobj, channels=2, sample_rate=96000,
+                              envelope_interval=50) as encoder:
+            pass
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertEqual(decoder.envelope(0, 100, 10),
+                             ((array.array('i'), array.array('i')),) * 2)
+
+        fileobj.seek(0)
+        plibflac.transcode(path, fileobj)
+        fileobj.seek(0)
+        with plibflac.Decoder(fileobj) as decoder:
+            self.assertIsNone(decoder.envelope(0, n, 100))
+
     def data_path(self, name):
         return os.path.join(os.path.dirname(__file__), 'data', name)
 